@@ -0,0 +1,59 @@
+#pragma once
+#include "GraphicsUtils.h"
+
+namespace Core
+{
+    class Renderer;
+
+    // Describes a compute pipeline: its shader, the bindings of the descriptor sets it owns and the layouts of the shared sets bound after them.
+    struct ComputePipelineDesc
+    {
+        const char*                        filename;
+        std::vector<std::string>           defines;
+        std::vector<VkDescriptorType>      bindings;             // Type of each binding of the pipeline's own descriptor sets, empty if it owns none.
+        std::vector<uint32_t>              bindingCounts;        // Number of descriptors in each binding, one for every binding if empty.
+        uint32_t                           setCount         = 0; // Number of own descriptor sets, usually one per frame in flight.
+        std::vector<VkDescriptorSetLayout> sharedSetLayouts;     // Layouts of descriptor sets owned elsewhere, bound after the pipeline's own set.
+        uint32_t                           pushConstantSize = 0;
+    };
+
+    // - ComputePipeline: Compute shader along with its pipeline layout and own descriptor sets - //
+    // * Dispatches can be recorded in the frame's command buffer or in the renderer's async compute command buffer. * //
+    class ComputePipeline
+    {
+    private:
+        VkDevice                      vkDevice              = nullptr;
+        VkDescriptorSetLayout         vkDescriptorSetLayout = nullptr;
+        VkDescriptorPool              vkDescriptorPool      = nullptr;
+        VkPipelineLayout              vkPipelineLayout      = nullptr;
+        VkPipeline                    vkPipeline            = nullptr;
+        std::vector<VkDescriptorSet>  vkDescriptorSets;
+        std::vector<VkDescriptorType> bindingTypes;
+        uint32_t                      pushConstantSize      = 0;
+
+    public:
+        ComputePipeline(const Renderer* renderer, const ComputePipelineDesc& desc);
+        ComputePipeline(const ComputePipeline&)            = delete;
+        ComputePipeline(ComputePipeline&&)                 = delete;
+        ComputePipeline& operator=(const ComputePipeline&) = delete;
+        ComputePipeline& operator=(ComputePipeline&&)      = delete;
+        ~ComputePipeline();
+
+        // Points the given binding of one of the pipeline's own descriptor sets to a region of a buffer.
+        void WriteBuffer(const uint32_t& set, const uint32_t& binding, const VkBuffer& buffer, const VkDeviceSize& offset, const VkDeviceSize& range) const;
+
+        // Points the given binding of one of the pipeline's own descriptor sets to image views in the given layout, starting at its first descriptor.
+        void WriteImages(const uint32_t& set, const uint32_t& binding, const std::vector<VkImageView>& imageViews, const VkImageLayout& imageLayout) const;
+
+        // Binds the pipeline along with one of its own descriptor sets if it has any, followed by the given shared sets and their dynamic offsets.
+        void Bind(const VkCommandBuffer& commandBuffer, const uint32_t& set = 0, const std::vector<VkDescriptorSet>& sharedSets = {}, const std::vector<uint32_t>& dynamicOffsets = {}) const;
+
+        // Pushes constants of the size given when creating the pipeline.
+        void PushConstants(const VkCommandBuffer& commandBuffer, const void* data) const;
+
+        // Records a dispatch of the given number of work groups, once the pipeline is bound.
+        void Dispatch(const VkCommandBuffer& commandBuffer, const uint32_t& groupCountX, const uint32_t& groupCountY = 1, const uint32_t& groupCountZ = 1) const;
+
+        VkPipelineLayout GetVkPipelineLayout() const { return vkPipelineLayout; }
+    };
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "Core/FrustumCuller.h"
 #include "Resources/Light.h"
 #include "Resources/Model.h"
 #include "Resources/Material.h"
@@ -10,6 +11,7 @@ namespace Resources
 {
 	class Camera;
 	class Model;
+	class Mesh;
 	class Material;
 	class Texture;
 	class Light;
@@ -23,9 +25,11 @@ namespace Core
 	class Engine
 	{
 	public:
-		static constexpr size_t MAX_LIGHTS    = 5;
-		static constexpr size_t MAX_MODELS    = 1000;
-		static constexpr size_t MAX_MATERIALS = 5000;
+		static constexpr size_t MAX_LIGHTS    = 4096; // Size of each frame's light buffer, lights are binned into clusters on the GPU.
+		static constexpr size_t MAX_INSTANCES = 16384; // Maximum number of mesh instances drawn each frame.
+		static constexpr size_t MAX_MATERIALS = 5000; // Size of the material buffer, materials don't use descriptor sets of their own.
+		static constexpr size_t MAX_VERTICES  = 1 << 20; // Size of the shared vertex buffer, larger meshes get their own buffers.
+		static constexpr size_t MAX_INDICES   = 1 << 22; // Size of the shared index buffer.
 		
 	private:
         Application*       app    = nullptr;
@@ -36,6 +40,15 @@ namespace Core
 		std::unordered_map<std::string, Resources::Material> materials;
 		std::unordered_map<std::string, Resources::Texture>  textures;
 
+		// Frustum culling state, kept between frames to reuse allocations.
+		FrustumCuller                            frustumCuller;
+		bool                                     frustumCullingEnabled = true;
+		std::vector<BoundingSphere>              cullSpheres;
+		std::vector<uint8_t>                     cullVisibility;
+		std::vector<const Resources::Model*>     cullModels;
+		std::vector<const Resources::Mesh*>      cullMeshes;
+		std::vector<uint32_t>                    cullMeshModels; // Index in cullModels of each mesh's model.
+
 	public:
 		float cameraSpeed       = 2;
 		float cameraSensitivity = 5e-3f;
@@ -52,6 +65,7 @@ namespace Core
 			// R"(Resources\Models\Headcrab\headcrab.obj)",
 			// R"(Resources\Models\DoomSlayer\doommarine.obj)",
 			// R"(Resources\Models\Sponza\sponza.obj)",
+			// R"(Resources\Models\ItemBox\box.obj)",
 			// R"(Resources\Models\Gizmo\gizmoTranslation.obj)",
 		};
 		
@@ -65,7 +79,16 @@ namespace Core
 		void Awake();
 		void Start();
 		void Update(const float& deltaTime);
-		void Render(Renderer* renderer) const;
+		void Render(Renderer* renderer);
+
+		// Models and meshes outside of the camera frustum are culled on the CPU before being drawn.
+		void SetFrustumCullingEnabled(const bool& enabled) { frustumCullingEnabled = enabled; }
+		bool IsFrustumCullingEnabled() const { return frustumCullingEnabled; }
+		void BenchmarkFrustumCulling() const;
+
+		// Keeps the first light and scatters point lights above the ground until there are the given number of lights, to measure the lighting's scalability.
+		void   ScatterLights(const size_t& count);
+		size_t GetLightCount() const { return lights.size(); }
 
 		void LoadFile(const std::string& filename, int additionalParamsCount = 0, ...);
 
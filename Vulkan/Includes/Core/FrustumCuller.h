@@ -0,0 +1,50 @@
+#pragma once
+#include "Maths/Vector3.h"
+#include "Maths/Vector4.h"
+#include "Maths/Matrix.h"
+#include <cstdint>
+#include <vector>
+
+namespace Core
+{
+    class WorkerPool;
+
+    // Holds a sphere that encloses an object, in world space.
+    struct BoundingSphere
+    {
+        Maths::Vector3 center;
+        float          radius = 0;
+    };
+
+    // - FrustumCuller: Tests world space bounding spheres against the camera frustum on the CPU - //
+    // * Spheres are tested 4 at a time with SSE, and large sets are split into batches culled in parallel by a worker pool. * //
+    class FrustumCuller
+    {
+    public:
+        static constexpr size_t BATCH_SIZE  = 4096; // Number of spheres under which culling stays on the calling thread.
+        static constexpr size_t PLANE_COUNT = 6;
+
+    private:
+        alignas(16) float planes[4][PLANE_COUNT] = {}; // Normalized plane equations, stored as the a, b, c and d coefficients of all planes.
+
+    public:
+        // Extracts the frustum planes from the given view-projection matrix.
+        void Update(const Maths::Mat4& viewProjMat);
+
+        // Returns true if the sphere intersects the frustum.
+        bool IsVisible(const BoundingSphere& sphere) const;
+
+        // Writes 1 to the visibility of each sphere that intersects the frustum and 0 to the others.
+        // Batches are culled by the given pool's threads along with the calling thread. Returns the number of visible spheres.
+        size_t Cull(const BoundingSphere* spheres, const size_t& count, uint8_t* visibility, WorkerPool* workers = nullptr) const;
+
+        // Returns the given model space sphere transformed by a local matrix.
+        static BoundingSphere TransformSphere(const Maths::Vector3& center, const float& radius, const Maths::Mat4& localMat);
+
+        // Logs the time taken to cull the given number of random spheres with the scalar, SIMD and parallel SIMD paths.
+        static void Benchmark(const Maths::Mat4& viewProjMat, WorkerPool* workers, const size_t& count = 100000);
+
+    private:
+        size_t CullBatch(const BoundingSphere* spheres, const size_t& count, uint8_t* visibility) const;
+    };
+}
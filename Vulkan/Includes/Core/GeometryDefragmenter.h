@@ -0,0 +1,57 @@
+#pragma once
+#include "GpuDataManager.h"
+
+namespace Core
+{
+    // Work done by the geometry defragmenter during the last frame, and the fragmentation left.
+    struct DefragmentationStats
+    {
+        uint32_t     movedMeshes      = 0; // Shared meshes whose vertices or indices were moved to a lower range.
+        uint32_t     migratedMeshes   = 0; // Meshes moved from dedicated buffers into the shared geometry buffers.
+        VkDeviceSize copiedBytes      = 0;
+        uint32_t     freeVertexRanges = 0; // Number of holes in the shared vertex buffers, including the space at their end.
+        uint32_t     freeIndexRanges  = 0;
+        uint32_t     freedRanges      = 0; // Vertex and index ranges freed by moves since startup, counting each buffer a mesh was moved out of.
+        VkDeviceSize freedBytes       = 0; // Bytes of the freed ranges and of the released dedicated buffers since startup.
+    };
+
+    // - GeometryDefragmenter: Compacts the shared vertex and index buffers a few meshes per frame - //
+    // * Meshes are copied to the lowest free range below them in the frame's command buffer, and their old range is freed once the frames in flight are done with it. * //
+    // * Meshes that got dedicated buffers because the shared ones were full are moved into them once there is room, which gives their allocations back. * //
+    class GeometryDefragmenter
+    {
+    private:
+        Renderer*       renderer = nullptr;
+        GpuDataManager* gpuData  = nullptr;
+
+        uint32_t             maxMovesPerFrame = 4; // Maximum number of meshes copied in a single frame.
+        bool                 enabled          = true;
+        DefragmentationStats stats;
+
+        static bool IsFragmented(const std::vector<GpuRange>& freeRanges, const uint32_t& capacity);
+
+        // Moves a range to the lowest free range below it, returns false if there is none large enough.
+        bool MoveRange(const VkCommandBuffer& commandBuffer, std::vector<GpuRange>& freeRanges, GpuRange& range,
+                       const VkBuffer* buffers, const VkDeviceSize* elementSizes, const uint32_t& bufferCount);
+        bool MigrateMesh(const VkCommandBuffer& commandBuffer, GpuData<Resources::Mesh>& data);
+
+    public:
+        GeometryDefragmenter(Renderer* _renderer, GpuDataManager* _gpuData) : renderer(_renderer), gpuData(_gpuData) {}
+        GeometryDefragmenter(const GeometryDefragmenter&)            = delete;
+        GeometryDefragmenter(GeometryDefragmenter&&)                 = delete;
+        GeometryDefragmenter& operator=(const GeometryDefragmenter&) = delete;
+        GeometryDefragmenter& operator=(GeometryDefragmenter&&)      = delete;
+        ~GeometryDefragmenter() = default;
+
+        // Records the copies of the meshes moved this frame and the barrier that makes them visible to the draws.
+        // The given command buffer must be the frame's and be recorded before any draw, the meshes' ranges are updated right away.
+        void Update(const VkCommandBuffer& commandBuffer);
+
+        void SetEnabled         (const bool&     _enabled) { enabled          = _enabled; }
+        void SetMaxMovesPerFrame(const uint32_t& count)    { maxMovesPerFrame = count;    }
+
+        bool                        IsEnabled()           const { return enabled;          }
+        uint32_t                    GetMaxMovesPerFrame() const { return maxMovesPerFrame; }
+        const DefragmentationStats& GetStats()            const { return stats;            }
+    };
+}
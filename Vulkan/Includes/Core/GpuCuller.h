@@ -0,0 +1,66 @@
+#pragma once
+#include "GraphicsUtils.h"
+
+namespace Core
+{
+    class Renderer;
+    class GpuDataManager;
+    class ComputePipeline;
+
+    // Holds the bounds of an instance and the indirect command that draws it, read by the culling shader.
+    struct CullInstance
+    {
+        Maths::Vector3 center;         // Center of the bounding sphere, in model space.
+        float          radius;         // Radius of the bounding sphere, in model space.
+        uint32_t       command;        // Index of the indirect command that draws the instance.
+        uint32_t       padding[3] = {};
+    };
+
+    // - GpuCuller: Culls instances against the camera frustum in a compute pass and compacts the visible ones into the indirect draw commands - //
+    // * The culled and visible counts are read back once the frame that produced them has completed, so they lag behind by MAX_FRAMES_IN_FLIGHT frames. * //
+    class GpuCuller
+    {
+    private:
+        Renderer*       renderer = nullptr;
+        GpuDataManager* gpuData  = nullptr;
+
+        ComputePipeline*      pipeline               = nullptr; // Owns one descriptor set per frame.
+        VkBuffer              vkInstanceBuffer       = nullptr; // Cull instances, one region per frame.
+        VkDeviceMemory        vkInstanceBufferMemory = nullptr;
+        void*                 vkInstanceBufferMapped = nullptr;
+        VkBuffer              vkCounterBuffer        = nullptr; // Visible and submitted instance counts, one pair per frame.
+        VkDeviceMemory        vkCounterBufferMemory  = nullptr;
+        void*                 vkCounterBufferMapped  = nullptr;
+        VkDeviceSize          vkCounterStride        = 0;
+        VkDeviceSize          vkMemorySize           = 0;
+
+        uint32_t submittedCounts[GraphicsUtils::MAX_FRAMES_IN_FLIGHT] = { 0 };
+        uint32_t visibleCount = 0;
+        uint32_t culledCount  = 0;
+        bool     enabled      = true;
+
+    public:
+        GpuCuller(Renderer* _renderer, GpuDataManager* _gpuData);
+        GpuCuller(const GpuCuller&)            = delete;
+        GpuCuller(GpuCuller&&)                 = delete;
+        GpuCuller& operator=(const GpuCuller&) = delete;
+        GpuCuller& operator=(GpuCuller&&)      = delete;
+        ~GpuCuller();
+
+        // Returns the mapped cull instances of the given frame, indexed like the frame's instance matrices.
+        CullInstance* GetFrameInstances(const uint32_t& frame) const;
+
+        // Reads the visible count written by the frame's last culling pass and resets it.
+        // Must be called once the frame's fence has signaled.
+        void ReadBackCounters(const uint32_t& frame);
+
+        // Records the culling dispatch and the barrier that makes its results visible to indirect draws.
+        // Must be recorded outside of a render pass, with the draws' instance counts set to zero.
+        void RecordCulling(const VkCommandBuffer& commandBuffer, const uint32_t& frame, const uint32_t& instanceCount);
+
+        void SetEnabled(const bool& _enabled) { enabled = _enabled; }
+        bool IsEnabled()       const { return enabled;      }
+        uint32_t GetVisibleCount() const { return visibleCount; }
+        uint32_t GetCulledCount()  const { return culledCount;  }
+    };
+}
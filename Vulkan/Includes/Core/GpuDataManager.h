@@ -1,15 +1,80 @@
 ﻿#pragma once
 #include "UniqueID.h"
 #include "GraphicsUtils.h"
-#include <unordered_map>
+#include "SlotMap.h"
+#include "Maths/Vertex.h"
+#include <deque>
+#include <functional>
+#include <list>
+#include <string>
 
 namespace Resources { class Texture; class Material; class Mesh; class Model; class Light; }
 
 namespace Core
 {
     class Renderer;
+    class ResidencyManager;
+    class GpuCuller;
+    class MipGenerator;
+    class GeometryDefragmenter;
+
+    // Enumerates the classes of resources whose GPU memory is tracked.
+    namespace GpuMemoryCategory
+    {
+        static constexpr size_t COUNT = 6;
+
+        enum
+        {
+            Textures,      // Texture images and their mip chains.
+            Meshes,        // Vertex and index buffers.
+            Models,        // Per-frame ring of instance data.
+            Materials,     // Material storage buffer.
+            Lights,        // Per-frame ring of lights and their clusters.
+            RenderTargets, // Multisampled color and depth targets, and the transparency targets while they are enabled.
+        };
+    }
+    const char* GpuMemoryCategoryToStr(const size_t& category);
+
+    // Enumerates the warnings that are logged once, until their condition stops holding and they are reset.
+    namespace GpuWarning
+    {
+        static constexpr size_t COUNT = 5;
+
+        enum
+        {
+            MemoryUsage,      // Device memory usage close to the budget.
+            AllocationCount,  // Number of allocations close to the device's limit.
+            InstanceCount,    // More mesh instances drawn in a frame than fit in the instance ring.
+            PipelineVariants, // More pipeline variants needed than can be created.
+            LightCount,       // More lights than fit in the light buffer.
+        };
+    }
+
+    // Snapshot of the GPU memory used by the engine.
+    struct GpuMemoryStats
+    {
+        VkDeviceSize categoryBytes      [GpuMemoryCategory::COUNT] = { 0 }; // Bytes allocated for each resource class.
+        uint32_t     categoryAllocations[GpuMemoryCategory::COUNT] = { 0 }; // Device memory allocations made for each resource class.
+        VkDeviceSize trackedBytes       = 0;  // Sum of all the resource classes.
+        VkDeviceSize sharedGeometryBytes     = 0; // Size of the shared geometry buffers, counted as mesh memory.
+        VkDeviceSize sharedGeometryUsedBytes = 0; // Bytes of the shared geometry buffers sub-allocated to resident meshes.
+        uint32_t     allocationCount    = 0;  // Sum of all the resource classes' allocations.
+        uint32_t     maxAllocationCount = 0;  // Maximum number of simultaneous allocations supported by the device.
+        VkDeviceSize deviceBudget    = 0;     // Device-local memory the process can use before the driver starts paging.
+        VkDeviceSize deviceUsage     = 0;     // Device-local memory currently used by the process.
+        bool         budgetQueried   = false; // True if budget and usage were reported by VK_EXT_memory_budget, otherwise they are estimates.
+    };
 
     template<typename> struct GpuData { GpuData() = delete; };
+    template<typename T> using GpuHandle = SlotHandle<GpuData<T>>;
+
+    // Entry of the list of resident textures and meshes, ordered from least to most recently used.
+    struct ResidencyEntry
+    {
+        GpuHandle<Resources::Texture> texture; // Invalid if the entry is a mesh.
+        GpuHandle<Resources::Mesh>    mesh;    // Invalid if the entry is a texture.
+    };
+    using ResidencyList = std::list<ResidencyEntry>;
 
     template<> struct GpuData<Resources::Texture>
     {
@@ -17,29 +82,49 @@ namespace Core
         VkDeviceMemory vkImageMemory = nullptr;
         VkImageView    vkImageView   = nullptr;
         VkFormat       vkImageFormat;
+        VkDeviceSize   vkMemorySize  = 0;
+        uint32_t       bindlessIndex = GraphicsUtils::INVALID_BINDLESS_INDEX; // Slot of the texture in the bindless texture array.
+
+        // Residency information.
+        std::string sourceFile;           // File from which the texture can be streamed back in.
+        uint32_t    width         = 0;
+        uint32_t    height        = 0;
+        uint32_t    mipLevels     = 0;
+        uint32_t    residentMip   = 0;    // First mip level of the full chain that is resident on the GPU.
+        uint64_t    lastUsedFrame = 0;
+        bool        streamRequested = false;
+        ResidencyList::iterator residencyEntry; // Only in the residency list while the full chain is resident.
     };
 
     template<> struct GpuData<Resources::Material>
     {
-        VkDescriptorSet vkDescriptorSet    = nullptr;
-        VkBuffer        vkDataBuffer       = nullptr;
-        VkDeviceMemory  vkDataBufferMemory = nullptr;
+        uint32_t index = 0; // Slot of the material in the material buffer, passed to the shaders with each instance.
     };
 
-    template<> struct GpuData<Resources::Mesh>
+    // Holds a range of elements sub-allocated from a shared buffer.
+    struct GpuRange
     {
-        VkBuffer       vkVertexBuffer       = nullptr;
-        VkDeviceMemory vkVertexBufferMemory = nullptr;
-        VkBuffer       vkIndexBuffer        = nullptr;
-        VkDeviceMemory vkIndexBufferMemory  = nullptr;
+        uint32_t offset = 0;
+        uint32_t count  = 0;
     };
 
-    template<> struct GpuData<Resources::Model>
+    template<> struct GpuData<Resources::Mesh>
     {
-        VkDescriptorSet vkDescriptorSets  [GraphicsUtils::MAX_FRAMES_IN_FLIGHT] = { nullptr };
-        VkBuffer        vkMvpBuffers      [GraphicsUtils::MAX_FRAMES_IN_FLIGHT] = { nullptr };
-        VkDeviceMemory  vkMvpBuffersMemory[GraphicsUtils::MAX_FRAMES_IN_FLIGHT] = { nullptr };
-        void*           vkMvpBuffersMapped[GraphicsUtils::MAX_FRAMES_IN_FLIGHT] = { nullptr };
+        VkBuffer       vkPositionBuffer        = nullptr; // Tightly packed vertex positions, the only stream read by depth only passes.
+        VkDeviceMemory vkPositionBufferMemory  = nullptr; // Null if the vertices are in the shared geometry buffers.
+        VkBuffer       vkAttributeBuffer       = nullptr; // Other vertex attributes, at the same vertex offset as the positions.
+        VkDeviceMemory vkAttributeBufferMemory = nullptr;
+        VkBuffer       vkIndexBuffer           = nullptr;
+        VkDeviceMemory vkIndexBufferMemory     = nullptr; // Null if the indices are in the shared geometry buffer.
+        VkDeviceSize   vkMemorySize            = 0; // Size of the dedicated buffers, or of the ranges used in the shared ones.
+        GpuRange       vertexRange;
+        GpuRange       indexRange;
+        uint64_t       lastUsedFrame           = 0;
+        bool           resident                = true;  // False once evicted, the data is kept without buffers until the mesh is drawn again.
+        bool           uploadRequested         = false; // True if the mesh was drawn while evicted, until it is re-uploaded.
+        ResidencyList::iterator residencyEntry; // Only in the residency list while resident.
+
+        bool IsShared() const { return !vkPositionBufferMemory; }
     };
 
     template<typename> struct GpuArray
@@ -48,6 +133,73 @@ namespace Core
         VkDescriptorPool      vkDescriptorPool      = nullptr;
     };
 
+    // Holds the bindless descriptor set shared by all materials: a storage buffer of material data and an array of every texture.
+    // Materials and textures are referenced by their slot index, so drawing with a different material doesn't bind anything.
+    template<> struct GpuArray<Resources::Material>
+    {
+        VkDescriptorSetLayout vkDescriptorSetLayout = nullptr;
+        VkDescriptorPool      vkDescriptorPool      = nullptr;
+        VkDescriptorSet       vkDescriptorSet       = nullptr;
+        VkBuffer              vkBuffer              = nullptr;
+        VkDeviceMemory        vkBufferMemory        = nullptr;
+        void*                 vkBufferMapped        = nullptr;
+        VkDeviceSize          vkMemorySize          = 0;
+        uint32_t              capacity              = 0; // Number of materials that fit in the material buffer.
+        uint32_t              materialSlotCount     = 0; // Number of material slots handed out, including freed ones.
+        uint32_t              textureSlotCount      = 0; // Number of texture slots handed out, including freed ones.
+        std::vector<uint32_t> freeMaterialSlots;
+        std::vector<uint32_t> freeTextureSlots;
+    };
+
+    // Holds the data of a mesh instance, read by the shaders from the model array's ring buffer.
+    struct InstanceData
+    {
+        Maths::MvpBuffer matrices;
+        uint32_t         materialIndex = 0;  // Slot of the instance's material in the material buffer.
+        uint32_t         padding[3]    = {};
+    };
+
+    // Persistently mapped ring of instance data, split in one region per frame in flight and bound with dynamic offsets.
+    template<> struct GpuArray<Resources::Model>
+    {
+        VkDescriptorSetLayout vkDescriptorSetLayout = nullptr;
+        VkDescriptorPool      vkDescriptorPool      = nullptr;
+        VkDescriptorSet       vkDescriptorSet       = nullptr;
+        VkBuffer              vkBuffer              = nullptr;
+        VkDeviceMemory        vkBufferMemory        = nullptr;
+        void*                 vkBufferMapped        = nullptr;
+        VkDeviceSize          vkMemorySize          = 0;
+        VkDeviceSize          vkStride              = 0; // Size of one instance's data.
+        VkDeviceSize          vkFrameSize           = 0; // Size of one frame's region, aligned to the device's dynamic offset alignment.
+        uint32_t              capacity              = 0; // Number of mesh instances that can be drawn each frame.
+        VkBuffer              vkDrawBuffer          = nullptr; // Indirect draw commands, one region per frame.
+        VkDeviceMemory        vkDrawBufferMemory    = nullptr;
+        void*                 vkDrawBufferMapped    = nullptr;
+        VkDeviceSize          vkDrawMemorySize      = 0;
+        VkBuffer              vkVisibleBuffer       = nullptr; // Indices of the instances drawn by each draw's instances, one region per frame.
+        VkDeviceMemory        vkVisibleBufferMemory = nullptr;
+        void*                 vkVisibleBufferMapped = nullptr;
+        VkDeviceSize          vkVisibleMemorySize   = 0;
+    };
+
+    // Holds the shared vertex and index buffers that meshes are sub-allocated from, so that draws of different meshes can be merged.
+    // Vertex positions and the other attributes are in separate buffers, sub-allocated with the same vertex ranges.
+    template<> struct GpuArray<Resources::Mesh>
+    {
+        VkBuffer              vkPositionBuffer        = nullptr;
+        VkDeviceMemory        vkPositionBufferMemory  = nullptr;
+        VkBuffer              vkAttributeBuffer       = nullptr;
+        VkDeviceMemory        vkAttributeBufferMemory = nullptr;
+        VkBuffer              vkIndexBuffer           = nullptr;
+        VkDeviceMemory        vkIndexBufferMemory     = nullptr;
+        VkDeviceSize          vkMemorySize            = 0;
+        VkDeviceSize          usedBytes               = 0; // Bytes of the ranges sub-allocated to meshes.
+        std::vector<GpuRange> freeVertexRanges;
+        std::vector<GpuRange> freeIndexRanges;
+    };
+
+    // Lights, cluster parameters and cluster light lists, with one region per frame selected by dynamic offsets.
+    // Each cluster's light list starts after the light counts of all clusters.
     template<> struct GpuArray<Resources::Light>
     {
         VkDescriptorSetLayout vkDescriptorSetLayout = nullptr;
@@ -56,22 +208,112 @@ namespace Core
         VkBuffer              vkBuffer              = nullptr;
         VkDeviceMemory        vkBufferMemory        = nullptr;
         void*                 vkBufferMapped        = nullptr;
-        VkDeviceSize          vkBufferSize          = 0;
+        VkDeviceSize          vkFrameSize           = 0;
+        VkBuffer              vkParamsBuffer        = nullptr;
+        VkDeviceMemory        vkParamsBufferMemory  = nullptr;
+        void*                 vkParamsBufferMapped  = nullptr;
+        VkDeviceSize          vkParamsStride        = 0;
+        VkBuffer              vkClusterBuffer       = nullptr;
+        VkDeviceMemory        vkClusterBufferMemory = nullptr;
+        VkDeviceSize          vkClusterFrameSize    = 0;
+        VkDeviceSize          vkMemorySize          = 0;
+
+        GraphicsUtils::LightClusterParams* GetFrameParams(const uint32_t& frame) const { return (GraphicsUtils::LightClusterParams*)((char*)vkParamsBufferMapped + vkParamsStride * frame); }
+    };
+
+    // - GpuDataTable: Dense storage of GPU data, indexed by the handles that resources hold - //
+    // * Freed slots are reused, and the handles still pointing to them are detected as stale by their generation. * //
+    template<typename T> class GpuDataTable
+    {
+    private:
+        SlotMap<GpuData<T>> slots;
+
+    public:
+        // Inserts new data and points the given handle to it.
+        GpuData<T>& Emplace(GpuHandle<T>& handle)
+        {
+            handle = slots.Insert();
+            return *slots.Get(handle);
+        }
+
+        // Frees the data pointed to by the given handle and invalidates the handle.
+        void Erase(GpuHandle<T>& handle)
+        {
+            slots.Erase(handle);
+            handle = GpuHandle<T>();
+        }
+
+        bool              Contains(const GpuHandle<T>& handle) const { return slots.Contains(handle); }
+        GpuData<T>*       Get(const GpuHandle<T>& handle)            { return slots.Get(handle); }
+        const GpuData<T>* Get(const GpuHandle<T>& handle)      const { return slots.Get(handle); }
+        size_t            Size()                               const { return slots.Size(); }
+        size_t            Capacity()                           const { return slots.Capacity(); }
+
+        template<typename F> void ForEach(F&& func)       { slots.ForEach(std::forward<F>(func)); }
+        template<typename F> void ForEach(F&& func) const { slots.ForEach(std::forward<F>(func)); }
     };
 
     class GpuDataManager
     {
     private:
+        friend Renderer;
+        friend ResidencyManager;
+        friend GpuCuller;
+        friend MipGenerator;
+        friend GeometryDefragmenter;
+
         Renderer* renderer;
         
         GpuArray<Resources::Material> materialsArray;
         GpuArray<Resources::Model>    modelsArray;
+        GpuArray<Resources::Mesh>     meshesArray;
         GpuArray<Resources::Light>    lightsArray;
         
-        std::unordered_map<uid_t, GpuData<Resources::Texture>>  textures;
-        std::unordered_map<uid_t, GpuData<Resources::Material>> materials;
-        std::unordered_map<uid_t, GpuData<Resources::Mesh>>     meshes;
-        std::unordered_map<uid_t, GpuData<Resources::Model>>    models;
+        GpuDataTable<Resources::Texture>  textures;
+        GpuDataTable<Resources::Material> materials;
+        GpuDataTable<Resources::Mesh>     meshes;
+        ResidencyList                     residencyList;
+
+        // When set, uploads are recorded in this command buffer and their staging buffers are retired with its frame,
+        // instead of being submitted and waited for.
+        VkCommandBuffer vkUploadCommandBuffer = nullptr;
+
+        // Vulkan objects waiting for the frames that may still use them to complete.
+        struct PendingDeletion
+        {
+            uint64_t              frameIndex; // Index of the frame during which the resource was destroyed.
+            std::function<void()> destroy;
+        };
+        std::deque<PendingDeletion> deletionQueue;
+
+        VkDeviceSize trackedMemory     [GpuMemoryCategory::COUNT] = { 0 };
+        uint32_t     trackedAllocations[GpuMemoryCategory::COUNT] = { 0 };
+        float        memoryWarningRatio = 0.9f;
+        bool         issuedWarnings[GpuWarning::COUNT] = { false };
+        uint32_t     maxAllocationCount = 0; // Device limit on simultaneous allocations, queried once.
+        VkDeviceSize deviceHeapSize     = 0; // Size of the device-local heaps, queried once.
+        VkDeviceSize deviceBudget       = 0; // Device-local budget and usage reported by VK_EXT_memory_budget, refreshed once per frame.
+        VkDeviceSize deviceUsage        = 0;
+
+        template<typename T> GpuDataTable<T>&       GetTable();
+        template<typename T> const GpuDataTable<T>& GetTable() const { return const_cast<GpuDataManager*>(this)->GetTable<T>(); }
+
+        void DeferDeletion(std::function<void()>&& destroy);
+        void UploadMeshData(GpuData<Resources::Mesh>& data, const Resources::Mesh& resource);
+        void ReleaseMeshData(const GpuData<Resources::Mesh>& data);
+        void UploadTextureImage(GpuData<Resources::Texture>& data, const unsigned char* pixels);
+        void WriteTextureDescriptor(const GpuData<Resources::Texture>& data) const;
+        void RemapTextureSlot(const uint32_t& oldSlot, const uint32_t& newSlot);
+        void UploadBufferData(const VkBuffer& dstBuffer, const VkDeviceSize& dstOffset, const void* src, const VkDeviceSize& size);
+        void TrackMemory  (const size_t& category, const VkDeviceSize& size, const uint32_t& allocationCount = 1);
+        void UntrackMemory(const size_t& category, const VkDeviceSize& size, const uint32_t& allocationCount = 1);
+
+        // First-fit allocation of ranges in a free list sorted by offset.
+        static bool AllocateRange(std::vector<GpuRange>& freeRanges, const uint32_t& count, uint32_t& offset);
+        static void FreeRange    (std::vector<GpuRange>& freeRanges, const GpuRange& range);
+
+        // Reuses a freed slot or hands out a new one, returns INVALID_BINDLESS_INDEX if all slots are in use.
+        static uint32_t AllocateSlot(std::vector<uint32_t>& freeSlots, uint32_t& slotCount, const uint32_t& capacity);
 
     public:
         GpuDataManager() = default;
@@ -82,6 +324,28 @@ namespace Core
         ~GpuDataManager();
 
         void SetRendererPtr(Renderer* _renderer) { renderer = _renderer; }
+
+        // Returns the memory used by each resource class, along with the device budget and usage as of the last call to UpdateMemoryBudget.
+        GpuMemoryStats GetMemoryStats() const;
+
+        // Queries the device's memory budget and usage, and its heap sizes and allocation limit on the first call. Called once per frame.
+        void UpdateMemoryBudget();
+
+        // A warning is logged when device memory usage reaches the given fraction of the budget,
+        // or when the number of allocations reaches the given fraction of the device's limit.
+        void  SetMemoryWarningRatio(const float& ratio) { memoryWarningRatio = ratio; ResetWarning(GpuWarning::MemoryUsage); ResetWarning(GpuWarning::AllocationCount); }
+        float GetMemoryWarningRatio() const             { return memoryWarningRatio; }
+
+        // Returns true if the given warning should be logged, which is only the case the first time it is issued since it was reset.
+        // Callers reset their warnings once the condition that caused them stops holding, so each occurrence is logged once.
+        bool IssueWarning(const size_t& warning) { const bool issued = issuedWarnings[warning]; issuedWarnings[warning] = true; return !issued; }
+        void ResetWarning(const size_t& warning) { issuedWarnings[warning] = false; }
+
+        // Regenerates the mips of every fully resident texture with each generation method and logs their times.
+        void BenchmarkMipGeneration();
+
+        // Times lookups of the given number of GPU data by handle and by resource ID in a hash map, and logs both times.
+        static void BenchmarkDataLookups(const size_t& count = 10000);
         
         template<typename T> const GpuArray<T>& CreateArray();
         template<typename T> const GpuData <T>& CreateData(const T& resource);
@@ -89,42 +353,55 @@ namespace Core
         template<typename T> void DestroyArray();
         template<typename T> void DestroyData(const T& resource);
 
+        // Destroys the Vulkan objects of resources deleted at least MAX_FRAMES_IN_FLIGHT frames before the given one.
+        // Should be called once the fence of the frame that is about to be recorded has signaled.
+        void RetireDeletions(const uint64_t& currentFrameIndex);
+        void FlushDeletions();
+
         template<typename T> bool CheckArray() const;
         template<typename T> bool CheckData(const T& resource) const;
 
         template<typename T> const GpuArray<T>& GetArray() const;
         template<typename T> const GpuData<T>*  GetData(const T& resource) const;
+
+        // Handles are stored in resources and are detected as stale once their data is destroyed.
+        template<typename T> GpuHandle<T>      GetHandle(const T& resource)        const { return resource.gpuHandle; }
+        template<typename T> const GpuData<T>* GetData(const GpuHandle<T>& handle) const { return GetTable<T>().Get(handle); }
     };
+
+    template<> inline GpuDataTable<Resources::Texture >& GpuDataManager::GetTable() { return textures;  }
+    template<> inline GpuDataTable<Resources::Material>& GpuDataManager::GetTable() { return materials; }
+    template<> inline GpuDataTable<Resources::Mesh    >& GpuDataManager::GetTable() { return meshes;    }
     
     template<> const GpuArray<Resources::Material>& GpuDataManager::CreateArray<Resources::Material>();
     template<> const GpuArray<Resources::Model   >& GpuDataManager::CreateArray<Resources::Model   >();
+    template<> const GpuArray<Resources::Mesh    >& GpuDataManager::CreateArray<Resources::Mesh    >();
     template<> const GpuArray<Resources::Light   >& GpuDataManager::CreateArray<Resources::Light   >();
     template<> const GpuData <Resources::Texture >& GpuDataManager::CreateData(const Resources::Texture&  resource);
     template<> const GpuData <Resources::Material>& GpuDataManager::CreateData(const Resources::Material& resource);
-    template<> const GpuData <Resources::Model   >& GpuDataManager::CreateData(const Resources::Model&    resource);
     template<> const GpuData <Resources::Mesh    >& GpuDataManager::CreateData(const Resources::Mesh&     resource);
     
     template<> void GpuDataManager::DestroyArray<Resources::Material>();
     template<> void GpuDataManager::DestroyArray<Resources::Model   >();
+    template<> void GpuDataManager::DestroyArray<Resources::Mesh    >();
     template<> void GpuDataManager::DestroyArray<Resources::Light   >();
     template<> void GpuDataManager::DestroyData(const Resources::Texture&  resource);
     template<> void GpuDataManager::DestroyData(const Resources::Material& resource);
-    template<> void GpuDataManager::DestroyData(const Resources::Model&    resource);
     template<> void GpuDataManager::DestroyData(const Resources::Mesh&     resource);
     
     template<> bool GpuDataManager::CheckArray<Resources::Material>() const;
     template<> bool GpuDataManager::CheckArray<Resources::Model   >() const;
+    template<> bool GpuDataManager::CheckArray<Resources::Mesh    >() const;
     template<> bool GpuDataManager::CheckArray<Resources::Light   >() const;
     template<> bool GpuDataManager::CheckData(const Resources::Texture&  resource) const;
     template<> bool GpuDataManager::CheckData(const Resources::Material& resource) const;
-    template<> bool GpuDataManager::CheckData(const Resources::Model&    resource) const;
     template<> bool GpuDataManager::CheckData(const Resources::Mesh&     resource) const;
     
     template<> const GpuArray<Resources::Material>& GpuDataManager::GetArray<Resources::Material>() const;
     template<> const GpuArray<Resources::Model   >& GpuDataManager::GetArray<Resources::Model   >() const;
+    template<> const GpuArray<Resources::Mesh    >& GpuDataManager::GetArray<Resources::Mesh    >() const;
     template<> const GpuArray<Resources::Light   >& GpuDataManager::GetArray<Resources::Light   >() const;
     template<> const GpuData <Resources::Texture >* GpuDataManager::GetData(const Resources::Texture&  resource) const;
     template<> const GpuData <Resources::Material>* GpuDataManager::GetData(const Resources::Material& resource) const;
-    template<> const GpuData <Resources::Model   >* GpuDataManager::GetData(const Resources::Model&    resource) const;
     template<> const GpuData <Resources::Mesh    >* GpuDataManager::GetData(const Resources::Mesh&     resource) const;
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
 #pragma once
 #include "Maths/Color.h"
+#include "Maths/Matrix.h"
+#include "Maths/Vector2.h"
 #include "Maths/Vector3.h"
 #include <cstdint>
 #include <optional>
+#include <string>
 #include <vector>
 
 #pragma region Forward Declarations
@@ -12,8 +15,10 @@ typedef uint32_t VkFlags;
 typedef VkFlags  VkMemoryPropertyFlags;
 typedef VkFlags  VkBufferUsageFlags;
 typedef VkFlags  VkImageUsageFlags;
+typedef VkFlags  VkImageCreateFlags;
 typedef VkFlags  VkImageAspectFlags;
 typedef VkFlags  VkFormatFeatureFlags;
+typedef VkFlags  VkPipelineStageFlags;
 typedef struct VkInstance_T*               VkInstance;
 typedef struct VkDebugUtilsMessengerEXT_T* VkDebugUtilsMessengerEXT;
 typedef struct VkPhysicalDevice_T*         VkPhysicalDevice;
@@ -30,6 +35,7 @@ typedef struct VkRenderPass_T*             VkRenderPass;
 typedef struct VkDescriptorSetLayout_T*    VkDescriptorSetLayout;
 typedef struct VkPipelineLayout_T*         VkPipelineLayout;
 typedef struct VkPipeline_T*               VkPipeline;
+typedef struct VkPipelineCache_T*          VkPipelineCache;
 typedef struct VkCommandPool_T*            VkCommandPool;
 typedef struct VkBuffer_T*                 VkBuffer;
 typedef struct VkDeviceMemory_T*           VkDeviceMemory;
@@ -38,6 +44,7 @@ typedef struct VkDescriptorSet_T*          VkDescriptorSet;
 typedef struct VkCommandBuffer_T*          VkCommandBuffer;
 typedef struct VkSemaphore_T*              VkSemaphore;
 typedef struct VkFence_T*                  VkFence;
+typedef struct VkQueryPool_T*              VkQueryPool;
 typedef struct VkSurfaceCapabilitiesKHR    VkSurfaceCapabilitiesKHR;
 typedef struct VkSurfaceFormatKHR          VkSurfaceFormatKHR;
 typedef struct VkExtent2D                  VkExtent2D;
@@ -47,14 +54,22 @@ typedef enum   VkImageTiling         : int VkImageTiling;
 typedef enum   VkImageLayout         : int VkImageLayout;
 typedef enum   VkSampleCountFlagBits : int VkSampleCountFlagBits;
 typedef enum   VkShaderStageFlagBits : int VkShaderStageFlagBits;
+typedef enum   VkDescriptorType      : int VkDescriptorType;
 #pragma endregion 
 
 namespace GraphicsUtils
 {
-    constexpr unsigned int MAX_FRAMES_IN_FLIGHT = 3;
+    constexpr unsigned int MAX_FRAMES_IN_FLIGHT   = 3;
+    constexpr unsigned int MAX_BINDLESS_TEXTURES  = 4096;       // Size of the texture array shared by all materials.
+    constexpr uint32_t     INVALID_BINDLESS_INDEX = 0xFFFFFFFF; // Bindless index of missing textures.
+    constexpr unsigned int LIGHT_CLUSTERS_X       = 16;         // Number of light clusters along the screen's width, height and the view depth.
+    constexpr unsigned int LIGHT_CLUSTERS_Y       = 9;
+    constexpr unsigned int LIGHT_CLUSTERS_Z       = 24;
+    constexpr unsigned int MAX_CLUSTER_LIGHTS     = 128;        // Lights beyond this count in a cluster are ignored.
     extern const bool VALIDATION_LAYERS_ENABLED;
     extern const std::vector<const char*> VALIDATION_LAYERS;
     extern const std::vector<const char*> EXTENSIONS;
+    extern const std::vector<const char*> OPTIONAL_EXTENSIONS;
     
     enum class ShaderStage
     {
@@ -66,11 +81,47 @@ namespace GraphicsUtils
         Compute,
     };
         
+    // Bits of the features the main fragment shader is specialized for, passed as its first specialization constant.
+    namespace ShaderFeature
+    {
+        enum : uint32_t
+        {
+            Textures          = 0xFF,    // One bit per material texture type, set if the material has a texture of that type.
+            AlphaTest         = 1 << 8,  // Fragments below the material's alpha cutoff are discarded, or fully transparent ones with alpha to coverage or blending.
+            DirectionalLights = 1 << 9,  // One bit per light type, shifted by the type's value.
+            PointLights       = 1 << 10,
+            SpotLights        = 1 << 11,
+            Lights            = DirectionalLights | PointLights | SpotLights,
+            All               = Textures | AlphaTest | Lights,
+            DepthPrepass      = 1 << 12, // Pipeline state only: depth is tested for equality with the depth pre-pass and isn't written.
+            AlphaToCoverage   = 1 << 13, // Pipeline state only: alpha is converted to sample coverage under MSAA, without blending.
+            Blending          = 1 << 14, // Pipeline state only: color is blended with what is behind it and depth isn't written.
+            OrderIndependent  = 1 << 15, // Blended color is accumulated in the weighted blended transparency targets instead of the color target.
+            Tessellation      = 1 << 16, // The depth map displaces tessellated geometry instead of being ray marched by the fragment shader.
+            PipelineState     = DepthPrepass | AlphaToCoverage | Blending | OrderIndependent | Tessellation, // Bits that can't be dropped without drawing the material wrong.
+        };
+    }
+
+    // Describes a shader to compile, with the macros to define before its source.
+    struct ShaderDesc
+    {
+        ShaderStage              stage;
+        const char*              filename;
+        std::vector<std::string> defines;
+    };
+        
     template<ShaderStage> struct ShaderFrameConstants {};
     template<> struct ShaderFrameConstants<ShaderStage::Fragment>
     {
         Maths::Vector3 viewPos;
+        float          shadingLodScale; // Scales the shading LOD distances of all materials, 0 disables shading LOD.
     };
+    template<> struct ShaderFrameConstants<ShaderStage::TessellationControl>
+    {
+        Maths::Vector2 screenSize;       // In pixels.
+        float          targetEdgeLength; // Screen space length of tessellated edges, in pixels.
+    };
+    constexpr uint32_t TESSELLATION_CONSTANTS_OFFSET = 16; // Push constant offset of the tessellation control constants, after the fragment constants.
 
     struct DistanceFogParams
     {
@@ -89,6 +140,27 @@ namespace GraphicsUtils
         float alpha;
         float depthMultiplier;
         unsigned int parallaxLayerDepth;
+        uint32_t textureIndices[8]; // Indices of the material's textures in the bindless texture array, one per texture type.
+        float parallaxLodDistance;
+        float normalLodDistance;
+        float detailLodDistance;
+        float alphaCutoff;
+    };
+
+    // Parameters of the light clusters, one per frame.
+    // The light count and features are written along with the lights, the rest is written by the light culler.
+    struct LightClusterParams
+    {
+        Maths::Mat4 viewMat;
+        float       projScaleX    = 1; // Diagonal of the projection matrix, to get view space positions from NDC.
+        float       projScaleY    = 1;
+        float       nearPlane     = 0;
+        float       farPlane      = 1;
+        float       screenWidth   = 0;
+        float       screenHeight  = 0;
+        uint32_t    lightCount    = 0;
+        uint32_t    lightFeatures = 0; // Shader features of the light types.
+        uint32_t    clustered     = 0; // Lights are read from the fragment's cluster if set, all of them are looped over otherwise.
     };
 
     struct LightData
@@ -105,6 +177,7 @@ namespace GraphicsUtils
     {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        std::optional<uint32_t> computeFamily; // Compute only family used as an async compute queue, if the device has one.
         
         bool IsComplete() const
         {
@@ -138,17 +211,21 @@ namespace GraphicsUtils
     VkPresentModeKHR        ChooseSwapPresentMode      (const std::vector<VkPresentModeKHR  >& availablePresentModes);
     VkExtent2D              ChooseSwapExtent           (const VkSurfaceCapabilitiesKHR& capabilities);
     bool                    CheckDeviceExtensionSupport(const VkPhysicalDevice& device);
+    bool                    CheckDeviceExtensionSupport(const VkPhysicalDevice& device, const char* extensionName);
     bool                    IsDeviceSuitable           (const VkPhysicalDevice& device, const VkSurfaceKHR& surface);
     
     VkCommandBuffer BeginSingleTimeCommands(const VkDevice& device, const VkCommandPool& commandPool);
     void            EndSingleTimeCommands  (const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& graphicsQueue, const VkCommandBuffer& commandBuffer);
 
     VkShaderStageFlagBits ShaderStageToFlagBits(const ShaderStage& shaderStage);
-    VkShaderModule CreateShaderModule(const VkDevice& device, const ShaderStage& type, const char* filename);
-    void CreateBuffer         (const VkDevice& device, const VkPhysicalDevice& physicalDevice, const VkDeviceSize& size, const VkBufferUsageFlags& usage, const VkMemoryPropertyFlags& properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-    void CopyBuffer           (const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& graphicsQueue, VkBuffer srcBuffer, VkBuffer dstBuffer, const VkDeviceSize& size);
-    void CreateImage          (const VkDevice& device, const VkPhysicalDevice& physicalDevice, const uint32_t& width, const uint32_t& height, const uint32_t& mipLevels, const VkSampleCountFlagBits& numSamples, const VkFormat& format, const VkImageTiling& tiling, const VkImageUsageFlags& usage, const VkMemoryPropertyFlags& properties, VkImage& image, VkDeviceMemory& imageMemory);
-    void CreateImageView      (const VkDevice& device, const VkImage& image, const VkFormat& format, const VkImageAspectFlags& aspectFlags, const uint32_t& mipLevels, VkImageView& imageView);
+    VkShaderModule              CreateShaderModule (const VkDevice& device, const ShaderStage& type, const char* filename, const std::vector<std::string>& defines = {});
+    std::vector<VkShaderModule> CreateShaderModules(const VkDevice& device, const std::vector<ShaderDesc>& shaders); // Loads the shaders from the SPIR-V cache, or compiles them in parallel.
+    void CreateBuffer         (const VkDevice& device, const VkPhysicalDevice& physicalDevice, const VkDeviceSize& size, const VkBufferUsageFlags& usage, const VkMemoryPropertyFlags& properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, const std::vector<uint32_t>& sharingFamilies = {});
+    void CopyBuffer           (const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& graphicsQueue, VkBuffer srcBuffer, VkBuffer dstBuffer, const VkDeviceSize& size, const VkDeviceSize& dstOffset = 0);
+    void CreateImage          (const VkDevice& device, const VkPhysicalDevice& physicalDevice, const uint32_t& width, const uint32_t& height, const uint32_t& mipLevels, const VkSampleCountFlagBits& numSamples, const VkFormat& format, const VkImageTiling& tiling, const VkImageUsageFlags& usage, const VkMemoryPropertyFlags& properties, VkImage& image, VkDeviceMemory& imageMemory, const VkImageCreateFlags& flags = 0, const void* pNext = nullptr);
+    void CreateImageView      (const VkDevice& device, const VkImage& image, const VkFormat& format, const VkImageAspectFlags& aspectFlags, const uint32_t& mipLevels, VkImageView& imageView, const uint32_t& baseMipLevel = 0);
     void TransitionImageLayout(const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& graphicsQueue, const VkImage& image, const VkFormat& format, const uint32_t& mipLevels, const VkImageLayout& oldLayout, const VkImageLayout& newLayout);
     void CopyBufferToImage    (const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& graphicsQueue, const VkBuffer& buffer, const VkImage& image, const uint32_t& width, const uint32_t& height);
+    VkDeviceSize GetBufferMemorySize(const VkDevice& device, const VkBuffer& buffer);
+    VkDeviceSize GetImageMemorySize (const VkDevice& device, const VkImage&  image);
 }
@@ -0,0 +1,51 @@
+#pragma once
+#include "GraphicsUtils.h"
+
+namespace Resources { class Camera; }
+namespace Core
+{
+    class Renderer;
+    class GpuDataManager;
+    class ComputePipeline;
+
+    // - LightCuller: Bins the lights into view space clusters in a compute pass, so that fragments only shade with the lights of their cluster - //
+    // * Clusters split the screen into tiles and the view depth into exponential slices, their light lists are written to the light array's cluster buffer. * //
+    class LightCuller
+    {
+    private:
+        Renderer*       renderer = nullptr;
+        GpuDataManager* gpuData  = nullptr;
+
+        ComputePipeline* pipeline = nullptr;
+
+        Maths::Mat4 viewMat;
+        float       projScaleX = 1;
+        float       projScaleY = 1;
+        float       nearPlane  = 0;
+        float       farPlane   = 1;
+        bool        enabled    = true;
+
+    public:
+        LightCuller(Renderer* _renderer, GpuDataManager* _gpuData);
+        LightCuller(const LightCuller&)            = delete;
+        LightCuller(LightCuller&&)                 = delete;
+        LightCuller& operator=(const LightCuller&) = delete;
+        LightCuller& operator=(LightCuller&&)      = delete;
+        ~LightCuller();
+
+        // Sets the camera the clusters are built from.
+        void SetView(const Resources::Camera& camera);
+
+        // Writes the frame's cluster parameters and records the culling dispatch along with the barrier that makes the light lists visible to fragment shaders.
+        // Must be recorded outside of a render pass, after the frame's lights have been written.
+        // On the async compute queue, the barrier is left to the semaphore the frame's graphics work waits on.
+        void RecordCulling(const VkCommandBuffer& commandBuffer, const uint32_t& frame, const bool& asyncCompute = false) const;
+
+        // When disabled, fragments loop over all the lights instead, to compare their GPU times.
+        void SetEnabled(const bool& _enabled) { enabled = _enabled; }
+        bool IsEnabled() const { return enabled; }
+
+        // Returns the macros that give the cluster grid and bindless array sizes to the shaders that read the light clusters.
+        static std::vector<std::string> GetShaderDefines();
+    };
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "GraphicsUtils.h"
+
+namespace Core
+{
+    class Renderer;
+    class GpuDataManager;
+    class ComputePipeline;
+
+    // Filters that reduce each 2x2 block of texels to a texel of the next mip level.
+    enum class MipFilter
+    {
+        Box,   // Average of the block, in linear space for sRGB textures.
+        Point, // Top left texel of the block.
+        Min,   // Minimum of each channel in the block.
+        Max,   // Maximum of each channel in the block.
+    };
+    const char* MipFilterToStr(const MipFilter& filter);
+
+    // Ways of generating mip chains.
+    enum class MipMethod
+    {
+        Compute, // A single dispatch per texture, with the selected filter.
+        Blit,    // A chain of linear blits, one level after the other.
+    };
+
+    // Number of textures whose mips were generated with a method, and the time it took.
+    struct MipGenerationStats
+    {
+        uint32_t textureCount = 0;
+        float    totalTime    = 0; // GPU time in milliseconds, or submission time when timestamps aren't supported.
+    };
+
+    // - MipGenerator: Generates the mip chains of textures, either in a single compute dispatch or with a chain of blits - //
+    // * Each work group reduces a 64x64 tile to six levels, then the last work group to finish reduces the remaining ones. * //
+    // * sRGB levels are written through UNORM views and encoded by the shader, so filtering is done in linear space. * //
+    class MipGenerator
+    {
+    private:
+        static constexpr uint32_t TILE_SIZE         = 64; // Texels reduced by each work group along each axis.
+        static constexpr uint32_t MAX_MIPS_PER_PASS = 12; // Six levels reduced by each work group and six by the last one.
+        static constexpr uint32_t MAX_PASSES        = 2;  // Enough for images of up to 65536 texels along each axis.
+
+        // Dispatch parameters, laid out like the shader's.
+        struct PassConstants
+        {
+            uint32_t srcWidth;
+            uint32_t srcHeight;
+            uint32_t mipCount;
+            uint32_t groupCount;
+            uint32_t filter;
+            uint32_t srgb;
+        };
+
+        Renderer*       renderer = nullptr;
+        GpuDataManager* gpuData  = nullptr;
+
+        ComputePipeline* pipeline              = nullptr; // Owns one descriptor set per pass, null when compute mips aren't supported.
+        VkBuffer         vkCounterBuffer       = nullptr; // Number of work groups done with the current pass, reset by the last one.
+        VkDeviceMemory   vkCounterBufferMemory = nullptr;
+        VkDeviceSize     vkMemorySize          = 0;
+        VkQueryPool      vkTimestampQueryPool  = nullptr;
+
+        MipMethod          method = MipMethod::Compute;
+        MipFilter          filter = MipFilter::Box;
+        MipGenerationStats stats[2];
+
+        bool IsLinearBlitSupported(const VkFormat& format) const;
+        void RecordComputeMips(const VkCommandBuffer& commandBuffer, const VkImage& image, const VkFormat& format, const uint32_t& width, const uint32_t& height,
+                               const uint32_t& mipLevels, const VkImageLayout& oldLayout, std::vector<VkImageView>& imageViews) const;
+        void RecordBlitMips   (const VkCommandBuffer& commandBuffer, const VkImage& image, const uint32_t& width, const uint32_t& height,
+                               const uint32_t& mipLevels, const VkImageLayout& oldLayout) const;
+
+    public:
+        MipGenerator(Renderer* _renderer, GpuDataManager* _gpuData);
+        MipGenerator(const MipGenerator&)            = delete;
+        MipGenerator(MipGenerator&&)                 = delete;
+        MipGenerator& operator=(const MipGenerator&) = delete;
+        MipGenerator& operator=(MipGenerator&&)      = delete;
+        ~MipGenerator();
+
+        // Generates the mips of an image from its first level and waits for them, every level being in the given layout.
+        // The image is left in the shader read only layout, the time it took is returned and added to the method's stats.
+        // Compute generation requires the image to be created with the usage, flags and format list returned for its format.
+        float Generate(const VkImage& image, const VkFormat& format, const uint32_t& width, const uint32_t& height, const uint32_t& mipLevels,
+                       const VkImageLayout& oldLayout, MipMethod generationMethod);
+        float Generate(const VkImage& image, const VkFormat& format, const uint32_t& width, const uint32_t& height, const uint32_t& mipLevels,
+                       const VkImageLayout& oldLayout) { return Generate(image, format, width, height, mipLevels, oldLayout, method); }
+
+        // Records the generation of the mips with blits in a command buffer submitted later, such as a frame's, leaving the image in the shader read only layout.
+        // Compute generation can't be recorded this way since it reuses its descriptor sets, so formats that can't be blitted linearly can't either.
+        bool CanRecord(const VkFormat& format) const { return IsLinearBlitSupported(format); }
+        void Record(const VkCommandBuffer& commandBuffer, const VkImage& image, const uint32_t& width, const uint32_t& height,
+                    const uint32_t& mipLevels, const VkImageLayout& oldLayout) const { RecordBlitMips(commandBuffer, image, width, height, mipLevels, oldLayout); }
+
+        // Textures are generated with the selected method, formats that can't be blitted linearly always use compute.
+        void      SetMethod(const MipMethod& _method) { method = _method; }
+        MipMethod GetMethod() const                   { return method; }
+
+        // The compute method reduces texels with the selected filter, blits always average them.
+        void      SetFilter(const MipFilter& _filter) { filter = _filter; }
+        MipFilter GetFilter() const                   { return filter; }
+
+        const MipGenerationStats& GetStats(const MipMethod& generationMethod) const { return stats[(size_t)generationMethod]; }
+
+        // Returns the usage, creation flags and format list to create images of the given format with, so that their mips can be generated by compute.
+        // Storage usage is only added when compute mips are supported, and only sRGB images are mutable since their levels are written through UNORM views.
+        // The format list, to chain to the image creation information, restricts those views to UNORM so that sRGB images can stay compressed. Null for other formats.
+        VkImageUsageFlags                  GetImageUsage     () const;
+        VkImageCreateFlags                 GetImageFlags     (const VkFormat& format) const;
+        const VkImageFormatListCreateInfo* GetImageFormatList(const VkFormat& format) const;
+    };
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "Maths/Vertex.h"
+#include <vector>
+
+namespace Resources { class Mesh; class Material; }
+namespace Core
+{
+    // Enumerates the passes draw items are sorted into, in drawing order.
+    namespace DrawPass
+    {
+        static constexpr size_t COUNT = 3;
+
+        enum
+        {
+            Opaque,      // Sorted by state then front-to-back.
+            AlphaTested, // Sorted by state then front-to-back, drawn after opaque items so that more of their fragments are rejected early.
+            Blended,     // Sorted back-to-front, or by state with order independent transparency.
+        };
+    }
+
+    // Holds a mesh submitted for drawing along with its matrices.
+    struct DrawItem
+    {
+        uint64_t                   sortKey  = 0;
+        const Resources::Mesh*     mesh     = nullptr;
+        const Resources::Material* material = nullptr;
+        Maths::MvpBuffer           matrices;
+    };
+
+    // Holds a range of draw items that share the same mesh and material and can be drawn as instances of a single draw.
+    struct DrawBatch
+    {
+        const Resources::Mesh*     mesh          = nullptr;
+        const Resources::Material* material      = nullptr;
+        uint32_t                   pipeline      = 0; // Index of the pipeline the batch is drawn with.
+        uint32_t                   firstItem     = 0; // Index of the batch's first item in the sorted item order.
+        uint32_t                   instanceCount = 0;
+    };
+
+    // - RenderQueue: Collects the meshes drawn during a frame, radix sorts them by 64-bit keys and groups identical mesh and material pairs into instanced batches - //
+    // * Opaque and alpha tested keys are laid out as pass (2 bits) | pipeline (6 bits) | material (16 bits) | mesh (16 bits) | depth (24 bits). * //
+    // * Sorted blended keys are laid out as pass (2 bits) | pipeline (6 bits) | inverted depth (24 bits) | material (16 bits) | mesh (16 bits). * //
+    class RenderQueue
+    {
+    private:
+        std::vector<DrawItem>  items;
+        std::vector<uint32_t>  order;
+        std::vector<uint32_t>  sortScratch;
+        std::vector<DrawBatch> batches;
+        bool                   instancingEnabled = true;
+        bool                   sortBlended       = true; // Disabled when blended items are drawn with order independent transparency.
+
+    public:
+        RenderQueue() = default;
+        RenderQueue(const RenderQueue&)            = delete;
+        RenderQueue(RenderQueue&&)                 = delete;
+        RenderQueue& operator=(const RenderQueue&) = delete;
+        RenderQueue& operator=(RenderQueue&&)      = delete;
+        ~RenderQueue() = default;
+
+        void Clear();
+        // Items are sorted by the given material and mesh slots, which must be unique among the live materials and meshes.
+        void Submit(const Resources::Mesh& mesh, const Maths::MvpBuffer& matrices, const uint32_t& pipeline, const uint32_t& materialSlot, const uint32_t& meshSlot);
+
+        // Sorts the submitted items and groups them into batches.
+        void Build();
+
+        void SetInstancingEnabled(const bool& enabled) { instancingEnabled = enabled; }
+        bool IsInstancingEnabled() const { return instancingEnabled; }
+
+        // When disabled, blended items are sorted and batched by state like opaque items.
+        void SetBlendedSortingEnabled(const bool& enabled) { sortBlended = enabled; }
+        bool IsBlendedSortingEnabled() const { return sortBlended; }
+
+        const DrawItem&               GetItem(const uint32_t& sortedIdx) const { return items[order[sortedIdx]]; }
+        const std::vector<DrawBatch>& GetBatches()                       const { return batches; }
+        size_t                        GetItemCount()                     const { return items.size(); }
+
+        static uint64_t MakeSortKey(const uint32_t& pass, const uint32_t& pipeline, const uint32_t& materialSlot, const uint32_t& meshSlot, const float& viewDepth, const bool& backToFront);
+        static uint32_t GetSortKeyPass    (const uint64_t& sortKey) { return (uint32_t)(sortKey >> 62); }
+        static uint32_t GetSortKeyPipeline(const uint64_t& sortKey) { return (uint32_t)(sortKey >> 56) & 0x3F; }
+
+    private:
+        void RadixSort();
+    };
+}
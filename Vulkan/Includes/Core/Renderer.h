@@ -1,17 +1,80 @@
 ﻿#pragma once
 #include "GraphicsUtils.h"
+#include "RenderQueue.h"
+#include <unordered_map>
 
-namespace Resources { class Camera; class Model; }
+namespace Resources { class Camera; class Model; class Mesh; class Material; }
 namespace Core
 {
     class Application;
     class GpuDataManager;
+    class ResidencyManager;
+    class GpuCuller;
+    class LightCuller;
+    class MipGenerator;
+    class GeometryDefragmenter;
+    class WorkerPool;
+
+    // Holds the number of meshes submitted, draw calls and binds recorded during the last frame.
+    struct RenderStats
+    {
+        uint32_t submittedMeshes  = 0;
+        uint32_t visibleInstances = 0; // Read back from the GPU culling pass, lags behind by a few frames.
+        uint32_t culledInstances  = 0;
+        uint32_t drawCalls        = 0;
+        uint32_t bindCalls        = 0; // Number of pipeline, vertex and index buffer binds.
+        uint32_t recordThreads    = 0; // Number of threads that recorded the draws.
+        float    recordTime       = 0; // CPU time spent recording the render queue, in milliseconds.
+        float    gpuTime          = 0; // GPU time spent in the render pass, in milliseconds. Lags behind by MAX_FRAMES_IN_FLIGHT frames.
+    };
+
+    // Render pass GPU times summed while comparing sorted blending with order independent transparency.
+    struct TransparencyBenchmark
+    {
+        uint32_t frameCount      = 0;     // Frames measured with each method.
+        uint32_t remainingFrames = 0;     // Frames left to measure with the current method, 0 when no benchmark runs.
+        uint32_t skippedFrames   = 0;     // Timestamps left to skip, since they are read back from frames drawn before the last switch.
+        bool     restoreOit      = false; // Method selected before the benchmark, restored when it ends.
+        float    totalTimes[2]   = { 0 }; // Sorted blending, then order independent transparency, in milliseconds.
+
+        // The last frame drawn with sorted blending and the first one drawn with order independent transparency are copied without the overlay, to compare them.
+        bool           captureFrame         = false;          // True if the frame being recorded is copied to the readback buffer.
+        bool           captured[2]          = { false };      // Whether the image drawn with each method was copied.
+        VkExtent2D     captureExtent        = { 0, 0 };       // Swap chain size when the benchmark started, frames of another size aren't copied.
+        VkBuffer       readbackBuffer       = VK_NULL_HANDLE; // Image drawn with each method, in the swap chain's format.
+        VkDeviceMemory readbackBufferMemory = VK_NULL_HANDLE;
+    };
 
     class Renderer
     {
+    public:
+        static constexpr uint32_t MAX_RECORD_WORKERS         = 8;  // Maximum number of threads that record draws in parallel.
+        static constexpr uint32_t MIN_DRAWS_PER_WORKER       = 64; // Draws are recorded on the main thread until there are enough for two workers.
+        static constexpr uint32_t MAX_PIPELINE_VARIANTS      = 64; // Limited by the pipeline bits of the render queue's sort keys.
+        static constexpr uint32_t RESERVED_PIPELINE_VARIANTS = 8;  // Last variants, kept for one with all shader features per pipeline state.
+        static constexpr VkFormat OIT_ACCUM_FORMAT           = VK_FORMAT_R16G16B16A16_SFLOAT; // Weighted premultiplied color and alpha sums of transparent surfaces.
+        static constexpr VkFormat OIT_REVEAL_FORMAT          = VK_FORMAT_R16_SFLOAT;          // Product of the transparent surfaces' transmittance.
+        static constexpr float    OIT_MAX_IMAGE_ERROR        = 0.02f; // Root mean square difference allowed between the sorted blending and order independent images.
+        
     private:
+        // Pipeline and geometry buffers bound by each indirect command of the frame.
+        struct QueuedDraw
+        {
+            VkPipeline pipeline;
+            VkBuffer   positionBuffer;
+            VkBuffer   attributeBuffer;
+            VkBuffer   indexBuffer;
+            bool       depthPrepass; // True if the draw is also recorded in the depth pre-pass.
+        };
+        
         Application*                      app;
         GpuDataManager*                   gpuData;
+        ResidencyManager*                 residency             = nullptr;
+        GeometryDefragmenter*             defragmenter          = nullptr;
+        GpuCuller*                        culler                = nullptr;
+        LightCuller*                      lightCuller           = nullptr;
+        MipGenerator*                     mipGenerator          = nullptr;
+        WorkerPool*                       workerPool            = nullptr; // Threads that record draws with the main thread.
         VkInstance                        vkInstance            = nullptr;
         VkDebugUtilsMessengerEXT          vkDebugMessenger      = nullptr;
         VkSurfaceKHR                      vkSurface             = nullptr;
@@ -20,11 +83,18 @@ namespace Core
         GraphicsUtils::QueueFamilyIndices vkQueueFamilyIndices;
         VkQueue                           vkGraphicsQueue       = nullptr;
         VkQueue                           vkPresentQueue        = nullptr;
+        VkQueue                           vkComputeQueue        = nullptr; // Queue of a compute only family for async compute, null if the device has none.
         VkSwapchainKHR                    vkSwapChain           = nullptr;
         VkRenderPass                      vkRenderPass          = nullptr;
         VkPipelineLayout                  vkPipelineLayout      = nullptr;
-        VkPipeline                        vkGraphicsPipeline    = nullptr;
+        VkPipelineCache                   vkPipelineCache       = nullptr;
+        VkPipeline                        vkPrepassPipeline     = nullptr; // Position only pipeline that writes the depth of opaque draws.
+        VkShaderModule                    vkVertShaderModule    = nullptr; // Kept to create pipeline variants on demand.
+        VkShaderModule                    vkFragShaderModule    = nullptr;
+        VkShaderModule                    vkTessModules[3]      = {}; // Vertex, control and evaluation shaders of tessellated variants, if supported.
+        VkQueryPool                       vkTimestampQueryPool  = nullptr; // Timestamps around the render pass, two per frame in flight.
         VkCommandPool                     vkCommandPool         = nullptr;
+        VkCommandPool                     vkComputeCommandPool  = nullptr;
         VkSampler                         vkTextureSampler      = nullptr;
         VkImage                           vkColorImage          = nullptr;
         VkDeviceMemory                    vkColorImageMemory    = nullptr;
@@ -32,10 +102,27 @@ namespace Core
         VkImage                           vkDepthImage          = nullptr;
         VkDeviceMemory                    vkDepthImageMemory    = nullptr;
         VkImageView                       vkDepthImageView      = nullptr;
+        VkImage                           vkAccumImage          = nullptr; // Weighted blended transparency targets: premultiplied color and alpha sums, and revealage.
+        VkDeviceMemory                    vkAccumImageMemory    = nullptr;
+        VkImageView                       vkAccumImageView      = nullptr;
+        VkImage                           vkRevealImage         = nullptr;
+        VkDeviceMemory                    vkRevealImageMemory   = nullptr;
+        VkImageView                       vkRevealImageView     = nullptr;
+        VkPipelineLayout                  vkCompositeLayout     = nullptr;
+        VkPipeline                        vkCompositePipeline   = nullptr; // Composites the transparency targets over the color target.
         VkFormat                          vkDepthImageFormat;
         std::vector<VkCommandBuffer>      vkCommandBuffers;
+        std::vector<VkCommandBuffer>      vkComputeCommandBuffers; // Async compute command buffers, one per frame in flight.
+        std::vector<VkCommandPool>        vkWorkerCommandPools;    // One pool per recording worker and frame in flight.
+        std::vector<VkCommandBuffer>      vkWorkerCommandBuffers;  // Secondary command buffers, one per recording worker and frame in flight.
+        std::vector<VkCommandBuffer>      vkOverlayCommandBuffers; // Secondary command buffers for what is recorded after parallel draws.
+        std::vector<VkCommandBuffer>      vkPrepassCommandBuffers; // Secondary command buffers for the depth pre-pass of parallel draws.
+        std::vector<VkPipeline>           vkPipelineVariants;      // Graphics pipelines specialized for shader features, the first one has all of them.
+        std::vector<uint32_t>             pipelineVariantFeatures; // Shader features of each pipeline variant.
+        std::unordered_map<uint32_t, uint32_t> pipelineVariantIndices; // Index of each pipeline variant, by shader features.
         std::vector<VkSemaphore>          vkImageAvailableSemaphores;
         std::vector<VkSemaphore>          vkRenderFinishedSemaphores;
+        std::vector<VkSemaphore>          vkComputeFinishedSemaphores; // Signaled by each frame's async compute work and waited on by its graphics work.
         std::vector<VkFence>              vkInFlightFences;
         std::vector<VkFramebuffer>        vkSwapChainFramebuffers;
         std::vector<VkImage>              vkSwapChainImages;
@@ -47,10 +134,46 @@ namespace Core
         VkDescriptorSetLayout             constDataDescriptorLayout = nullptr;
         VkDescriptorPool                  constDataDescriptorPool   = nullptr;
         VkDescriptorSet                   constDataDescriptorSet    = nullptr;
+        VkDescriptorSetLayout             oitDescriptorLayout       = nullptr; // Transparency targets, read as input attachments by the composite.
+        VkDescriptorPool                  oitDescriptorPool         = nullptr;
+        VkDescriptorSet                   oitDescriptorSet          = nullptr;
         VkBuffer                          fogParamsBuffer           = nullptr;
         VkDeviceMemory                    fogParamsBufferMemory     = nullptr;
         bool                              framebufferResized        = false;
+        bool                              pipelineCacheWarm         = false; // True if the pipeline cache was loaded from disk.
+        bool                              memoryBudgetSupported     = false;
+        bool                              indirectDrawSupported     = false;
+        bool                              multiDrawSupported        = false;
+        bool                              tessellationSupported     = false;
+        bool                              computeMipsSupported      = false;
+        bool                              oitSupported              = false; // The scene sub-pass blends its color targets differently, which requires independent blending.
+        bool                              swapChainCopySupported    = false; // Swap chain images can be copied from, and have 8 bits per channel.
+        bool                              indirectDrawEnabled       = true;
+        bool                              renderPassActive          = false;
+        bool                              overlayRecording          = false;
+        bool                              parallelRecordingEnabled  = true;
+        bool                              shaderPermutationsEnabled = true;
+        bool                              depthPrepassEnabled       = false;
+        bool                              oitEnabled                = false; // True if the render pass has transparency targets.
+        bool                              oitRequested              = false; // The render pass is rebuilt with or without transparency targets at the start of the next frame.
+        bool                              tessellationEnabled       = false;
+        bool                              asyncComputeEnabled       = true;
+        VkPipelineStageFlags              asyncComputeWaitStages    = 0;  // Graphics stages that wait for the frame's async compute work, 0 if none was recorded.
+        float                             tessellationEdgeLength    = 16; // Target screen space length of tessellated edges, in pixels.
+        float                             shadingLodScale           = 1;  // Scales the shading LOD distances of all materials, 0 disables shading LOD.
+        bool                              timestampsSupported       = false;
+        bool                              timestampsWritten[GraphicsUtils::MAX_FRAMES_IN_FLIGHT] = { false };
+        float                             timestampPeriod           = 0; // Nanoseconds per timestamp tick.
+        float                             gpuTime                   = 0; // Last render pass GPU time read back, in milliseconds.
+        uint32_t                          frameLightFeatures        = GraphicsUtils::ShaderFeature::Lights; // Shader features of the light types in the scene.
+        uint32_t                          recordWorkerCount         = 1;
         uint32_t                          currentFrame              = 0;
+        uint64_t                          frameIndex                = 0; // Number of frames presented since startup.
+        RenderQueue                       renderQueue;
+        RenderStats                       renderStats;
+        TransparencyBenchmark             transparencyBenchmark;
+        std::vector<QueuedDraw>           queuedDraws;
+        std::vector<std::pair<GraphicsUtils::ShaderStage, std::vector<uint8_t>>> frameConstants; // Pushed in each command buffer that records draws.
         
     public:
         Renderer(Application* application, const char* appName, const char* engineName = "No Engine");
@@ -64,9 +187,78 @@ namespace Core
         void SetDistanceFogParams(const Maths::RGB& color, const float& start, const float& end);
 
         void BeginRender();
-        void DrawModel(const Resources::Model& model, const Resources::Camera& camera) const;
+        void DrawModel(const Resources::Model& model, const Resources::Camera& camera);
+        void DrawModel(const Resources::Model& model, const Resources::Camera& camera, const Maths::Mat4& localMat);
+        void DrawMesh (const Resources::Mesh& mesh, const Maths::MvpBuffer& matrices);
+        void DrawRenderQueue();
         void EndRender();
 
+        // In indirect mode, consecutive draws that share geometry buffers and material are submitted with a single indirect command.
+        // Instances are then also culled against the camera frustum on the GPU when the culler is enabled.
+        void SetIndirectDrawEnabled(const bool& enabled) { indirectDrawEnabled = enabled; }
+        bool IsIndirectDrawEnabled()   const { return indirectDrawEnabled && indirectDrawSupported; }
+        bool IsIndirectDrawSupported() const { return indirectDrawSupported; }
+
+        // When there are enough draws, they are split across worker threads that each record a secondary command buffer.
+        void SetParallelRecordingEnabled(const bool& enabled) { parallelRecordingEnabled = enabled; }
+        bool IsParallelRecordingEnabled() const { return parallelRecordingEnabled; }
+
+        // Each material is drawn with a pipeline specialized for its textures, its alpha mode and the light types in the scene.
+        // When disabled, every material uses the pipeline variant that handles all the features, to compare their GPU times.
+        void     SetShaderPermutationsEnabled(const bool& enabled) { shaderPermutationsEnabled = enabled; }
+        bool     IsShaderPermutationsEnabled() const { return shaderPermutationsEnabled; }
+        uint32_t GetPipelineVariantCount()     const { return (uint32_t)vkPipelineVariants.size(); }
+        bool     IsGpuTimeSupported()          const { return timestampsSupported; }
+        float    GetTimestampPeriod()          const { return timestampPeriod; }
+
+        // When enabled, the depth of opaque draws is written by a position only pre-pass.
+        // Their main pass then tests depth for equality, so each of their pixels is shaded once.
+        void SetDepthPrepassEnabled(const bool& enabled) { depthPrepassEnabled = enabled; }
+        bool IsDepthPrepassEnabled() const { return depthPrepassEnabled; }
+
+        // When enabled, blended materials are drawn unsorted into weighted blended transparency targets, which are then composited over the opaque color.
+        // When disabled, they are sorted back-to-front and blended in order, to compare both results.
+        // The transparency targets are only allocated while enabled, the render pass is rebuilt with or without them at the start of the next frame.
+        void SetOrderIndependentTransparencyEnabled(const bool& enabled) { oitRequested = enabled && oitSupported; }
+        bool IsOrderIndependentTransparencyEnabled()   const { return oitEnabled; }
+        bool IsOrderIndependentTransparencySupported() const { return oitSupported; }
+
+        // Draws the given number of frames with sorted blending, then with order independent transparency, and logs their average render pass GPU times.
+        // The frames drawn on either side of the switch are read back and their difference is checked against OIT_MAX_IMAGE_ERROR.
+        // The selected method is restored afterwards, this requires timestamps.
+        void BenchmarkTransparency(const uint32_t& frameCount);
+        bool IsTransparencyBenchmarkRunning() const { return transparencyBenchmark.remainingFrames > 0; }
+        bool IsCapturingFrame()               const { return transparencyBenchmark.captureFrame; } // The overlay isn't drawn in captured frames.
+
+        // When enabled, materials with depth maps are tessellated so that edges span about the target length on screen, then displaced by their depth map.
+        // Their fragments then skip parallax mapping, and they aren't drawn in the depth pre-pass since it doesn't displace them.
+        void  SetTessellationEnabled(const bool& enabled) { tessellationEnabled = enabled; }
+        bool  IsTessellationEnabled()   const { return tessellationEnabled && tessellationSupported; }
+        bool  IsTessellationSupported() const { return tessellationSupported; }
+        void  SetTessellationEdgeLength(const float& length) { tessellationEdgeLength = length; }
+        float GetTessellationEdgeLength() const { return tessellationEdgeLength; }
+
+        // Fragments past the LOD distances of their material skip parallax mapping, normal mapping and detail maps, the distances are scaled by the given factor.
+        // A scale of 0 disables shading LOD, to compare their GPU times.
+        void  SetShadingLodScale(const float& scale) { shadingLodScale = scale; }
+        float GetShadingLodScale() const { return shadingLodScale; }
+
+        // When enabled and the device has a compute only queue family, light binning is recorded on the async compute queue.
+        // It then overlaps the frame's graphics work until the fragment shaders, which wait for it.
+        void SetAsyncComputeEnabled(const bool& enabled) { asyncComputeEnabled = enabled; }
+        bool IsAsyncComputeEnabled()   const { return asyncComputeEnabled && vkComputeQueue; }
+        bool IsAsyncComputeSupported() const { return vkComputeQueue != nullptr; }
+
+        // Mips are generated by a compute shader when storage image arrays can be indexed, otherwise by blits.
+        bool IsComputeMipsSupported() const { return computeMipsSupported; }
+
+        // Returns the frame's async compute command buffer, which begins recording on first use and is submitted before the frame's graphics work.
+        // The graphics work waits for it at the given stages, so the dispatches recorded in it need no barriers towards them.
+        VkCommandBuffer GetAsyncComputeCommandBuffer(const VkPipelineStageFlags& waitStages);
+
+        // Returns the queue families that buffers accessed by both the graphics and async compute queues are shared between, empty without async compute.
+        std::vector<uint32_t> GetSharedQueueFamilies() const;
+
         void WaitUntilIdle() const;
         void ResizeSwapChain() { framebufferResized = true; }
 
@@ -80,10 +272,24 @@ namespace Core
         VkFormat              GetVkDepthImageFormat()    const { return vkDepthImageFormat; }
         VkRenderPass          GetVkRenderPass()          const { return vkRenderPass; }
         VkPipelineLayout      GetVkPipelineLayout()      const { return vkPipelineLayout; }
+        VkPipelineCache       GetVkPipelineCache()       const { return vkPipelineCache; }
         VkCommandPool         GetVkCommandPool()         const { return vkCommandPool; }
-        VkCommandBuffer       GetCurVkCommandBuffer()    const { return vkCommandBuffers[currentFrame]; }
+        VkCommandBuffer       GetCurVkCommandBuffer()    const { return overlayRecording ? vkOverlayCommandBuffers[currentFrame] : vkCommandBuffers[currentFrame]; }
+        uint32_t              GetCurrentFrame()          const { return currentFrame; }
+        uint64_t              GetFrameIndex()            const { return frameIndex; }
+        uint32_t              GetSwapChainWidth()        const { return vkSwapChainWidth; }
+        uint32_t              GetSwapChainHeight()       const { return vkSwapChainHeight; }
+        ResidencyManager*     GetResidency()             const { return residency; }
+        GeometryDefragmenter* GetDefragmenter()          const { return defragmenter; }
+        GpuCuller*            GetCuller()                const { return culler; }
+        LightCuller*          GetLightCuller()           const { return lightCuller; }
+        MipGenerator*         GetMipGenerator()          const { return mipGenerator; }
+        WorkerPool*           GetWorkerPool()            const { return workerPool; }
+        RenderQueue&          GetRenderQueue()                 { return renderQueue; }
+        const RenderStats&    GetRenderStats()           const { return renderStats; }
         VkSampler             GetVkTextureSampler()      const { return vkTextureSampler; }
         VkSampleCountFlagBits GetMsaaSamples()           const { return msaaSamples; }
+        bool                  IsMemoryBudgetSupported()  const { return memoryBudgetSupported; }
 
     private:
         void CheckValidationLayers() const;
@@ -96,22 +302,46 @@ namespace Core
         void CreateImageViews();
         void CreateRenderPass();
         void CreateDescriptorLayoutsAndPools();
+        void CreatePipelineCache();
         void CreateGraphicsPipeline();
+        void CreateDepthPrepassPipeline();
+        void CreateTimestampQueries();
         void CreateColorResources();
+        void CreateTransparencyResources();
+        void CreateCompositePipeline();
         void CreateDepthResources();
         void CreateFramebuffers();
         void CreateCommandPool();
         void CreateTextureSampler();
         void CreateCommandBuffers();
+        void CreateWorkerCommandBuffers();
         void CreateSyncObjects();
 
         void RecreateSwapChain();
-        void DestroySwapChain() const;
+        void RecreateRenderPass();
+        void DestroySwapChain();
+        void DestroyTransparencyResources();
         void DestroyDescriptorLayoutsAndPools() const;
+        void SavePipelineCache() const;
+
+        VkPipeline CreatePipelineVariant     (const uint32_t& shaderFeatures) const;
+        uint32_t   GetPipelineVariant        (const Resources::Material& material);
+        uint32_t   FindClosestPipelineVariant(const uint32_t& shaderFeatures) const;
+        void       UpdateLightFeatures();
+        void       ReadBackTimestamps();
+        void       UpdateTransparencyBenchmark();
+        void       CaptureTransparencyImage();
+        void       CompareTransparencyImages() const;
+        void       ReleaseTransparencyReadback();
 
         void NewFrame();
-        void BeginRenderPass() const;
-        void EndRenderPass() const;
+        void BeginCommandBuffer() const;
+        void BeginSecondaryCommandBuffer(const VkCommandBuffer& commandBuffer, const uint32_t& subpass = 0) const;
+        void BeginRenderPass(const bool& secondaryContents = false);
+        void BeginCompositeSubpass(const bool& secondaryContents = false);
+        void EndRenderPass();
+        void RecordDraws(const VkCommandBuffer& commandBuffer, const uint32_t& firstDraw, const uint32_t& drawCount, const bool& indirect, RenderStats& stats, const bool& depthPrepass = false) const;
+        void SubmitIndirectDraws(const VkCommandBuffer& commandBuffer, const uint32_t& firstCommand, const uint32_t& commandCount, RenderStats& stats) const;
         void PresentFrame();
     };
 }
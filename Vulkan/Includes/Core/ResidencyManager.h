@@ -0,0 +1,82 @@
+#pragma once
+#include "GpuDataManager.h"
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <vector>
+
+namespace Resources { class Mesh; }
+namespace Core
+{
+    // - ResidencyManager: Evicts least recently used textures and meshes from the GPU when over budget, and streams them back in on demand - //
+    // * Evicted textures keep their lowest mips resident as placeholders until they are streamed back in from their source file. * //
+    // * Evicted meshes are re-uploaded from their CPU data the frame after they are drawn again. * //
+    // * Transfers are recorded in the frame's command buffer and replaced resources are retired with the frame, so nothing waits for the GPU. * //
+    class ResidencyManager
+    {
+    private:
+        // Texture whose source file is being decoded by a worker thread.
+        struct StreamRequest
+        {
+            GpuHandle<Resources::Texture> handle;
+            std::future<unsigned char*>   pixels; // Null if the file couldn't be loaded or no longer matches the texture.
+        };
+
+        // Mesh drawn while evicted, re-uploaded before the next frame is recorded.
+        struct UploadRequest
+        {
+            GpuHandle<Resources::Mesh> handle;
+            const Resources::Mesh*     mesh;
+        };
+
+        Renderer*       renderer = nullptr;
+        GpuDataManager* gpuData  = nullptr;
+
+        VkDeviceSize budget             = 1024ull << 20; // Bytes of texture and mesh data that can stay resident.
+        uint64_t     minIdleFrames      = 300;           // Number of frames a resource must go unused before it can be evicted.
+        uint32_t     placeholderSize    = 64;            // Largest dimension of the mips kept resident for evicted textures.
+        uint32_t     maxStreamsPerFrame = 2;             // Maximum number of textures decoded at once, and so uploaded in a single frame.
+
+        std::deque<GpuHandle<Resources::Texture>> streamQueue;    // Textures waiting for a worker to decode them.
+        std::vector<StreamRequest>                streamRequests; // Textures being decoded.
+        std::vector<UploadRequest>                uploadRequests;
+
+    public:
+        ResidencyManager(Renderer* _renderer, GpuDataManager* _gpuData) : renderer(_renderer), gpuData(_gpuData) {}
+        ResidencyManager(const ResidencyManager&)            = delete;
+        ResidencyManager(ResidencyManager&&)                 = delete;
+        ResidencyManager& operator=(const ResidencyManager&) = delete;
+        ResidencyManager& operator=(ResidencyManager&&)      = delete;
+        ~ResidencyManager();
+
+        // Records that the given mesh and its material's textures are used this frame.
+        // Returns false if the mesh is evicted, in which case it is re-uploaded for the next frame.
+        bool MarkUsed(const Resources::Mesh& mesh);
+
+        // Uploads requested meshes and decoded textures, and evicts least recently used data while over budget.
+        // Transfers are recorded in the given command buffer, which must be the frame's and be recorded before any draw.
+        void Update(const VkCommandBuffer& commandBuffer);
+
+        void SetBudget            (const VkDeviceSize& bytes)  { budget             = bytes;  }
+        void SetMinIdleFrames     (const uint64_t&     frames) { minIdleFrames      = std::max(frames, (uint64_t)GraphicsUtils::MAX_FRAMES_IN_FLIGHT); }
+        void SetPlaceholderSize   (const uint32_t&     size)   { placeholderSize    = size;   }
+        void SetMaxStreamsPerFrame(const uint32_t&     count)  { maxStreamsPerFrame = count;  }
+
+        VkDeviceSize GetBudget()              const { return budget; }
+        VkDeviceSize GetResidentBytes()       const;
+        size_t       GetEvictedMeshCount()    const;
+        size_t       GetEvictedTextureCount() const;
+
+    private:
+        uint32_t GetPlaceholderBaseMip(const GpuData<Resources::Texture>& data) const;
+        bool     EvictTexture (const VkCommandBuffer& commandBuffer, GpuData<Resources::Texture>& data);
+        void     StreamTexture(const GpuHandle<Resources::Texture>& handle, GpuData<Resources::Texture>& data, const unsigned char* pixels);
+        void     EvictMesh    (GpuData<Resources::Mesh>& data);
+
+        // Textures whose image is replaced move to a new bindless slot, so that the frames in flight keep sampling the old one until it is retired.
+        // Returns false if no slot is free, textures without a slot don't get one.
+        bool AllocateReplacementSlot(const GpuData<Resources::Texture>& data, uint32_t& newSlot) const;
+        void ReplaceTextureImage(GpuData<Resources::Texture>& data, const uint32_t& newSlot, const VkImage& image,
+                                 const VkDeviceMemory& imageMemory, const VkImageView& imageView, const uint32_t& residentMip);
+    };
+}
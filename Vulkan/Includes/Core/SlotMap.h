@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Core
+{
+    // - SlotHandle: Index and generation of a value stored in a SlotMap - //
+    template<typename T> struct SlotHandle
+    {
+        static constexpr uint32_t invalidIndex = UINT32_MAX;
+
+        uint32_t index      = invalidIndex; // Index of the slot in which the value is stored.
+        uint32_t generation = 0;            // Generation of the slot at the time the value was inserted.
+
+        bool IsValid() const { return index != invalidIndex; }
+        bool operator==(const SlotHandle& other) const { return index == other.index && generation == other.generation; }
+        bool operator!=(const SlotHandle& other) const { return !(*this == other); }
+    };
+
+    // - SlotMap: Contiguous storage with O(1) insertion, removal and handle lookups - //
+    // * Erasing a value bumps its slot's generation, so any handle still pointing to it is detected as stale. * //
+    // * Pointers to values are invalidated when a new value is inserted. * //
+    template<typename T> class SlotMap
+    {
+    private:
+        struct Slot
+        {
+            T        value;
+            uint32_t generation = 0;
+            bool     occupied   = false;
+        };
+
+        std::vector<Slot>     slots;
+        std::vector<uint32_t> freeIndices;
+        size_t                count = 0;
+
+    public:
+        // Inserts the given value in a free slot and returns its handle.
+        SlotHandle<T> Insert(T value = T())
+        {
+            uint32_t index;
+            if (!freeIndices.empty()) {
+                index = freeIndices.back();
+                freeIndices.pop_back();
+            }
+            else {
+                index = (uint32_t)slots.size();
+                slots.emplace_back();
+            }
+
+            Slot& slot    = slots[index];
+            slot.value    = std::move(value);
+            slot.occupied = true;
+            ++count;
+            return { index, slot.generation };
+        }
+
+        // Frees the slot pointed to by the given handle. Returns false if the handle is stale.
+        bool Erase(const SlotHandle<T>& handle)
+        {
+            if (!Contains(handle)) return false;
+
+            Slot& slot    = slots[handle.index];
+            slot.value    = T();
+            slot.occupied = false;
+            ++slot.generation;
+            freeIndices.push_back(handle.index);
+            --count;
+            return true;
+        }
+
+        // Returns true if the given handle points to a live value.
+        bool Contains(const SlotHandle<T>& handle) const
+        {
+            return handle.index < slots.size()
+                && slots[handle.index].occupied
+                && slots[handle.index].generation == handle.generation;
+        }
+
+        // Returns a pointer to the value pointed to by the given handle, or nullptr if the handle is stale.
+        T*       Get(const SlotHandle<T>& handle)       { return Contains(handle) ? &slots[handle.index].value : nullptr; }
+        const T* Get(const SlotHandle<T>& handle) const { return Contains(handle) ? &slots[handle.index].value : nullptr; }
+
+        // Calls the given function on every live value, with its handle.
+        template<typename F> void ForEach(F&& func)
+        {
+            for (uint32_t i = 0; i < (uint32_t)slots.size(); i++)
+                if (slots[i].occupied)
+                    func(SlotHandle<T>{ i, slots[i].generation }, slots[i].value);
+        }
+        template<typename F> void ForEach(F&& func) const
+        {
+            for (uint32_t i = 0; i < (uint32_t)slots.size(); i++)
+                if (slots[i].occupied)
+                    func(SlotHandle<T>{ i, slots[i].generation }, slots[i].value);
+        }
+
+        size_t Size()     const { return count; }
+        size_t Capacity() const { return slots.size(); }
+        bool   Empty()    const { return count == 0; }
+
+        void Clear()
+        {
+            for (uint32_t i = 0; i < (uint32_t)slots.size(); i++)
+                if (slots[i].occupied)
+                    Erase({ i, slots[i].generation });
+        }
+    };
+}
@@ -50,12 +50,17 @@ namespace Core
         void SetResourceRefs(Resources::Camera* _camera, std::unordered_map<std::string, Resources::Model>* _models, std::unordered_map<std::string, Resources::Texture>* _textures);
         void Render() const;
 
+        // Initializes the Vulkan backend again once the renderer has recreated its render pass, which must not happen during a frame.
+        void RecreateRenderPassObjects() const;
+
     private:
         void CreateDescriptorPool();
         void InitImGui       () const;
+        void InitImGuiVulkan () const;
         void UploadImGuiFonts() const;
 
         void ShowStatsWindow    () const;
+        void ShowMemoryWindow   () const;
         void ShowLogsWindow     () const;
         void ShowResourcesWindow() const;
         
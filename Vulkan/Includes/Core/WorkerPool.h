@@ -0,0 +1,53 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Core
+{
+    // - WorkerPool: Threads created once and kept alive to run the jobs submitted to them - //
+    // * Jobs are started in submission order, their results and exceptions are returned through futures. * //
+    class WorkerPool
+    {
+    private:
+        std::vector<std::thread>          threads;
+        std::deque<std::function<void()>> jobs;
+        std::mutex                        jobsMutex;
+        std::condition_variable           jobsAvailable;
+        bool                              stopping = false;
+
+    public:
+        WorkerPool(const uint32_t& threadCount);
+        WorkerPool(const WorkerPool&)            = delete;
+        WorkerPool(WorkerPool&&)                 = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+        WorkerPool& operator=(WorkerPool&&)      = delete;
+        ~WorkerPool();
+
+        // Queues the given job and returns the future of its result.
+        template<typename F> std::future<std::invoke_result_t<F&>> Submit(F&& job)
+        {
+            // Queued jobs must be copyable, so the task is shared with them.
+            const auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F&>()>>(std::forward<F>(job));
+            std::future<std::invoke_result_t<F&>> result = task->get_future();
+            {
+                const std::lock_guard<std::mutex> lock(jobsMutex);
+                jobs.emplace_back([task] { (*task)(); });
+            }
+            jobsAvailable.notify_one();
+            return result;
+        }
+
+        uint32_t GetThreadCount() const { return (uint32_t)threads.size(); }
+
+    private:
+        void RunJobs();
+    };
+}
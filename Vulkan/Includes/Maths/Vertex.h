@@ -39,6 +39,15 @@ namespace Maths
         }
     };
 
+    // - VertexAttributes: Rendering data and tangent space info of a TangentVertex, stored apart from its position on the GPU - //
+    struct VertexAttributes
+    {
+        Vector2 uv;        // Vertex texture coordinates.
+        Vector3 normal;    // Vertex normal vector.
+        Vector3 tangent;   // Vertex tangent vector.
+        Vector3 bitangent; // Vertex bitangent vector (orthogonal to normal and tangent).
+    };
+
     struct AnimatedVertex : TangentVertex
     {
         int   boneIDs[MAX_BONE_WEIGHTS] = {}; // Bone indices which influence this vertex.
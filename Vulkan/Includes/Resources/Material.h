@@ -1,6 +1,8 @@
 ﻿#pragma once
 #include "Core/UniqueID.h"
+#include "Core/SlotMap.h"
 #include "Maths/Color.h"
+#include <cstdint>
 #include <string>
 
 typedef struct VkDescriptorSetLayout_T* VkDescriptorSetLayout;
@@ -10,6 +12,8 @@ typedef struct VkBuffer_T*              VkBuffer;
 typedef struct VkDeviceMemory_T*        VkDeviceMemory;
 typedef struct VkDevice_T*              VkDevice;
 
+namespace Core { class GpuDataManager; template<typename> struct GpuData; }
+
 namespace Resources
 {
     class Texture;
@@ -31,6 +35,17 @@ namespace Resources
             Depth,      // Texture map used to modify the object's depth through parallax mapping.
         };
     };
+
+    // Enumerates how a material's transparency is rendered, each mode is drawn in its own pass with its own pipeline state.
+    namespace MaterialAlphaMode
+    {
+        enum : uint32_t
+        {
+            Opaque,      // Fully opaque, keeps early depth testing.
+            AlphaTested, // Albedo texture with transparent pixels, which are discarded (or converted to coverage under MSAA).
+            Blended,     // Material alpha or alpha map, blended with what is behind it.
+        };
+    };
     
     class Material : public UniqueID
     {
@@ -43,8 +58,21 @@ namespace Resources
         float        alpha           = 1;    // Defines how see-through the object is.
         float        depthMultiplier = 0.1f; // Defines how intense the parallax depth effect should be.
         unsigned int depthLayerCount = 32;   // Defines how many layers are used in the parallax depth effect.
+        float        alphaCutoff     = 0.5f; // Alpha tested fragments below this alpha are discarded, unless alpha is converted to coverage.
+
+        // Shading LOD distances, fragments further than them are shaded more cheaply with a dithered transition.
+        float parallaxLodDistance = 10; // Parallax mapping is disabled past this distance, its layer count decreases until then.
+        float normalLodDistance   = 25; // The normal map is replaced by the vertex normals past this distance.
+        float detailLodDistance   = 40; // The metallic, roughness and ambient occlusion maps aren't sampled past this distance.
 
         Texture* textures[MaterialTextureType::COUNT] = { nullptr }; // Array of all different textures used by this material.
+
+    private:
+        friend Core::GpuDataManager;
+
+        uint32_t alphaMode = MaterialAlphaMode::Opaque; // Classified when loading is finalized and when the parameters change.
+
+        mutable Core::SlotHandle<Core::GpuData<Material>> gpuHandle; // Slot of the material's GPU data, set by the GPU data manager.
     
     public:
         Material(const Maths::RGB& _albedo = 1, const Maths::RGB& _emissive = 0, const float& _metallic = 1, const float& _roughness = 1, const float& _alpha = 1,
@@ -55,9 +83,13 @@ namespace Resources
         Material& operator=(Material&&)      noexcept;
         ~Material();
 
-        void FinalizeLoading();
-        bool IsLoadingFinalized();
+        void     FinalizeLoading();
+        bool     IsLoadingFinalized();
+        uint32_t GetAlphaMode() const { return alphaMode; }
         
         void SetParams(const Maths::RGB& _albedo, const Maths::RGB& _emissive, const float& _metallic, const float& _roughness, const float& _alpha);
+
+    private:
+        void ClassifyAlphaMode();
     };
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "Core/UniqueID.h"
+#include "Core/SlotMap.h"
 #include "Maths/Vertex.h"
 #include "Resources/Material.h"
 #include <utility>
@@ -9,7 +10,7 @@
 typedef struct VkBuffer_T*       VkBuffer;
 typedef struct VkDeviceMemory_T* VkDeviceMemory;
 
-namespace Core { class WavefrontParser; }
+namespace Core { class WavefrontParser; class GpuDataManager; template<typename> struct GpuData; }
 namespace Resources
 {
 	class Model;
@@ -19,6 +20,7 @@ namespace Resources
 	{
 	private:
 		friend Core::WavefrontParser;
+		friend Core::GpuDataManager;
 		
 		std::string name;
 		Material*   material = nullptr;
@@ -26,6 +28,10 @@ namespace Resources
 		
 		std::vector<Maths::TangentVertex> vertices;
 		std::vector<uint32_t>             indices;
+		Maths::Vector3                    boundsCenter;     // Center of the mesh's bounding sphere, in model space.
+		float                             boundsRadius = 0; // Radius of the mesh's bounding sphere, in model space.
+
+		mutable Core::SlotHandle<Core::GpuData<Mesh>> gpuHandle; // Slot of the mesh's GPU data, set by the GPU data manager.
 
 	public:
 		Mesh(std::string _name, Model& _parentModel) : name(std::move(_name)), parentModel(_parentModel) {}
@@ -44,8 +50,12 @@ namespace Resources
 		const std::vector<Maths::TangentVertex>& GetVertices() const { return vertices; }
 		const std::vector<uint32_t>&             GetIndices()  const { return indices; }
 		uint32_t GetIndexCount() const { return (uint32_t)indices.size(); }
+		const Maths::Vector3& GetBoundsCenter() const { return boundsCenter; }
+		float                 GetBoundsRadius() const { return boundsRadius; }
 		
-		static VkVertexInputBindingDescription GetVertexBindingDescription();
+		// Vertices are split in a tightly packed position stream (binding 0) and a stream of the other attributes (binding 1),
+		// so that depth only passes can bind the positions alone.
+		static std::array<VkVertexInputBindingDescription,   2> GetVertexBindingDescriptions();
 		static std::array<VkVertexInputAttributeDescription, 5> GetVertexAttributeDescriptions();
 	};
 }
@@ -5,7 +5,7 @@
 #include <vector>
 #include <optional>
 
-namespace Core { class WavefrontParser; template<typename T> struct GpuData; }
+namespace Core { class WavefrontParser; }
 namespace Resources
 {
 	class Camera;
@@ -19,6 +19,8 @@ namespace Resources
 		
 		std::string       name;
 		std::vector<Mesh> meshes;
+		Maths::Vector3    boundsCenter;     // Center of the sphere that encloses all meshes, in model space.
+		float             boundsRadius = 0; // Radius of the sphere that encloses all meshes, in model space.
 
 	public:
 		Maths::Transform transform;
@@ -29,12 +31,15 @@ namespace Resources
 		Model(Model&&)                 = delete;
 		Model& operator=(const Model&) = delete;
 		Model& operator=(Model&&) noexcept;
-		~Model();
+		~Model() = default;
 
-		void UpdateMvpBuffer(const Camera& camera, const uint32_t& currentFrame, const Core::GpuData<Model>* modelData = nullptr) const;
+		// Recomputes the model's bounding sphere from its meshes' bounding spheres.
+		void UpdateBounds();
 		
 		std::string              GetName  () const { return name;    }
 		const std::vector<Mesh>& GetMeshes() const { return meshes;  }
 		      std::vector<Mesh>& GetMeshes()       { return meshes;  }
+		const Maths::Vector3&    GetBoundsCenter() const { return boundsCenter; }
+		float                    GetBoundsRadius() const { return boundsRadius; }
 	};
 }
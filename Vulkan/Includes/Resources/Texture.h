@@ -1,21 +1,27 @@
 ﻿#pragma once
 #include "Core/UniqueID.h"
+#include "Core/SlotMap.h"
 #include <cstdint>
 #include <string>
 
-namespace Core { class Renderer; }
+namespace Core { class Renderer; class GpuDataManager; template<typename> struct GpuData; }
 namespace Resources
 {
     class Texture : public UniqueID
     {
     private:
+        friend Core::GpuDataManager;
+
         std::string name;
         bool        containsColor;
         int         width     = 0;
         int         height    = 0;
         int         channels  = 0;
         uint32_t    mipLevels = 0;
+        bool        hasAlpha  = false; // True if some pixels aren't fully opaque.
         unsigned char* pixels = nullptr;
+
+        mutable Core::SlotHandle<Core::GpuData<Texture>> gpuHandle; // Slot of the texture's GPU data, set by the GPU data manager.
         
     public:
         Texture() = default;
@@ -29,7 +35,9 @@ namespace Resources
         std::string    GetName()           const { return name; }
         int            GetWidth ()         const { return width; }
         int            GetHeight()         const { return height; }
+        int            GetChannels()       const { return channels; }
         uint32_t       GetMipLevels()      const { return mipLevels; }
+        bool           HasAlpha()          const { return hasAlpha; }
         unsigned char* GetPixels()         const { return pixels; }
         bool           ContainsColorData() const { return containsColor; }
     };
@@ -0,0 +1,95 @@
+// Light types definition.
+#define DirLightType   1
+#define PointLightType 2
+#define SpotLightType  3
+
+// The cluster grid dimensions are defined when compiling.
+#define ClusterCount (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z)
+#define GroupSize    64
+
+// Light data, laid out like Resources::Light.
+struct Light
+{
+    float4 albedo;
+    float3 position;
+    float3 direction;
+    float  radius, falloff;
+    float  outerCutoff, innerCutoff;
+    int    type;
+};
+
+// Cluster parameters, laid out like GraphicsUtils::LightClusterParams.
+struct ClusterParams
+{
+    row_major float4x4 viewMat;
+    float projScaleX;
+    float projScaleY;
+    float nearPlane;
+    float farPlane;
+    float screenWidth;
+    float screenHeight;
+    uint  lightCount;
+    uint  lightFeatures;
+    uint  clustered;
+};
+
+// Lights, cluster parameters and cluster light lists, which hold the light counts of all clusters followed by the light list of each cluster.
+[[vk::binding(0, 0)]] StructuredBuffer<Light>        lights;
+[[vk::binding(1, 0)]] ConstantBuffer<ClusterParams>  clusterParams;
+[[vk::binding(2, 0)]] RWStructuredBuffer<uint>       clusterLights;
+
+// View space bounding spheres of the batch of lights being tested.
+// The radius is -1 for lights that reach every cluster and -2 for unassigned lights.
+groupshared float4 batchSpheres[GroupSize];
+
+[numthreads(GroupSize, 1, 1)]
+void main(uint3 threadID : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex)
+{
+    const uint clusterIdx = threadID.x;
+    const bool active     = clusterIdx < ClusterCount;
+
+    // Get the cluster's view space bounds from its screen tile and exponential depth slice.
+    // A view space point at a given distance projects to its xy coordinates times the projection scale divided by that distance.
+    const uint3  cell       = uint3(clusterIdx % LIGHT_CLUSTERS_X, (clusterIdx / LIGHT_CLUSTERS_X) % LIGHT_CLUSTERS_Y, clusterIdx / (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y));
+    const float2 tileCount  = float2(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y);
+    const float2 ndcMin     = float2(cell.xy)     / tileCount * 2 - 1;
+    const float2 ndcMax     = float2(cell.xy + 1) / tileCount * 2 - 1;
+    const float  depthRatio = clusterParams.farPlane / clusterParams.nearPlane;
+    const float  nearDist   = clusterParams.nearPlane * pow(depthRatio, (float)cell.z       / LIGHT_CLUSTERS_Z);
+    const float  farDist    = clusterParams.nearPlane * pow(depthRatio, (float)(cell.z + 1) / LIGHT_CLUSTERS_Z);
+    const float2 invScale   = 1 / float2(clusterParams.projScaleX, clusterParams.projScaleY);
+    const float2 nearMin    = ndcMin * invScale * nearDist, nearMax = ndcMax * invScale * nearDist;
+    const float2 farMin     = ndcMin * invScale * farDist,  farMax  = ndcMax * invScale * farDist;
+    const float3 boxMin     = float3(min(min(nearMin, nearMax), min(farMin, farMax)), -farDist);
+    const float3 boxMax     = float3(max(max(nearMin, nearMax), max(farMin, farMax)), -nearDist);
+
+    uint       count     = 0;
+    const uint listStart = ClusterCount + clusterIdx * MAX_CLUSTER_LIGHTS;
+    for (uint first = 0; first < clusterParams.lightCount; first += GroupSize)
+    {
+        // Load a batch of lights in view space, one per thread.
+        const uint lightIdx = first + groupIndex;
+        if (lightIdx < clusterParams.lightCount)
+        {
+            const Light  light   = lights[lightIdx];
+            const bool   valid   = light.type == DirLightType || light.type == PointLightType || light.type == SpotLightType;
+            const float4 viewPos = clusterParams.viewMat * float4(light.position, 1);
+            batchSpheres[groupIndex] = float4(viewPos.xyz, !valid ? -2 : light.type == DirLightType ? -1 : light.radius);
+        }
+        GroupMemoryBarrierWithGroupSync();
+
+        // Add the lights whose spheres intersect the cluster's bounds.
+        const uint batchCount = min(GroupSize, clusterParams.lightCount - first);
+        for (uint i = 0; active && i < batchCount && count < MAX_CLUSTER_LIGHTS; i++)
+        {
+            const float4 sphere = batchSpheres[i];
+            const float3 offset = clamp(sphere.xyz, boxMin, boxMax) - sphere.xyz;
+            if (sphere.w == -1 || (sphere.w >= 0 && dot(offset, offset) <= sphere.w * sphere.w))
+                clusterLights[listStart + count++] = first + i;
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (active)
+        clusterLights[clusterIdx] = count;
+}
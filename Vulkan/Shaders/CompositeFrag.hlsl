@@ -0,0 +1,25 @@
+// Weighted blended transparency targets, read per sample when multisampling is enabled.
+#ifdef MSAA
+[[vk::input_attachment_index(0)]] [[vk::binding(0, 0)]] SubpassInputMS<float4> accumInput;
+[[vk::input_attachment_index(1)]] [[vk::binding(1, 0)]] SubpassInputMS<float4> revealInput;
+#else
+[[vk::input_attachment_index(0)]] [[vk::binding(0, 0)]] SubpassInput<float4> accumInput;
+[[vk::input_attachment_index(1)]] [[vk::binding(1, 0)]] SubpassInput<float4> revealInput;
+#endif
+
+// Outputs the average transparent color with the alpha that reveals what is behind it, blended as src * (1 - alpha) + dst * alpha.
+float4 main(float4 position : SV_POSITION, uint sampleIndex : SV_SampleIndex) : SV_Target
+{
+#ifdef MSAA
+    const float4 accum  = accumInput .SubpassLoad(sampleIndex);
+    const float  reveal = revealInput.SubpassLoad(sampleIndex).r;
+#else
+    const float4 accum  = accumInput .SubpassLoad();
+    const float  reveal = revealInput.SubpassLoad().r;
+#endif
+    
+    // Skip the pixels that no transparent surface covers.
+    if (reveal >= 1)
+        discard;
+    return float4(accum.rgb / max(accum.a, 1e-5), reveal);
+}
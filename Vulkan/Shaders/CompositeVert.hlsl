@@ -0,0 +1,6 @@
+// Draws a triangle that covers the whole screen from the vertex index alone.
+float4 main(uint vertexIndex : SV_VertexID) : SV_POSITION
+{
+    const float2 uv = float2((vertexIndex << 1) & 2, vertexIndex & 2);
+    return float4(uv * 2 - 1, 0, 1);
+}
@@ -0,0 +1,75 @@
+#include "InstanceData.hlsli"
+
+// Model space bounding sphere of each instance and the index of the command that draws it.
+struct CullInstance
+{
+    float3 center;
+    float  radius;
+    uint   command;
+    uint   padding0; // Scalars rather than a uint3, which would be aligned to 16 bytes and make the stride 48.
+    uint   padding1;
+    uint   padding2;
+};
+
+// Indirect draw command, laid out like VkDrawIndexedIndirectCommand.
+struct DrawCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int  vertexOffset;
+    uint firstInstance;
+};
+
+// Number of visible instances written by the shader and number of instances to cull written by the CPU.
+struct CullCounters
+{
+    uint visibleCount;
+    uint instanceCount;
+};
+
+[[vk::binding(0, 0)]] StructuredBuffer<InstanceData>   instances;
+[[vk::binding(1, 0)]] StructuredBuffer<CullInstance>   cullInstances;
+[[vk::binding(2, 0)]] RWStructuredBuffer<DrawCommand>  commands;
+[[vk::binding(3, 0)]] RWStructuredBuffer<uint>         visibleInstances;
+[[vk::binding(4, 0)]] RWStructuredBuffer<CullCounters> counters;
+
+// Frustum planes as combinations of clip space coordinates: left, right, bottom, top, near, far.
+static const float4 frustumPlanes[6] = {
+    float4( 1,  0,  0, 1),
+    float4(-1,  0,  0, 1),
+    float4( 0,  1,  0, 1),
+    float4( 0, -1,  0, 1),
+    float4( 0,  0,  1, 0),
+    float4( 0,  0, -1, 1),
+};
+
+[numthreads(64, 1, 1)]
+void main(uint3 threadID : SV_DispatchThreadID)
+{
+    const uint instanceIdx = threadID.x;
+    if (instanceIdx >= counters[0].instanceCount)
+        return;
+    const CullInstance cull = cullInstances[instanceIdx];
+    const float4x4     mvp  = instances[instanceIdx].mvp;
+
+    // Each clip space plane is an affine function of model space positions.
+    // Its value at the sphere center divided by the length of its gradient is the distance from the center to the plane.
+    const float4 center = mvp * float4(cull.center, 1);
+    const float4 axisX  = mvp * float4(1, 0, 0, 0);
+    const float4 axisY  = mvp * float4(0, 1, 0, 0);
+    const float4 axisZ  = mvp * float4(0, 0, 1, 0);
+    for (uint i = 0; i < 6; i++)
+    {
+        const float  dist     = dot(frustumPlanes[i], center);
+        const float3 gradient = float3(dot(frustumPlanes[i], axisX), dot(frustumPlanes[i], axisY), dot(frustumPlanes[i], axisZ));
+        if (dist < -cull.radius * length(gradient))
+            return;
+    }
+
+    // Append the instance to its command's visible instances.
+    uint slot;
+    InterlockedAdd(commands[cull.command].instanceCount, 1, slot);
+    visibleInstances[commands[cull.command].firstInstance + slot] = instanceIdx;
+    InterlockedAdd(counters[0].visibleCount, 1);
+}
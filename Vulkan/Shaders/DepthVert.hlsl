@@ -0,0 +1,17 @@
+// Vertex position input, only the position stream is bound for the depth pre-pass.
+struct VSInput
+{
+    [[vk::location(0)]] float3 position : POSITION;
+};
+
+#include "InstanceData.hlsli"
+[[vk::binding(0, 0)]] StructuredBuffer<InstanceData> instances;
+[[vk::binding(1, 0)]] StructuredBuffer<uint>         visibleInstances;
+
+// The position is computed exactly like in the main vertex shader, so that the main pass can test depth for equality.
+float4 main(VSInput input, uint instanceIndex : SV_InstanceID) : SV_POSITION
+{
+    const InstanceData instance = instances[visibleInstances[instanceIndex]];
+    precise const float4 position = instance.mvp * float4(input.position, 1);
+    return position;
+}
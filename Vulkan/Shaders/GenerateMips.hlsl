@@ -0,0 +1,132 @@
+// Each work group reduces a 64x64 tile of the source level to the next six levels,
+// then the last work group to finish reduces the sixth level to the remaining ones.
+#define MaxMipsPerPass 12
+#define TileSize       64
+#define GroupSize      16
+
+// Reduction filters, matching Core::MipFilter.
+#define BoxFilter   0
+#define PointFilter 1
+#define MinFilter   2
+#define MaxFilter   3
+
+// Dispatch parameters, laid out like Core::MipGenerator::PassConstants.
+struct PassConstants
+{
+    uint2 srcSize;    // Size of the level the pass reads from.
+    uint  mipCount;   // Number of levels written by the pass.
+    uint  groupCount; // Number of work groups in the dispatch.
+    uint  filter;
+    uint  srgb;       // Non-zero if the levels are sRGB encoded.
+};
+[[vk::push_constant]] PassConstants constants;
+
+// Source level, read through a view that decodes sRGB, the levels written through UNORM views and the number of work groups that are done.
+[[vk::binding(0, 0)]] Texture2D<float4> srcTexture;
+[[vk::binding(1, 0)]] [[vk::image_format("rgba8")]] globallycoherent RWTexture2D<float4> dstMips[MaxMipsPerPass];
+[[vk::binding(2, 0)]] globallycoherent RWStructuredBuffer<uint> groupCounter;
+
+groupshared float4 tile[GroupSize][GroupSize];
+groupshared uint   isLastGroup;
+
+float3 SrgbToLinear(float3 color)
+{
+    return lerp(pow((color + 0.055) / 1.055, 2.4), color / 12.92, step(color, 0.04045));
+}
+
+float3 LinearToSrgb(float3 color)
+{
+    return lerp(1.055 * pow(color, 1.0 / 2.4) - 0.055, color * 12.92, step(color, 0.0031308));
+}
+
+// Size of a level of the pass, the source being level 0.
+uint2 LevelSize(uint level)
+{
+    return max(constants.srcSize >> level, 1);
+}
+
+float4 Reduce(float4 topLeft, float4 topRight, float4 bottomLeft, float4 bottomRight)
+{
+    switch (constants.filter)
+    {
+    case PointFilter: return topLeft;
+    case MinFilter:   return min(min(topLeft, topRight), min(bottomLeft, bottomRight));
+    case MaxFilter:   return max(max(topLeft, topRight), max(bottomLeft, bottomRight));
+    default:          return (topLeft + topRight + bottomLeft + bottomRight) * 0.25;
+    }
+}
+
+// Loads a texel of a level in linear space, clamped to the level's edges.
+float4 LoadTexel(uint level, uint2 coord)
+{
+    const uint2 clamped = min(coord, LevelSize(level) - 1);
+    if (level == 0) return srcTexture.Load(int3(clamped, 0));
+
+    float4 texel = dstMips[level - 1][clamped];
+    if (constants.srgb != 0) texel.rgb = SrgbToLinear(texel.rgb);
+    return texel;
+}
+
+// Encodes a texel and writes it if it is inside a level written by the pass.
+void StoreTexel(uint level, uint2 coord, float4 texel)
+{
+    if (level > constants.mipCount || any(coord >= LevelSize(level))) return;
+    if (constants.srgb != 0) texel.rgb = LinearToSrgb(texel.rgb);
+    dstMips[level - 1][coord] = texel;
+}
+
+// Reduces a 64x64 tile of the given level to the six levels after it.
+void DownsampleTile(uint srcLevel, uint2 tileId, uint2 threadId)
+{
+    // Each thread reduces 4x4 texels to 2x2 texels of the first level, then to one texel of the second level.
+    float4 quad[4];
+    for (uint i = 0; i < 4; i++)
+    {
+        const uint2 dstCoord = tileId * (TileSize / 2) + threadId * 2 + uint2(i % 2, i / 2);
+        const uint2 srcCoord = dstCoord * 2;
+        quad[i] = Reduce(LoadTexel(srcLevel, srcCoord),              LoadTexel(srcLevel, srcCoord + uint2(1, 0)),
+                         LoadTexel(srcLevel, srcCoord + uint2(0, 1)), LoadTexel(srcLevel, srcCoord + uint2(1, 1)));
+        StoreTexel(srcLevel + 1, dstCoord, quad[i]);
+    }
+    float4 texel = Reduce(quad[0], quad[1], quad[2], quad[3]);
+    StoreTexel(srcLevel + 2, tileId * (TileSize / 4) + threadId, texel);
+    tile[threadId.y][threadId.x] = texel;
+
+    // The next levels are reduced in group shared memory, by a quarter of the threads each time.
+    for (uint level = 3; level <= 6; level++)
+    {
+        GroupMemoryBarrierWithGroupSync();
+        const uint tileSize = TileSize >> level;
+        const bool active   = all(threadId < tileSize);
+        if (active)
+        {
+            const uint2 coord = threadId * 2;
+            texel = Reduce(tile[coord.y][coord.x], tile[coord.y][coord.x + 1], tile[coord.y + 1][coord.x], tile[coord.y + 1][coord.x + 1]);
+            StoreTexel(srcLevel + level, tileId * tileSize + threadId, texel);
+        }
+        GroupMemoryBarrierWithGroupSync();
+        if (active) tile[threadId.y][threadId.x] = texel;
+    }
+}
+
+[numthreads(GroupSize, GroupSize, 1)]
+void main(uint3 groupId : SV_GroupID, uint3 threadId : SV_GroupThreadID, uint threadIndex : SV_GroupIndex)
+{
+    DownsampleTile(0, groupId.xy, threadId.xy);
+    if (constants.mipCount <= 6) return;
+
+    // Make the sixth level visible to the other work groups before counting this one as done.
+    AllMemoryBarrierWithGroupSync();
+    if (threadIndex == 0)
+    {
+        uint doneCount;
+        InterlockedAdd(groupCounter[0], 1, doneCount);
+        isLastGroup = doneCount == constants.groupCount - 1 ? 1 : 0;
+    }
+    AllMemoryBarrierWithGroupSync();
+    if (isLastGroup == 0) return;
+
+    // The last work group sees the whole sixth level, which fits in a single tile, and resets the counter for the next pass.
+    if (threadIndex == 0) groupCounter[0] = 0;
+    DownsampleTile(6, uint2(0, 0), threadId.xy);
+}
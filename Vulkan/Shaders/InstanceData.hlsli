@@ -0,0 +1,10 @@
+// Model, view and projection matrices and material index of each instance.
+struct InstanceData
+{
+    row_major float4x4 model;
+    row_major float4x4 mvp;
+    uint               materialIndex;
+    uint               padding0; // Scalars rather than a uint3, which would be aligned to 16 bytes and make the stride 160.
+    uint               padding1;
+    uint               padding2;
+};
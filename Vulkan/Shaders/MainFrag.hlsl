@@ -10,31 +10,47 @@ const float PI = 3.14159265359;
 #define NormalMapIdx       6
 #define DepthMapIdx        7
 #define TextureTypesCount  8
+#define NoTexture          0xFFFFFFFF
 
 // Light types definition.
 #define DirLightType   1
 #define PointLightType 2
 #define SpotLightType  3
 
+// Shader features, set per pipeline variant: one bit per texture type, alpha testing, then one bit per light type.
+// The alpha to coverage, blending, order independent transparency and tessellation bits are the pipeline's state.
+#define AlphaTestFeature    0x100
+#define LightFeatureShift   8
+#define A2cFeature          0x2000
+#define BlendingFeature     0x4000
+#define OitFeature          0x8000
+#define TessellationFeature 0x10000
+[[vk::constant_id(0)]] const uint shaderFeatures = 0xFFF;
+
 // Inputs from vertex shader.
 struct FSInput
 {
+    float4 position : SV_POSITION;
     [[vk::location(0)]] float3   fragPos   : POSITION;
     [[vk::location(1)]] float2   texCoord  : TEXCOORD;
     [[vk::location(2)]] float3   normal    : NORMAL;
     [[vk::location(3)]] float3x3 tbnMatrix : NORMAL1; // This variable uses 3 locations in total.
+    [[vk::location(6)]] nointerpolation uint materialIndex : MATERIAL;
 };
 
-// Fragment color output.
+// Fragment color output, and weighted blended transparency outputs that are only written by order independent pipelines.
 struct FSOutput
 {
-    float4 color : COLOR;
+    [[vk::location(0)]] float4 color  : COLOR0;
+    [[vk::location(1)]] float4 accum  : COLOR1;
+    [[vk::location(2)]] float  reveal : COLOR2;
 };
 
 // Push constants input.
 struct PushConstants
 {
     float3 viewPos;
+    float  shadingLodScale; // Scales the materials' shading LOD distances, 0 disables shading LOD.
 };
 [[vk::push_constant]] PushConstants pushConstants;
 
@@ -48,7 +64,8 @@ struct FogParams
 };
 [[vk::binding(0, 1)]] ConstantBuffer<FogParams> fogParams;
 
-// Material data and textures inputs.
+// Material data of every material and bindless textures inputs.
+// The material's textures are indices in the bindless texture array, or NoTexture.
 struct MaterialData
 {
     float3 albedo;
@@ -58,10 +75,16 @@ struct MaterialData
     float  alpha;
     float  depthMultiplier;
     uint   depthLayerCount;
+    uint   textures[TextureTypesCount];
+    float  parallaxLodDistance;
+    float  normalLodDistance;
+    float  detailLodDistance;
+    float  alphaCutoff;
 };
-[[vk::binding(0, 2)]] ConstantBuffer<MaterialData> materialData;
-[[vk::binding(1, 2)]] Texture2D    materialTextures[TextureTypesCount];
-[[vk::binding(1, 2)]] SamplerState materialSamplers[TextureTypesCount];
+[[vk::binding(0, 2)]] StructuredBuffer<MaterialData> materials;
+[[vk::binding(1, 2)]] Texture2D    bindlessTextures[MAX_BINDLESS_TEXTURES];
+[[vk::binding(1, 2)]] SamplerState bindlessSamplers[MAX_BINDLESS_TEXTURES];
+static MaterialData materialData; // Material of the current fragment.
 
 // Light data struct and inputs.
 struct Light
@@ -73,31 +96,47 @@ struct Light
     float  outerCutoff, innerCutoff;
     int    type;
 };
-struct LightBuffer
+struct ClusterParams
 {
-    Light data[2];
+    row_major float4x4 viewMat;
+    float projScaleX;
+    float projScaleY;
+    float nearPlane;
+    float farPlane;
+    float screenWidth;
+    float screenHeight;
+    uint  lightCount;
+    uint  lightFeatures;
+    uint  clustered;
 };
-[[vk::binding(0, 3)]] ConstantBuffer<LightBuffer> lights;
+[[vk::binding(0, 3)]] StructuredBuffer<Light>       lights;
+[[vk::binding(1, 3)]] ConstantBuffer<ClusterParams> clusterParams;
+[[vk::binding(2, 3)]] StructuredBuffer<uint>        clusterLights; // Light counts of all clusters, followed by the light list of each cluster.
+#define ClusterCount (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z)
 
 float3  ComputeLighting(Light light, float3 fragPos, float3 viewDir, float3 normal, float3 albedo, float metallic, float roughness, float3 reflectance);
 float2  ParallaxMapping(float2 fragTexCoord, float3 viewDir, float fragDistance);
+bool    IsPastLod(float lodDistance, float fragDistance, float2 fragCoord);
+uint    GetClusterIndex(float2 fragCoord, float3 fragPos);
+bool    HasTexture(uint type);
+float4  SampleTexture(uint type, float2 texCoord);
 
 FSOutput main(FSInput input)
 {
     FSOutput output = (FSOutput)0;
+    materialData = materials[input.materialIndex];
     
     // Compute the view direction.
     const float3 fragToView   = pushConstants.viewPos - input.fragPos;
     const float3 viewDir      = normalize(fragToView);
     const float  fragDistance = length(fragToView);
     
-    // Compute parallax mapping if necessary.
+    // Compute parallax mapping if necessary, tessellated variants already displaced their geometry with the depth map.
     float2 texCoord = input.texCoord;
-    uint width, height, levelCount;
-    materialTextures[DepthMapIdx].GetDimensions(0, width, height, levelCount);
-    if (width > 0)
+    if (HasTexture(DepthMapIdx))
     {
-        texCoord = ParallaxMapping(texCoord, normalize(/*inverse*/transpose(input.tbnMatrix) * viewDir), fragDistance);
+        if ((shaderFeatures & TessellationFeature) == 0 && !IsPastLod(materialData.parallaxLodDistance, fragDistance, input.position.xy))
+            texCoord = ParallaxMapping(texCoord, normalize(/*inverse*/transpose(input.tbnMatrix) * viewDir), fragDistance);
     }
     else
     {
@@ -107,64 +146,70 @@ FSOutput main(FSInput input)
     
     // Determine fragment transparency from material alpha value and texture.
     output.color.a = materialData.alpha;
-    materialTextures[AlphaMapIdx].GetDimensions(0, width, height, levelCount);
-    if (width > 0)
-        output.color.a *= materialTextures[AlphaMapIdx].Sample(materialSamplers[AlphaMapIdx], texCoord).a;
+    if (HasTexture(AlphaMapIdx))
+        output.color.a *= SampleTexture(AlphaMapIdx, texCoord).a;
     
     // Determine albedo from material albedo value and texture.
     float3 albedo = materialData.albedo.rgb;
-    materialTextures[AlbedoTextureIdx].GetDimensions(0, width, height, levelCount);
-    if (width > 0) {
-        float4 texSample = materialTextures[AlbedoTextureIdx].Sample(materialSamplers[AlbedoTextureIdx], texCoord);
+    if (HasTexture(AlbedoTextureIdx)) {
+        float4 texSample = SampleTexture(AlbedoTextureIdx, texCoord);
         albedo *= texSample.rgb;
         output.color.a *= texSample.a;
     }
 
-    // Stop computations if the fragment is fully transparent.
-    if (output.color.a <= 0)
-        discard; // Might cause visual artifacts.
+    // Discard alpha tested fragments below the material's cutoff, or only fully transparent ones when alpha is converted to coverage or blended.
+    if ((shaderFeatures & AlphaTestFeature) != 0)
+    {
+        const bool cutout = (shaderFeatures & (A2cFeature | BlendingFeature)) == 0;
+        if (output.color.a <= 0 || (cutout && output.color.a < materialData.alphaCutoff))
+            discard;
+    }
     
-    // Determine metallic from material metallic value and map.
+    // Determine metallic from material metallic value and map, the detail maps aren't sampled past the material's detail LOD distance.
+    const bool sampleDetail = !IsPastLod(materialData.detailLodDistance, fragDistance, input.position.xy);
     float metallic = materialData.metallic;
-    materialTextures[MetallicMapIdx].GetDimensions(0, width, height, levelCount);
-    if (width > 0)
-        metallic *= materialTextures[MetallicMapIdx].Sample(materialSamplers[MetallicMapIdx], texCoord).r;
+    if (sampleDetail && HasTexture(MetallicMapIdx))
+        metallic *= SampleTexture(MetallicMapIdx, texCoord).r;
 
     // Determine roughness from material roughness value and map.
     float roughness = materialData.roughness;
-    materialTextures[RoughnessMapIdx].GetDimensions(0, width, height, levelCount);
-    if (width > 0)
-        roughness *= materialTextures[RoughnessMapIdx].Sample(materialSamplers[RoughnessMapIdx], texCoord).r;
+    if (sampleDetail && HasTexture(RoughnessMapIdx))
+        roughness *= SampleTexture(RoughnessMapIdx, texCoord).r;
     
     // Determine ambient occlusion from ao map.
     float ambientOcclusion = 1;
-    materialTextures[AOcclusionMapIdx].GetDimensions(0, width, height, levelCount);
-    if (width > 0)
-        ambientOcclusion = materialTextures[AOcclusionMapIdx].Sample(materialSamplers[AOcclusionMapIdx], texCoord).r;
+    if (sampleDetail && HasTexture(AOcclusionMapIdx))
+        ambientOcclusion = SampleTexture(AOcclusionMapIdx, texCoord).r;
 
-    // Determine fragment normal from mesh normal and normal map.
+    // Determine fragment normal from mesh normal and normal map, which falls back to the mesh normal past the material's normal LOD distance.
     float3 normal = input.normal.xyz;
-    materialTextures[NormalMapIdx].GetDimensions(0, width, height, levelCount);
-    if (width > 0) {
-        normal = materialTextures[NormalMapIdx].Sample(materialSamplers[NormalMapIdx], texCoord).rgb * 2.0 - 1.0;
+    if (HasTexture(NormalMapIdx) && !IsPastLod(materialData.normalLodDistance, fragDistance, input.position.xy)) {
+        normal = SampleTexture(NormalMapIdx, texCoord).rgb * 2.0 - 1.0;
         normal = normalize(input.tbnMatrix * normal);
     }
 
     // Calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)
     const float3 reflectance = lerp(float3(0.04, 0.04, 0.04), albedo, metallic);
     
-    // Compute lighting and shadows.
+    // Compute lighting and shadows from the lights of the fragment's cluster, or from all the lights if clustering is disabled.
+    uint lightCount = clusterParams.lightCount;
+    uint listStart  = 0;
+    if (clusterParams.clustered != 0) {
+        const uint clusterIdx = GetClusterIndex(input.position.xy, input.fragPos);
+        lightCount = clusterLights[clusterIdx];
+        listStart  = ClusterCount + clusterIdx * MAX_CLUSTER_LIGHTS;
+    }
     float3 lightSum = float3(0,0,0);
-    for (int i = 0; i < 5; i++) {
-        lightSum += ComputeLighting(lights.data[i], input.fragPos, viewDir, normal, albedo, metallic, roughness, reflectance);
+    for (uint i = 0; i < lightCount; i++) {
+        const uint lightIdx = clusterParams.clustered != 0 ? clusterLights[listStart + i] : i;
+        lightSum += ComputeLighting(lights[lightIdx], input.fragPos, viewDir, normal, albedo, metallic, roughness, reflectance);
     }
     output.color.rgb = lightSum * ambientOcclusion;
     
     // Add emissive color from material emissive value and texture.
     float3 emissive = materialData.emissive;
-    materialTextures[EmissiveTextureIdx].GetDimensions(0, width, height, levelCount);
-    if (width > 0)
-        emissive *= materialTextures[EmissiveTextureIdx].Sample(materialSamplers[EmissiveTextureIdx], texCoord).rgb;
+    if (HasTexture(EmissiveTextureIdx))
+        emissive *= SampleTexture(EmissiveTextureIdx, texCoord).rgb;
     output.color.rgb += emissive;
     
     // Compute distance fog.
@@ -174,6 +219,14 @@ FSOutput main(FSInput input)
     
     // Apply gamma correction.
     output.color.rgb = pow(output.color.rgb, 1.0/1.6);
+
+    // Accumulate premultiplied color weighted by alpha and depth, so that the nearest surfaces dominate without sorting.
+    if ((shaderFeatures & OitFeature) != 0) {
+        const float alpha  = output.color.a;
+        const float weight = clamp(alpha * max(1e-2, 3e3 * pow(1 - input.position.z, 3)), 1e-2, 3e3);
+        output.accum  = float4(output.color.rgb * alpha, alpha) * weight;
+        output.reveal = alpha;
+    }
     return output;
 }
 
@@ -240,6 +293,8 @@ float3 ComputeLighting(Light light, float3 fragPos, float3 viewDir, float3 norma
 {
     if (light.type != DirLightType && light.type != PointLightType && light.type != SpotLightType)
     return float3(0,0,0);
+    if ((shaderFeatures & (1u << (LightFeatureShift + light.type))) == 0)
+        return float3(0,0,0);
 
     const float3 fragToLight = light.type == DirLightType ? normalize(-light.direction) : normalize(light.position - fragPos);
     const float3 height      = normalize(viewDir + fragToLight);
@@ -268,29 +323,64 @@ float3 ComputeLighting(Light light, float3 fragPos, float3 viewDir, float3 norma
 
 float2 ParallaxMapping(float2 fragTexCoord, float3 viewDir, float fragDistance)
 {
+    // The layer count decreases with distance, down to a single layer at the parallax LOD distance when shading LOD is enabled.
     const float maxLayers  = float(materialData.depthLayerCount);
-    const float numLayers  = max(lerp(maxLayers, 1, log(fragDistance+1) * 0.5), 1);
+    const float lodFactor  = pushConstants.shadingLodScale > 0 ? saturate(fragDistance / (materialData.parallaxLodDistance * pushConstants.shadingLodScale)) : log(fragDistance+1) * 0.5;
+    const float numLayers  = max(lerp(maxLayers, 1, lodFactor), 1);
     const float layerDepth = 1 / numLayers;
     
     const float2 layerOffset   = viewDir.xy  * materialData.depthMultiplier;
     const float2 deltaTexCoord = layerOffset * layerDepth;
 
     float2 curTexCoord   = fragTexCoord;
-    float  curDepthVal   = 1 - materialTextures[DepthMapIdx].Sample(materialSamplers[DepthMapIdx], curTexCoord).r;
+    float  curDepthVal   = 1 - SampleTexture(DepthMapIdx, curTexCoord).r;
     float  curLayerDepth = 0.0;
 
     while (curLayerDepth < curDepthVal)
     {
         curTexCoord   -= deltaTexCoord;
-        curDepthVal    = 1 - materialTextures[DepthMapIdx].Sample(materialSamplers[DepthMapIdx], curTexCoord).r;
+        curDepthVal    = 1 - SampleTexture(DepthMapIdx, curTexCoord).r;
         curLayerDepth += layerDepth;
     }
 
     const float2 prevTexCoords = curTexCoord + deltaTexCoord;
 
     const float afterDepth  = curDepthVal - curLayerDepth;
-    const float beforeDepth = 1 - materialTextures[DepthMapIdx].Sample(materialSamplers[DepthMapIdx], prevTexCoords).r - curLayerDepth + layerDepth;
+    const float beforeDepth = 1 - SampleTexture(DepthMapIdx, prevTexCoords).r - curLayerDepth + layerDepth;
 
     const float weight = afterDepth / (afterDepth - beforeDepth);
     return prevTexCoords * weight + curTexCoord * (1 - weight);
 }
+
+bool IsPastLod(float lodDistance, float fragDistance, float2 fragCoord)
+{
+    if (pushConstants.shadingLodScale <= 0)
+        return false;
+
+    // Fragments in the last fifth of the band are dithered between both shadings with interleaved gradient noise, so the transition doesn't show as a line.
+    const float end    = lodDistance * pushConstants.shadingLodScale;
+    const float blend  = saturate((fragDistance - end * 0.8) / (end * 0.2));
+    const float dither = frac(52.9829189 * frac(dot(fragCoord, float2(0.06711056, 0.00583715))));
+    return blend > dither;
+}
+
+uint GetClusterIndex(float2 fragCoord, float3 fragPos)
+{
+    // Clusters split the screen into tiles and the view depth into exponential slices.
+    const float  viewDepth = -(clusterParams.viewMat * float4(fragPos, 1)).z;
+    const uint2  tile      = min(uint2(fragCoord / float2(clusterParams.screenWidth, clusterParams.screenHeight) * float2(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y)), uint2(LIGHT_CLUSTERS_X - 1, LIGHT_CLUSTERS_Y - 1));
+    const float  slice     = log(max(viewDepth, clusterParams.nearPlane) / clusterParams.nearPlane) / log(clusterParams.farPlane / clusterParams.nearPlane) * LIGHT_CLUSTERS_Z;
+    return tile.x + tile.y * LIGHT_CLUSTERS_X + min((uint)slice, LIGHT_CLUSTERS_Z - 1) * LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y;
+}
+
+bool HasTexture(uint type)
+{
+    return (shaderFeatures & (1u << type)) != 0 && materialData.textures[type] != NoTexture;
+}
+
+float4 SampleTexture(uint type, float2 texCoord)
+{
+    // Neighbouring instances of a draw can use different materials, so the index isn't uniform.
+    const uint idx = materialData.textures[type];
+    return bindlessTextures[NonUniformResourceIndex(idx)].Sample(bindlessSamplers[NonUniformResourceIndex(idx)], texCoord);
+}
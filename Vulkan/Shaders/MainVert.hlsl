@@ -16,28 +16,31 @@ struct VSOutput
     [[vk::location(1)]] float2   texCoord  : TEXCOORD;
     [[vk::location(2)]] float3   normal    : NORMAL;
     [[vk::location(3)]] float3x3 tbnMatrix : NORMAL1; // This variable uses 3 locations in total.
+    [[vk::location(6)]] nointerpolation uint materialIndex : MATERIAL;
 };
 
-// Model, view and projection matrices input.
-struct ModelMatrices
-{
-    float4x4 model;
-    float4x4 mvp;
-};
-[[vk::binding(0, 0)]] row_major ConstantBuffer<ModelMatrices> matrices;
+#include "InstanceData.hlsli"
+[[vk::binding(0, 0)]] StructuredBuffer<InstanceData> instances;
+[[vk::binding(1, 0)]] StructuredBuffer<uint>         visibleInstances;
 
-VSOutput main(VSInput input)
+// The instance index includes the draw's first instance, which points to the batch's visible instances.
+VSOutput main(VSInput input, uint instanceIndex : SV_InstanceID)
 {
     VSOutput output = (VSOutput)0;
+    const InstanceData instance = instances[visibleInstances[instanceIndex]];
     
-    output.position = matrices.mvp   * float4(input.position, 1);
-    output.fragPos  = matrices.model * float4(input.position, 1);
+    // The position isn't contracted, so that it matches the depth pre-pass exactly.
+    precise const float4 position = instance.mvp * float4(input.position, 1);
+    output.position = position;
+    output.fragPos  = instance.model * float4(input.position, 1);
     output.texCoord = input.texCoord;
     
-    output.normal    = normalize((matrices.model * float4(input.normal,   0)).xyz);
-    float3 tangent   = normalize((matrices.model * float4(input.tangent,  0)).xyz);
-    float3 binormal  = normalize((matrices.model * float4(input.binormal, 0)).xyz);
+    output.normal    = normalize((instance.model * float4(input.normal,   0)).xyz);
+    float3 tangent   = normalize((instance.model * float4(input.tangent,  0)).xyz);
+    float3 binormal  = normalize((instance.model * float4(input.binormal, 0)).xyz);
     output.tbnMatrix = float3x3(tangent, binormal, output.normal);
     
+    output.materialIndex = instance.materialIndex;
+    
     return output;
 }
@@ -0,0 +1,67 @@
+// Model space control points from the vertex shader.
+struct HSInput
+{
+    [[vk::location(0)]] float3 position : POSITION;
+    [[vk::location(1)]] float2 texCoord : TEXCOORD;
+    [[vk::location(2)]] float3 normal   : NORMAL;
+    [[vk::location(3)]] float3 tangent  : TANGENT;
+    [[vk::location(4)]] float3 binormal : BINORMAL;
+    [[vk::location(5)]] nointerpolation uint instance : INSTANCE;
+};
+typedef HSInput HSOutput;
+
+// Edge and inside tessellation factors of each triangle patch.
+struct HSConstantOutput
+{
+    float edges[3] : SV_TessFactor;
+    float inside   : SV_InsideTessFactor;
+};
+
+#include "InstanceData.hlsli"
+[[vk::binding(0, 0)]] StructuredBuffer<InstanceData> instances;
+
+// Push constants input, placed after the fragment shader's.
+struct PushConstants
+{
+    [[vk::offset(16)]] float2 screenSize;
+    [[vk::offset(24)]] float  targetEdgeLength;
+};
+[[vk::push_constant]] PushConstants pushConstants;
+
+#define MaxTessFactor 64
+
+// Splits each edge so that its segments span about the target length on screen, which also lowers the tessellation of distant patches.
+// Patches that are entirely behind the camera aren't tessellated.
+HSConstantOutput PatchConstants(InputPatch<HSInput, 3> patch)
+{
+    HSConstantOutput output = (HSConstantOutput)0;
+    const float4x4 mvp = instances[patch[0].instance].mvp;
+    
+    // Project the control points to pixels.
+    uint   behindCount = 0;
+    float2 screenPos[3];
+    for (uint i = 0; i < 3; i++) {
+        const float4 clipPos = mvp * float4(patch[i].position, 1);
+        screenPos[i] = clipPos.xy / max(clipPos.w, 1e-4) * 0.5 * pushConstants.screenSize;
+        behindCount += clipPos.w <= 0 ? 1 : 0;
+    }
+    
+    // Edge i is opposite to control point i.
+    for (uint j = 0; j < 3; j++) {
+        const float edgeLength = length(screenPos[(j + 1) % 3] - screenPos[(j + 2) % 3]);
+        output.edges[j] = behindCount == 3 ? 0 : clamp(edgeLength / pushConstants.targetEdgeLength, 1, MaxTessFactor);
+    }
+    output.inside = max(output.edges[0], max(output.edges[1], output.edges[2]));
+    return output;
+}
+
+[domain("tri")]
+[partitioning("fractional_odd")]
+[outputtopology("triangle_ccw")]
+[outputcontrolpoints(3)]
+[patchconstantfunc("PatchConstants")]
+[maxtessfactor(64.0)]
+HSOutput main(InputPatch<HSInput, 3> patch, uint pointID : SV_OutputControlPointID)
+{
+    return patch[pointID];
+}
@@ -0,0 +1,92 @@
+// Texture indices definition.
+#define DepthMapIdx       7
+#define TextureTypesCount 8
+#define NoTexture         0xFFFFFFFF
+
+// Model space control points from the hull shader.
+struct DSInput
+{
+    [[vk::location(0)]] float3 position : POSITION;
+    [[vk::location(1)]] float2 texCoord : TEXCOORD;
+    [[vk::location(2)]] float3 normal   : NORMAL;
+    [[vk::location(3)]] float3 tangent  : TANGENT;
+    [[vk::location(4)]] float3 binormal : BINORMAL;
+    [[vk::location(5)]] nointerpolation uint instance : INSTANCE;
+};
+
+// Edge and inside tessellation factors of each triangle patch.
+struct HSConstantOutput
+{
+    float edges[3] : SV_TessFactor;
+    float inside   : SV_InsideTessFactor;
+};
+
+// Outputs to the fragment shader, laid out like the main vertex shader's.
+struct DSOutput
+{
+    float4 position : SV_POSITION;
+    [[vk::location(0)]] float3   fragPos   : POSITION;
+    [[vk::location(1)]] float2   texCoord  : TEXCOORD;
+    [[vk::location(2)]] float3   normal    : NORMAL;
+    [[vk::location(3)]] float3x3 tbnMatrix : NORMAL1; // This variable uses 3 locations in total.
+    [[vk::location(6)]] nointerpolation uint materialIndex : MATERIAL;
+};
+
+#include "InstanceData.hlsli"
+[[vk::binding(0, 0)]] StructuredBuffer<InstanceData> instances;
+
+// Material data of every material and bindless textures inputs.
+struct MaterialData
+{
+    float3 albedo;
+    float3 emissive;
+    float  metallic;
+    float  roughness;
+    float  alpha;
+    float  depthMultiplier;
+    uint   depthLayerCount;
+    uint   textures[TextureTypesCount];
+    float  parallaxLodDistance;
+    float  normalLodDistance;
+    float  detailLodDistance;
+    float  alphaCutoff;
+};
+[[vk::binding(0, 2)]] StructuredBuffer<MaterialData> materials;
+[[vk::binding(1, 2)]] Texture2D    bindlessTextures[MAX_BINDLESS_TEXTURES];
+[[vk::binding(1, 2)]] SamplerState bindlessSamplers[MAX_BINDLESS_TEXTURES];
+
+// Interpolates the control points and pushes the surface in along its normal by the depth map, the way parallax mapping offsets it.
+// The surface never rises above its mesh, so the instance's bounding sphere still contains it.
+[domain("tri")]
+DSOutput main(HSConstantOutput patchConstants, float3 barycentrics : SV_DomainLocation, OutputPatch<DSInput, 3> patch)
+{
+    DSOutput output = (DSOutput)0;
+    const InstanceData instance = instances[patch[0].instance];
+    const MaterialData material = materials[instance.materialIndex];
+    
+    float3 position = barycentrics.x * patch[0].position + barycentrics.y * patch[1].position + barycentrics.z * patch[2].position;
+    float2 texCoord = barycentrics.x * patch[0].texCoord + barycentrics.y * patch[1].texCoord + barycentrics.z * patch[2].texCoord;
+    float3 normal   = normalize(barycentrics.x * patch[0].normal   + barycentrics.y * patch[1].normal   + barycentrics.z * patch[2].normal);
+    float3 tangent  = barycentrics.x * patch[0].tangent  + barycentrics.y * patch[1].tangent  + barycentrics.z * patch[2].tangent;
+    float3 binormal = barycentrics.x * patch[0].binormal + barycentrics.y * patch[1].binormal + barycentrics.z * patch[2].binormal;
+    
+    // The evaluation stage has no derivatives, so the depth map's top mip is sampled.
+    const uint depthMap = material.textures[DepthMapIdx];
+    if (depthMap != NoTexture) {
+        const float depth = 1 - bindlessTextures[NonUniformResourceIndex(depthMap)].SampleLevel(bindlessSamplers[NonUniformResourceIndex(depthMap)], texCoord, 0).r;
+        position -= normal * depth * material.depthMultiplier;
+    }
+    
+    output.position = instance.mvp   * float4(position, 1);
+    output.fragPos  = (instance.model * float4(position, 1)).xyz;
+    output.texCoord = texCoord;
+    
+    output.normal    = normalize((instance.model * float4(normal,   0)).xyz);
+    tangent          = normalize((instance.model * float4(tangent,  0)).xyz);
+    binormal         = normalize((instance.model * float4(binormal, 0)).xyz);
+    output.tbnMatrix = float3x3(tangent, binormal, output.normal);
+    
+    output.materialIndex = instance.materialIndex;
+    
+    return output;
+}
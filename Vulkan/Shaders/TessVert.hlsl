@@ -0,0 +1,35 @@
+// Vertex data inputs.
+struct VSInput
+{
+    [[vk::location(0)]] float3 position : POSITION;
+    [[vk::location(1)]] float2 texCoord : TEXCOORD;
+    [[vk::location(2)]] float3 normal   : NORMAL;
+    [[vk::location(3)]] float3 tangent  : TANGENT;
+    [[vk::location(4)]] float3 binormal : BINORMAL;
+};
+
+// Model space control points, transformed once they are displaced by the evaluation shader.
+struct VSOutput
+{
+    [[vk::location(0)]] float3 position : POSITION;
+    [[vk::location(1)]] float2 texCoord : TEXCOORD;
+    [[vk::location(2)]] float3 normal   : NORMAL;
+    [[vk::location(3)]] float3 tangent  : TANGENT;
+    [[vk::location(4)]] float3 binormal : BINORMAL;
+    [[vk::location(5)]] nointerpolation uint instance : INSTANCE;
+};
+
+[[vk::binding(1, 0)]] StructuredBuffer<uint> visibleInstances;
+
+// The instance index includes the draw's first instance, which points to the batch's visible instances.
+VSOutput main(VSInput input, uint instanceIndex : SV_InstanceID)
+{
+    VSOutput output = (VSOutput)0;
+    output.position = input.position;
+    output.texCoord = input.texCoord;
+    output.normal   = input.normal;
+    output.tangent  = input.tangent;
+    output.binormal = input.binormal;
+    output.instance = visibleInstances[instanceIndex];
+    return output;
+}
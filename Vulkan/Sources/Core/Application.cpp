@@ -56,6 +56,7 @@ void Application::Run() const
         renderer->BeginRender();
         {
             engine->Render(renderer);
+            renderer->DrawRenderQueue();
             ui->Render();
         }
         renderer->EndRender();
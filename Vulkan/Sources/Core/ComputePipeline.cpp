@@ -0,0 +1,154 @@
+#include "Core/ComputePipeline.h"
+#include "Core/Renderer.h"
+#include "Core/Logger.h"
+#include <vulkan/vulkan.h>
+#include <unordered_map>
+using namespace Core;
+using namespace GraphicsUtils;
+
+ComputePipeline::ComputePipeline(const Renderer* renderer, const ComputePipelineDesc& desc)
+    : vkDevice(renderer->GetVkDevice()), bindingTypes(desc.bindings), pushConstantSize(desc.pushConstantSize)
+{
+    // Create the layout, pool and sets of the pipeline's own descriptor sets.
+    if (!desc.bindings.empty() && desc.setCount > 0)
+    {
+        std::vector<VkDescriptorSetLayoutBinding> layoutBindings(desc.bindings.size());
+        std::unordered_map<VkDescriptorType, uint32_t> typeCounts;
+        for (uint32_t i = 0; i < (uint32_t)desc.bindings.size(); i++) {
+            layoutBindings[i].binding         = i;
+            layoutBindings[i].descriptorType  = desc.bindings[i];
+            layoutBindings[i].descriptorCount = desc.bindingCounts.empty() ? 1 : desc.bindingCounts[i];
+            layoutBindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+            typeCounts[desc.bindings[i]] += layoutBindings[i].descriptorCount * desc.setCount;
+        }
+
+        // Create the descriptor set layout.
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = (uint32_t)layoutBindings.size();
+        layoutInfo.pBindings    = layoutBindings.data();
+        if (vkCreateDescriptorSetLayout(vkDevice, &layoutInfo, nullptr, &vkDescriptorSetLayout) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
+        }
+
+        // Create the descriptor pool, with enough descriptors of each type for all the sets.
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        for (const auto& [type, count] : typeCounts)
+            poolSizes.push_back({ type, count });
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
+        poolInfo.pPoolSizes    = poolSizes.data();
+        poolInfo.maxSets       = desc.setCount;
+        if (vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &vkDescriptorPool) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to create descriptor pool.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_POOL_ERROR");
+        }
+
+        // Allocate the descriptor sets.
+        const std::vector<VkDescriptorSetLayout> setLayouts(desc.setCount, vkDescriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool     = vkDescriptorPool;
+        allocInfo.descriptorSetCount = desc.setCount;
+        allocInfo.pSetLayouts        = setLayouts.data();
+        vkDescriptorSets.resize(desc.setCount);
+        if (vkAllocateDescriptorSets(vkDevice, &allocInfo, vkDescriptorSets.data()) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to allocate descriptor sets.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_SET_ALLOCATION_ERROR");
+        }
+    }
+
+    // Create the pipeline layout, with the pipeline's own set first and the shared sets after it.
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    if (vkDescriptorSetLayout) setLayouts.push_back(vkDescriptorSetLayout);
+    setLayouts.insert(setLayouts.end(), desc.sharedSetLayouts.begin(), desc.sharedSetLayouts.end());
+    const VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize };
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount         = (uint32_t)setLayouts.size();
+    pipelineLayoutInfo.pSetLayouts            = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges    = &pushConstantRange;
+    if (vkCreatePipelineLayout(vkDevice, &pipelineLayoutInfo, nullptr, &vkPipelineLayout) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, std::string("Failed to create compute pipeline layout for ") + desc.filename + ".");
+        throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+    }
+
+    // Create the compute pipeline.
+    const VkShaderModule shaderModule = CreateShaderModule(vkDevice, ShaderStage::Compute, desc.filename, desc.defines);
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName  = "main";
+    pipelineInfo.layout       = vkPipelineLayout;
+    if (vkCreateComputePipelines(vkDevice, renderer->GetVkPipelineCache(), 1, &pipelineInfo, nullptr, &vkPipeline) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, std::string("Failed to create compute pipeline for ") + desc.filename + ".");
+        throw std::runtime_error("VULKAN_PIPELINE_ERROR");
+    }
+    vkDestroyShaderModule(vkDevice, shaderModule, nullptr);
+}
+
+ComputePipeline::~ComputePipeline()
+{
+    vkDestroyPipeline      (vkDevice, vkPipeline,       nullptr);
+    vkDestroyPipelineLayout(vkDevice, vkPipelineLayout, nullptr);
+    if (vkDescriptorPool)      vkDestroyDescriptorPool     (vkDevice, vkDescriptorPool,      nullptr);
+    if (vkDescriptorSetLayout) vkDestroyDescriptorSetLayout(vkDevice, vkDescriptorSetLayout, nullptr);
+}
+
+void ComputePipeline::WriteBuffer(const uint32_t& set, const uint32_t& binding, const VkBuffer& buffer, const VkDeviceSize& offset, const VkDeviceSize& range) const
+{
+    const VkDescriptorBufferInfo bufferInfo = { buffer, offset, range };
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet          = vkDescriptorSets[set];
+    descriptorWrite.dstBinding      = binding;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType  = bindingTypes[binding];
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo     = &bufferInfo;
+    vkUpdateDescriptorSets(vkDevice, 1, &descriptorWrite, 0, nullptr);
+}
+
+void ComputePipeline::WriteImages(const uint32_t& set, const uint32_t& binding, const std::vector<VkImageView>& imageViews, const VkImageLayout& imageLayout) const
+{
+    std::vector<VkDescriptorImageInfo> imageInfos(imageViews.size());
+    for (size_t i = 0; i < imageViews.size(); i++)
+        imageInfos[i] = { nullptr, imageViews[i], imageLayout };
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet          = vkDescriptorSets[set];
+    descriptorWrite.dstBinding      = binding;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType  = bindingTypes[binding];
+    descriptorWrite.descriptorCount = (uint32_t)imageInfos.size();
+    descriptorWrite.pImageInfo      = imageInfos.data();
+    vkUpdateDescriptorSets(vkDevice, 1, &descriptorWrite, 0, nullptr);
+}
+
+void ComputePipeline::Bind(const VkCommandBuffer& commandBuffer, const uint32_t& set, const std::vector<VkDescriptorSet>& sharedSets, const std::vector<uint32_t>& dynamicOffsets) const
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkPipeline);
+
+    // Bind the own set and the shared sets at once.
+    std::vector<VkDescriptorSet> descriptorSets;
+    if (!vkDescriptorSets.empty()) descriptorSets.push_back(vkDescriptorSets[set]);
+    descriptorSets.insert(descriptorSets.end(), sharedSets.begin(), sharedSets.end());
+    if (descriptorSets.empty()) return;
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkPipelineLayout, 0, (uint32_t)descriptorSets.size(), descriptorSets.data(),
+                            (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+}
+
+void ComputePipeline::PushConstants(const VkCommandBuffer& commandBuffer, const void* data) const
+{
+    vkCmdPushConstants(commandBuffer, vkPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize, data);
+}
+
+void ComputePipeline::Dispatch(const VkCommandBuffer& commandBuffer, const uint32_t& groupCountX, const uint32_t& groupCountY, const uint32_t& groupCountZ) const
+{
+    vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+}
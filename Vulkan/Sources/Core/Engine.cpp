@@ -3,6 +3,7 @@
 #include "Core/Window.h"
 #include "Core/Logger.h"
 #include "Core/Renderer.h"
+#include "Core/LightCuller.h"
 #include "Core/UserInterface.h"
 #include "Maths/MathConstants.h"
 #include "Maths/AngleAxis.h"
@@ -14,6 +15,7 @@
 #include "Resources/Light.h"
 #include <filesystem>
 #include <cstdarg>
+#include <random>
 namespace fs = std::filesystem;
 using namespace Core;
 using namespace Resources;
@@ -84,9 +86,9 @@ void Engine::Update(const float& deltaTime)
     // models.at("model_Cube").transform.SetPosition(Vector3(-cos(time)*2, -1, -sin(time)*2));
     time += deltaTime;
     
-    // Update camera transform.
+    // Update camera transform, it stays still during the transparency benchmark so that both methods draw the same view.
     const WindowInputs inputs = app->GetWindow()->GetInputs();
-    if (inputs.mouseRightClick)
+    if (inputs.mouseRightClick && !app->GetRenderer()->IsTransparencyBenchmarkRunning())
     {
         camera->transform.Move(camera->transform.GetRotation().RotateVec(inputs.dirMovement * cameraSpeed * deltaTime));
         camera->transform.Rotate(Quaternion::FromAngleAxis({ -inputs.mouseDelta.y * cameraSensitivity, camera->transform.Right() }));
@@ -94,16 +96,72 @@ void Engine::Update(const float& deltaTime)
     }
 }
 
-void Engine::Render(Renderer* renderer) const
+void Engine::Render(Renderer* renderer)
 {
-    // Set the viewPos constant in the fragment shader.
+    // Set the viewPos and shading LOD constants in the fragment shader.
     const Vector3 viewPos = camera->transform.GetPosition();
-    renderer->SetShaderFrameConstants<GraphicsUtils::ShaderStage::Fragment>({ viewPos });
+    renderer->SetShaderFrameConstants<GraphicsUtils::ShaderStage::Fragment>({ viewPos, renderer->GetShadingLodScale() });
     Light::UpdateBufferData(lights);
+    renderer->GetLightCuller()->SetView(*camera);
+
+    // Get the world space bounding sphere of each loaded model.
+    const Mat4 viewProjMat = camera->GetViewMat() * camera->GetProjMat();
+    frustumCuller.Update(viewProjMat);
+    cullModels.clear();
+    cullSpheres.clear();
+    for (const auto& [name, model] : models) {
+        cullModels .push_back(&model);
+        cullSpheres.push_back(FrustumCuller::TransformSphere(model.GetBoundsCenter(), model.GetBoundsRadius(), model.transform.GetLocalMat()));
+    }
+    cullVisibility.assign(cullModels.size(), 1);
+    if (frustumCullingEnabled)
+        frustumCuller.Cull(cullSpheres.data(), cullSpheres.size(), cullVisibility.data(), renderer->GetWorkerPool());
+
+    // Get the world space bounding sphere of each mesh of the visible models.
+    cullMeshes.clear();
+    cullMeshModels.clear();
+    cullSpheres.clear();
+    for (uint32_t i = 0; i < (uint32_t)cullModels.size(); i++)
+    {
+        if (!cullVisibility[i]) continue;
+        for (const Mesh& mesh : cullModels[i]->GetMeshes()) {
+            cullMeshes    .push_back(&mesh);
+            cullMeshModels.push_back(i);
+            cullSpheres   .push_back(FrustumCuller::TransformSphere(mesh.GetBoundsCenter(), mesh.GetBoundsRadius(), cullModels[i]->transform.GetLocalMat()));
+        }
+    }
+    cullVisibility.assign(cullMeshes.size(), 1);
+    if (frustumCullingEnabled)
+        frustumCuller.Cull(cullSpheres.data(), cullSpheres.size(), cullVisibility.data(), renderer->GetWorkerPool());
+
+    // Draw the visible meshes, computing the matrices once per model.
+    uint32_t matricesModel = UINT32_MAX;
+    MvpBuffer matrices;
+    for (size_t i = 0; i < cullMeshes.size(); i++)
+    {
+        if (!cullVisibility[i]) continue;
+        if (cullMeshModels[i] != matricesModel) {
+            matricesModel = cullMeshModels[i];
+            const Mat4 localMat = cullModels[matricesModel]->transform.GetLocalMat();
+            matrices = { localMat, localMat * viewProjMat };
+        }
+        renderer->DrawMesh(*cullMeshes[i], matrices);
+    }
+}
+
+void Engine::BenchmarkFrustumCulling() const
+{
+    FrustumCuller::Benchmark(camera->GetViewMat() * camera->GetProjMat(), app->GetRenderer()->GetWorkerPool());
+}
 
-    // Draw all loaded models.
-    for (const auto& [name, model] : models)
-        renderer->DrawModel(model, *camera);
+void Engine::ScatterLights(const size_t& count)
+{
+    // Use a fixed seed so that measurements are comparable between runs.
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> position(-15, 15), height(-1.8f, 0), color(0.2f, 1);
+    lights.resize(std::min(lights.size(), (size_t)1));
+    while (lights.size() < std::min(count, MAX_LIGHTS))
+        lights.push_back(Light::Point(Vector3(position(generator), height(generator), position(generator)), RGBA(color(generator), color(generator), color(generator), 2), 1.5f, 4));
 }
 
 void Engine::LoadFile(const std::string& filename, int additionalParamsCount, ...)
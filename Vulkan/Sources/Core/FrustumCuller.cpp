@@ -0,0 +1,155 @@
+#include "Core/FrustumCuller.h"
+#include "Core/Logger.h"
+#include "Core/WorkerPool.h"
+#include "Maths/Vector4.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <random>
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define FRUSTUM_CULLER_SSE
+#include <xmmintrin.h>
+#endif
+using namespace Core;
+using namespace Maths;
+
+// Spheres are loaded as 4 floats, with the radius after the center.
+static_assert(sizeof(BoundingSphere) == 4 * sizeof(float), "BoundingSphere must be tightly packed.");
+
+void FrustumCuller::Update(const Mat4& viewProjMat)
+{
+    // Points are row vectors, so each clip space coordinate is a column of the matrix.
+    // The planes are left, right, bottom, top, near and far, with depth in [0, w].
+    const float signs  [PLANE_COUNT] = { 1, -1, 1, -1, 1, -1 };
+    const int   columns[PLANE_COUNT] = { 0,  0, 1,  1, 2,  2 };
+    for (size_t i = 0; i < PLANE_COUNT; i++)
+    {
+        float plane[4];
+        for (int j = 0; j < 4; j++)
+            plane[j] = viewProjMat[j][columns[i]] * signs[i] + (i == 4 ? 0 : viewProjMat[j][3]);
+
+        // Normalize the plane so that its equation gives distances.
+        const float invLength = 1 / sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        for (int j = 0; j < 4; j++)
+            planes[j][i] = plane[j] * invLength;
+    }
+}
+
+bool FrustumCuller::IsVisible(const BoundingSphere& sphere) const
+{
+    for (size_t i = 0; i < PLANE_COUNT; i++)
+    {
+        const float dist = planes[0][i] * sphere.center.x + planes[1][i] * sphere.center.y + planes[2][i] * sphere.center.z + planes[3][i];
+        if (dist < -sphere.radius)
+            return false;
+    }
+    return true;
+}
+
+size_t FrustumCuller::Cull(const BoundingSphere* spheres, const size_t& count, uint8_t* visibility, WorkerPool* workers) const
+{
+    const size_t workerCount = workers ? std::min((size_t)workers->GetThreadCount() + 1, count / BATCH_SIZE) : 1;
+    if (workerCount <= 1)
+        return CullBatch(spheres, count, visibility);
+
+    // Split the spheres into one batch per worker, the calling thread culls the first one.
+    const size_t batchSize = (count / workerCount + 3) & ~(size_t)3;
+    std::vector<std::future<size_t>> batches;
+    batches.reserve(workerCount - 1);
+    for (size_t first = batchSize; first < count; first += batchSize)
+    {
+        const size_t batchCount = std::min(batchSize, count - first);
+        batches.push_back(workers->Submit([this, spheres, visibility, first, batchCount] {
+            return CullBatch(spheres + first, batchCount, visibility + first);
+        }));
+    }
+    size_t visibleCount = CullBatch(spheres, std::min(batchSize, count), visibility);
+    for (std::future<size_t>& batch : batches)
+        visibleCount += batch.get();
+    return visibleCount;
+}
+
+size_t FrustumCuller::CullBatch(const BoundingSphere* spheres, const size_t& count, uint8_t* visibility) const
+{
+    size_t visibleCount = 0;
+    size_t i = 0;
+
+#ifdef FRUSTUM_CULLER_SSE
+    // Transpose 4 spheres at a time and test them against each plane at once.
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&spheres[i + 0].center.x);
+        __m128 y = _mm_loadu_ps(&spheres[i + 1].center.x);
+        __m128 z = _mm_loadu_ps(&spheres[i + 2].center.x);
+        __m128 r = _mm_loadu_ps(&spheres[i + 3].center.x);
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+        const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), r);
+
+        __m128 outside = _mm_setzero_ps();
+        for (size_t j = 0; j < PLANE_COUNT; j++)
+        {
+            __m128 dist = _mm_set1_ps(planes[3][j]);
+            dist = _mm_add_ps(dist, _mm_mul_ps(x, _mm_set1_ps(planes[0][j])));
+            dist = _mm_add_ps(dist, _mm_mul_ps(y, _mm_set1_ps(planes[1][j])));
+            dist = _mm_add_ps(dist, _mm_mul_ps(z, _mm_set1_ps(planes[2][j])));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negRadius));
+        }
+
+        const int outsideMask = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; k++) {
+            visibility[i + k] = (outsideMask >> k & 1) ? 0 : 1;
+            visibleCount     += visibility[i + k];
+        }
+    }
+#endif
+
+    // Test the remaining spheres one by one.
+    for (; i < count; i++) {
+        visibility[i] = IsVisible(spheres[i]) ? 1 : 0;
+        visibleCount += visibility[i];
+    }
+    return visibleCount;
+}
+
+BoundingSphere FrustumCuller::TransformSphere(const Vector3& center, const float& radius, const Mat4& localMat)
+{
+    // Scale the radius by the largest axis scale so the sphere still encloses the object.
+    const Vector4 worldCenter = localMat * Vector4(center, 1);
+    float maxScaleSq = 0;
+    for (int i = 0; i < 3; i++)
+        maxScaleSq = std::max(maxScaleSq, localMat[i][0] * localMat[i][0] + localMat[i][1] * localMat[i][1] + localMat[i][2] * localMat[i][2]);
+    return { worldCenter.ToVector3(), radius * sqrtf(maxScaleSq) };
+}
+
+void FrustumCuller::Benchmark(const Mat4& viewProjMat, WorkerPool* workers, const size_t& count)
+{
+    FrustumCuller culler;
+    culler.Update(viewProjMat);
+
+    // Scatter spheres in a cube around the origin so that part of them are culled.
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> position(-100, 100), radius(0.1f, 2);
+    std::vector<BoundingSphere> spheres(count);
+    for (BoundingSphere& sphere : spheres)
+        sphere = { { position(generator), position(generator), position(generator) }, radius(generator) };
+    std::vector<uint8_t> visibility(count);
+
+    // Time each path.
+    using Clock = std::chrono::high_resolution_clock;
+    size_t visibleCount = 0;
+    const auto scalarStart = Clock::now();
+    for (size_t i = 0; i < count; i++)
+        visibleCount += culler.IsVisible(spheres[i]) ? 1 : 0;
+    const auto simdStart = Clock::now();
+    culler.CullBatch(spheres.data(), count, visibility.data());
+    const auto parallelStart = Clock::now();
+    culler.Cull(spheres.data(), count, visibility.data(), workers);
+    const auto end = Clock::now();
+
+    const std::chrono::duration<float, std::milli> scalarTime = simdStart - scalarStart, simdTime = parallelStart - simdStart, parallelTime = end - parallelStart;
+    LogInfo(LogType::Default, "Culled " + std::to_string(count) + " spheres, " + std::to_string(visibleCount) + " visible. "
+                            + "Scalar: "        + std::to_string(scalarTime  .count()) + "ms | "
+                            + "SIMD: "          + std::to_string(simdTime    .count()) + "ms | "
+                            + "Parallel SIMD: " + std::to_string(parallelTime.count()) + "ms");
+}
@@ -0,0 +1,154 @@
+#include "Core/GeometryDefragmenter.h"
+#include "Core/Renderer.h"
+#include "Core/Engine.h"
+#include "Resources/Mesh.h"
+#include <vulkan/vulkan.h>
+#include <algorithm>
+using namespace Core;
+using namespace Resources;
+
+static constexpr VkDeviceSize POSITION_SIZE  = sizeof(Maths::Vector3);
+static constexpr VkDeviceSize ATTRIBUTE_SIZE = sizeof(Maths::VertexAttributes);
+static constexpr VkDeviceSize INDEX_SIZE     = sizeof(uint32_t);
+
+void GeometryDefragmenter::Update(const VkCommandBuffer& commandBuffer)
+{
+    GpuArray<Mesh>& meshesArray = gpuData->meshesArray;
+    stats.movedMeshes      = 0;
+    stats.migratedMeshes   = 0;
+    stats.copiedBytes      = 0;
+    stats.freeVertexRanges = (uint32_t)meshesArray.freeVertexRanges.size();
+    stats.freeIndexRanges  = (uint32_t)meshesArray.freeIndexRanges .size();
+    if (!enabled || maxMovesPerFrame == 0 || !gpuData->CheckArray<Mesh>()) return;
+
+    // Gather the meshes above the first hole of a fragmented buffer, and the ones in dedicated buffers.
+    const bool vertexFragmented = IsFragmented(meshesArray.freeVertexRanges, (uint32_t)Engine::MAX_VERTICES);
+    const bool indexFragmented  = IsFragmented(meshesArray.freeIndexRanges,  (uint32_t)Engine::MAX_INDICES);
+    std::vector<GpuData<Mesh>*> candidates;
+    gpuData->meshes.ForEach([&](const GpuHandle<Mesh>&, GpuData<Mesh>& data)
+    {
+        if (!data.resident) return;
+        if (!data.IsShared()
+        ||  (vertexFragmented && data.vertexRange.offset > meshesArray.freeVertexRanges.front().offset)
+        ||  (indexFragmented  && data.indexRange .offset > meshesArray.freeIndexRanges .front().offset))
+            candidates.push_back(&data);
+    });
+    if (candidates.empty()) return;
+
+    // Move dedicated meshes first to give their allocations back, then the shared meshes furthest from the start of the buffers.
+    std::sort(candidates.begin(), candidates.end(), [](const GpuData<Mesh>* a, const GpuData<Mesh>* b)
+    {
+        if (a->IsShared() != b->IsShared()) return !a->IsShared();
+        return std::max(a->vertexRange.offset, a->indexRange.offset) > std::max(b->vertexRange.offset, b->indexRange.offset);
+    });
+
+    // Make the previous writes to the geometry buffers visible to the copies, the ranges copied to are free so nothing reads them.
+    VkMemoryBarrier barrier{};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    const VkBuffer     vertexBuffers[2] = { meshesArray.vkPositionBuffer, meshesArray.vkAttributeBuffer };
+    const VkDeviceSize vertexSizes  [2] = { POSITION_SIZE, ATTRIBUTE_SIZE };
+    for (GpuData<Mesh>* data : candidates)
+    {
+        if (stats.movedMeshes + stats.migratedMeshes >= maxMovesPerFrame) break;
+        if (!data->IsShared()) {
+            if (MigrateMesh(commandBuffer, *data)) stats.migratedMeshes++;
+            continue;
+        }
+        const bool verticesMoved = vertexFragmented && MoveRange(commandBuffer, meshesArray.freeVertexRanges, data->vertexRange, vertexBuffers, vertexSizes, 2);
+        const bool indicesMoved  = indexFragmented  && MoveRange(commandBuffer, meshesArray.freeIndexRanges,  data->indexRange,  &meshesArray.vkIndexBuffer, &INDEX_SIZE, 1);
+        if (verticesMoved || indicesMoved) stats.movedMeshes++;
+    }
+    stats.freeVertexRanges = (uint32_t)meshesArray.freeVertexRanges.size();
+    stats.freeIndexRanges  = (uint32_t)meshesArray.freeIndexRanges .size();
+    if (stats.copiedBytes == 0) return;
+
+    // Make the copies visible to the draws, which read the meshes' new ranges from this frame on.
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+bool GeometryDefragmenter::IsFragmented(const std::vector<GpuRange>& freeRanges, const uint32_t& capacity)
+{
+    // A compact buffer has a single hole at its end, or none when it is full.
+    if (freeRanges.empty()) return false;
+    return freeRanges.size() > 1 || freeRanges.front().offset + freeRanges.front().count != capacity;
+}
+
+bool GeometryDefragmenter::MoveRange(const VkCommandBuffer& commandBuffer, std::vector<GpuRange>& freeRanges, GpuRange& range,
+                                     const VkBuffer* buffers, const VkDeviceSize* elementSizes, const uint32_t& bufferCount)
+{
+    // First-fit allocation returns the lowest free range large enough, give it back if it isn't below the current one.
+    uint32_t newOffset;
+    if (range.count == 0 || !GpuDataManager::AllocateRange(freeRanges, range.count, newOffset)) return false;
+    if (newOffset > range.offset) {
+        GpuDataManager::FreeRange(freeRanges, { newOffset, range.count });
+        return false;
+    }
+
+    // Copy the elements within each buffer, the new range being free it can't overlap the current one.
+    for (uint32_t i = 0; i < bufferCount; i++)
+    {
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = elementSizes[i] * range.offset;
+        copyRegion.dstOffset = elementSizes[i] * newOffset;
+        copyRegion.size      = elementSizes[i] * range.count;
+        vkCmdCopyBuffer(commandBuffer, buffers[i], buffers[i], 1, &copyRegion);
+        stats.copiedBytes += copyRegion.size;
+        stats.freedRanges++;
+        stats.freedBytes  += copyRegion.size;
+    }
+
+    // The frames in flight still draw from the old range, so it is only freed once they are done.
+    const GpuRange oldRange = range;
+    gpuData->DeferDeletion([&freeRanges, oldRange]{ GpuDataManager::FreeRange(freeRanges, oldRange); });
+    range.offset = newOffset;
+    return true;
+}
+
+bool GeometryDefragmenter::MigrateMesh(const VkCommandBuffer& commandBuffer, GpuData<Mesh>& data)
+{
+    GpuArray<Mesh>& meshesArray = gpuData->meshesArray;
+    GpuRange vertexRange = { 0, data.vertexRange.count };
+    GpuRange indexRange  = { 0, data.indexRange .count };
+    if (!GpuDataManager::AllocateRange(meshesArray.freeVertexRanges, vertexRange.count, vertexRange.offset)) return false;
+    if (!GpuDataManager::AllocateRange(meshesArray.freeIndexRanges,  indexRange .count, indexRange .offset)) {
+        GpuDataManager::FreeRange(meshesArray.freeVertexRanges, vertexRange);
+        return false;
+    }
+
+    // Copy the dedicated buffers to the shared ranges.
+    const VkBuffer     srcBuffers  [3] = { data.vkPositionBuffer,        data.vkAttributeBuffer,        data.vkIndexBuffer        };
+    const VkBuffer     dstBuffers  [3] = { meshesArray.vkPositionBuffer, meshesArray.vkAttributeBuffer, meshesArray.vkIndexBuffer };
+    const VkDeviceSize dstOffsets  [3] = { POSITION_SIZE  * vertexRange.offset, ATTRIBUTE_SIZE * vertexRange.offset, INDEX_SIZE * indexRange.offset };
+    const VkDeviceSize copySizes   [3] = { POSITION_SIZE  * vertexRange.count,  ATTRIBUTE_SIZE * vertexRange.count,  INDEX_SIZE * indexRange.count  };
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        if (copySizes[i] == 0) continue;
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = 0;
+        copyRegion.dstOffset = dstOffsets[i];
+        copyRegion.size      = copySizes[i];
+        vkCmdCopyBuffer(commandBuffer, srcBuffers[i], dstBuffers[i], 1, &copyRegion);
+        stats.copiedBytes += copyRegion.size;
+    }
+
+    // Destroy the dedicated buffers once the frames in flight are done with them, and count the space used by the ranges instead.
+    stats.freedBytes += data.vkMemorySize;
+    gpuData->ReleaseMeshData(data);
+    data.vkPositionBuffer        = meshesArray.vkPositionBuffer;
+    data.vkAttributeBuffer       = meshesArray.vkAttributeBuffer;
+    data.vkIndexBuffer           = meshesArray.vkIndexBuffer;
+    data.vkPositionBufferMemory  = nullptr;
+    data.vkAttributeBufferMemory = nullptr;
+    data.vkIndexBufferMemory     = nullptr;
+    data.vertexRange             = vertexRange;
+    data.indexRange              = indexRange;
+    data.vkMemorySize            = copySizes[0] + copySizes[1] + copySizes[2];
+    meshesArray.usedBytes       += data.vkMemorySize;
+    return true;
+}
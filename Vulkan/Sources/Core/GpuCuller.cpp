@@ -0,0 +1,109 @@
+#include "Core/GpuCuller.h"
+#include "Core/ComputePipeline.h"
+#include "Core/GpuDataManager.h"
+#include "Core/Renderer.h"
+#include "Core/Engine.h"
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <cstring>
+using namespace Core;
+using namespace GraphicsUtils;
+
+// Keeps each frame's region of the instance buffers aligned to the largest storage buffer offset alignment allowed by the specification.
+static_assert(Engine::MAX_INSTANCES % 64 == 0, "Engine::MAX_INSTANCES must be a multiple of 64.");
+
+GpuCuller::GpuCuller(Renderer* _renderer, GpuDataManager* _gpuData)
+    : renderer(_renderer), gpuData(_gpuData)
+{
+    const VkDevice         vkDevice         = renderer->GetVkDevice();
+    const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
+    const GpuArray<Resources::Model>& modelArray = gpuData->GetArray<Resources::Model>();
+    constexpr uint32_t bindingCount = 5;
+
+    // Create the compute pipeline, with one set per frame that binds the instance matrices, cull instances, draw commands, visible instances and counter buffers.
+    // The number of instances to cull is written to the counters buffer rather than pushed, so that the graphics push constants are left untouched.
+    ComputePipelineDesc desc{ "Shaders/CullInstances.hlsl" };
+    desc.bindings = std::vector<VkDescriptorType>(bindingCount, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    desc.setCount = MAX_FRAMES_IN_FLIGHT;
+    pipeline = new ComputePipeline(renderer, desc);
+
+    // Create the cull instances buffer and keep it mapped.
+    const VkDeviceSize instanceFrameSize = sizeof(CullInstance) * modelArray.capacity;
+    CreateBuffer(vkDevice, vkPhysicalDevice, instanceFrameSize * MAX_FRAMES_IN_FLIGHT,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 vkInstanceBuffer, vkInstanceBufferMemory);
+    vkMapMemory(vkDevice, vkInstanceBufferMemory, 0, instanceFrameSize * MAX_FRAMES_IN_FLIGHT, 0, &vkInstanceBufferMapped);
+
+    // Create the counters buffer with one aligned pair of counters per frame and keep it mapped.
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(vkPhysicalDevice, &deviceProperties);
+    vkCounterStride = std::max((VkDeviceSize)sizeof(uint32_t) * 2, deviceProperties.limits.minStorageBufferOffsetAlignment);
+    CreateBuffer(vkDevice, vkPhysicalDevice, vkCounterStride * MAX_FRAMES_IN_FLIGHT,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 vkCounterBuffer, vkCounterBufferMemory);
+    vkMapMemory(vkDevice, vkCounterBufferMemory, 0, vkCounterStride * MAX_FRAMES_IN_FLIGHT, 0, &vkCounterBufferMapped);
+    memset(vkCounterBufferMapped, 0, vkCounterStride * MAX_FRAMES_IN_FLIGHT);
+    vkMemorySize = GetBufferMemorySize(vkDevice, vkInstanceBuffer) + GetBufferMemorySize(vkDevice, vkCounterBuffer);
+    gpuData->TrackMemory(GpuMemoryCategory::Models, vkMemorySize, 2);
+
+    // Point each frame's descriptors to the frame's regions.
+    for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+    {
+        const VkDeviceSize commandsFrameSize = sizeof(VkDrawIndexedIndirectCommand) * modelArray.capacity;
+        const VkDeviceSize visibleFrameSize  = sizeof(uint32_t) * modelArray.capacity;
+        const VkDescriptorBufferInfo bufferInfos[bindingCount] = {
+            { modelArray.vkBuffer,        modelArray.vkFrameSize * frame, modelArray.vkFrameSize },
+            { vkInstanceBuffer,           instanceFrameSize      * frame, instanceFrameSize      },
+            { modelArray.vkDrawBuffer,    commandsFrameSize      * frame, commandsFrameSize      },
+            { modelArray.vkVisibleBuffer, visibleFrameSize       * frame, visibleFrameSize       },
+            { vkCounterBuffer,            vkCounterStride        * frame, sizeof(uint32_t) * 2   },
+        };
+        for (uint32_t i = 0; i < bindingCount; i++)
+            pipeline->WriteBuffer(frame, i, bufferInfos[i].buffer, bufferInfos[i].offset, bufferInfos[i].range);
+    }
+}
+
+GpuCuller::~GpuCuller()
+{
+    const VkDevice vkDevice = renderer->GetVkDevice();
+    vkDestroyBuffer(vkDevice, vkCounterBuffer,        nullptr);
+    vkFreeMemory   (vkDevice, vkCounterBufferMemory,  nullptr);
+    vkDestroyBuffer(vkDevice, vkInstanceBuffer,       nullptr);
+    vkFreeMemory   (vkDevice, vkInstanceBufferMemory, nullptr);
+    delete pipeline;
+    gpuData->UntrackMemory(GpuMemoryCategory::Models, vkMemorySize, 2);
+}
+
+CullInstance* GpuCuller::GetFrameInstances(const uint32_t& frame) const
+{
+    return (CullInstance*)vkInstanceBufferMapped + (size_t)gpuData->GetArray<Resources::Model>().capacity * frame;
+}
+
+void GpuCuller::ReadBackCounters(const uint32_t& frame)
+{
+    uint32_t* counter = (uint32_t*)((char*)vkCounterBufferMapped + vkCounterStride * frame);
+    visibleCount = *counter;
+    culledCount  = submittedCounts[frame] - std::min(visibleCount, submittedCounts[frame]);
+    submittedCounts[frame] = 0;
+    *counter = 0;
+}
+
+void GpuCuller::RecordCulling(const VkCommandBuffer& commandBuffer, const uint32_t& frame, const uint32_t& instanceCount)
+{
+    submittedCounts[frame] = instanceCount;
+    if (instanceCount == 0) return;
+    uint32_t* counters = (uint32_t*)((char*)vkCounterBufferMapped + vkCounterStride * frame);
+    counters[1] = instanceCount;
+
+    // Cull the instances, 64 per work group.
+    pipeline->Bind    (commandBuffer, frame);
+    pipeline->Dispatch(commandBuffer, (instanceCount + 63) / 64);
+
+    // Make the compacted commands and visible instances available to the draws.
+    VkMemoryBarrier barrier{};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+}
@@ -7,21 +7,187 @@
 #include "Resources/Mesh.h"
 #include "Resources/Model.h"
 #include "Resources/Light.h"
+#include "Maths/Arithmetic.h"
 #include <vulkan/vulkan_core.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <unordered_map>
 using namespace Core;
 using namespace Resources;
 using namespace GraphicsUtils;
 
+const char* Core::GpuMemoryCategoryToStr(const size_t& category)
+{
+    switch (category)
+    {
+    case GpuMemoryCategory::Textures:
+        return "Textures";
+    case GpuMemoryCategory::Meshes:
+        return "Meshes";
+    case GpuMemoryCategory::Models:
+        return "Instances";
+    case GpuMemoryCategory::Materials:
+        return "Materials";
+    case GpuMemoryCategory::Lights:
+        return "Lights";
+    case GpuMemoryCategory::RenderTargets:
+        return "Render targets";
+    default:
+        return "Unknown";
+    }
+}
+
 GpuDataManager::~GpuDataManager()
 {
     
 }
 
+GpuMemoryStats GpuDataManager::GetMemoryStats() const
+{
+    GpuMemoryStats stats;
+    for (size_t i = 0; i < GpuMemoryCategory::COUNT; i++) {
+        stats.categoryBytes      [i] = trackedMemory     [i];
+        stats.categoryAllocations[i] = trackedAllocations[i];
+        stats.trackedBytes          += trackedMemory     [i];
+        stats.allocationCount       += trackedAllocations[i];
+    }
+    stats.sharedGeometryBytes     = meshesArray.vkMemorySize;
+    stats.sharedGeometryUsedBytes = meshesArray.usedBytes;
+    stats.maxAllocationCount      = maxAllocationCount;
+
+    // Without the budget extension, fall back to heap sizes and tracked bytes.
+    stats.budgetQueried = renderer && renderer->IsMemoryBudgetSupported();
+    stats.deviceBudget  = stats.budgetQueried ? deviceBudget : deviceHeapSize;
+    stats.deviceUsage   = stats.budgetQueried ? deviceUsage  : stats.trackedBytes;
+    return stats;
+}
+
+void GpuDataManager::UpdateMemoryBudget()
+{
+    // Every resource has a dedicated allocation, so the device's allocation limit can be hit before its memory runs out.
+    const bool firstUpdate = maxAllocationCount == 0;
+    if (firstUpdate) {
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(renderer->GetVkPhysicalDevice(), &deviceProperties);
+        maxAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+    }
+    if (!firstUpdate && !renderer->IsMemoryBudgetSupported()) return;
+
+    // Query the memory heaps, along with their budget if the extension is enabled.
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+    memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memoryProperties.pNext = renderer->IsMemoryBudgetSupported() ? &budgetProperties : nullptr;
+    vkGetPhysicalDeviceMemoryProperties2(renderer->GetVkPhysicalDevice(), &memoryProperties);
+
+    // Sum the sizes, budget and usage of device-local heaps.
+    deviceHeapSize = deviceBudget = deviceUsage = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryProperties.memoryHeapCount; i++)
+    {
+        if (!(memoryProperties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) continue;
+        deviceHeapSize += memoryProperties.memoryProperties.memoryHeaps[i].size;
+        deviceBudget   += budgetProperties.heapBudget[i];
+        deviceUsage    += budgetProperties.heapUsage [i];
+    }
+}
+
+void GpuDataManager::BenchmarkDataLookups(const size_t& count)
+{
+    constexpr size_t passCount = 100;
+
+    // Fill a table and a map keyed by scattered resource IDs, as when resources of other types are created in between.
+    std::mt19937 generator(0);
+    GpuDataTable<Mesh>                             table;
+    std::unordered_map<uid_t, GpuData<Mesh>>       map;
+    std::vector<std::pair<GpuHandle<Mesh>, uid_t>> resources(count);
+    uid_t id = 0;
+    for (auto& [handle, resourceID] : resources)
+    {
+        resourceID = id += 1 + generator() % 4;
+        table.Emplace(handle).indexRange.count = resourceID;
+        map[resourceID].indexRange.count       = resourceID;
+    }
+    std::shuffle(resources.begin(), resources.end(), generator);
+
+    // Time both lookups in the same random order, summing a field so that they aren't optimized out.
+    using Clock = std::chrono::high_resolution_clock;
+    uint64_t tableSum = 0, mapSum = 0;
+    const auto tableStart = Clock::now();
+    for (size_t pass = 0; pass < passCount; pass++)
+        for (const auto& [handle, resourceID] : resources)
+            tableSum += table.Get(handle)->indexRange.count;
+    const auto mapStart = Clock::now();
+    for (size_t pass = 0; pass < passCount; pass++)
+        for (const auto& [handle, resourceID] : resources)
+            mapSum += map.find(resourceID)->second.indexRange.count;
+    const auto end = Clock::now();
+
+    // Erase every other value and check that its handle is detected as stale, even once its slot is reused.
+    size_t staleCount = 0;
+    for (size_t i = 0; i < count; i += 2) {
+        GpuHandle<Mesh> handle = resources[i].first;
+        table.Erase(handle);
+        GpuHandle<Mesh> reused;
+        table.Emplace(reused);
+    }
+    for (size_t i = 0; i < count; i += 2)
+        staleCount += table.Contains(resources[i].first) ? 0 : 1;
+
+    const std::chrono::duration<float, std::milli> tableTime = mapStart - tableStart, mapTime = end - mapStart;
+    const float lookupCount = (float)(count * passCount);
+    LogInfo(LogType::Default, "Looked up " + std::to_string(count) + " GPU data " + std::to_string(passCount) + " times"
+                            + (tableSum == mapSum ? ". " : " with mismatching results. ")
+                            + "Handles: "  + std::to_string(tableTime.count() * 1e6f / lookupCount) + "ns | "
+                            + "Hash map: " + std::to_string(mapTime  .count() * 1e6f / lookupCount) + "ns | "
+                            + "Stale handles detected: " + std::to_string(staleCount) + " / " + std::to_string((count + 1) / 2));
+}
+
+void GpuDataManager::TrackMemory(const size_t& category, const VkDeviceSize& size, const uint32_t& allocationCount)
+{
+    trackedMemory     [category] += size;
+    trackedAllocations[category] += allocationCount;
+
+    // Warn once when usage gets close to the budget.
+    const GpuMemoryStats stats = GetMemoryStats();
+    const float usageRatio = stats.deviceBudget > 0 ? (float)((double)stats.deviceUsage / (double)stats.deviceBudget) : 0;
+    if (usageRatio >= memoryWarningRatio && IssueWarning(GpuWarning::MemoryUsage)) {
+        LogWarning(LogType::Vulkan, "GPU memory usage is at " + std::to_string(Maths::roundInt(usageRatio * 100)) + "% of the budget ("
+                                  + std::to_string(stats.deviceUsage >> 20) + "MB / " + std::to_string(stats.deviceBudget >> 20) + "MB).");
+    }
+
+    // Warn once when the number of allocations gets close to the device's limit.
+    const float allocationRatio = stats.maxAllocationCount > 0 ? (float)stats.allocationCount / (float)stats.maxAllocationCount : 0;
+    if (allocationRatio >= memoryWarningRatio && IssueWarning(GpuWarning::AllocationCount)) {
+        LogWarning(LogType::Vulkan, "GPU memory allocation count is at " + std::to_string(stats.allocationCount) + " out of a maximum of "
+                                  + std::to_string(stats.maxAllocationCount) + ".");
+    }
+}
+
+void GpuDataManager::UntrackMemory(const size_t& category, const VkDeviceSize& size, const uint32_t& allocationCount)
+{
+    trackedMemory     [category] -= std::min(trackedMemory     [category], size);
+    trackedAllocations[category] -= std::min(trackedAllocations[category], allocationCount);
+
+    // Allow new warnings once usage has gone back under the threshold.
+    if (issuedWarnings[GpuWarning::MemoryUsage] || issuedWarnings[GpuWarning::AllocationCount]) {
+        const GpuMemoryStats stats = GetMemoryStats();
+        if (stats.deviceBudget > 0 && (double)stats.deviceUsage / (double)stats.deviceBudget < memoryWarningRatio)
+            ResetWarning(GpuWarning::MemoryUsage);
+        if (stats.maxAllocationCount > 0 && (double)stats.allocationCount / (double)stats.maxAllocationCount < memoryWarningRatio)
+            ResetWarning(GpuWarning::AllocationCount);
+    }
+}
+
 template<> void GpuDataManager::DestroyArray<Material>()
 {
     const VkDevice vkDevice = renderer->GetVkDevice();
     if (materialsArray.vkDescriptorSetLayout) vkDestroyDescriptorSetLayout(vkDevice, materialsArray.vkDescriptorSetLayout, nullptr);
     if (materialsArray.vkDescriptorPool)      vkDestroyDescriptorPool     (vkDevice, materialsArray.vkDescriptorPool,      nullptr);
+    if (materialsArray.vkBuffer)              vkDestroyBuffer(vkDevice, materialsArray.vkBuffer,       nullptr);
+    if (materialsArray.vkBufferMemory)        vkFreeMemory   (vkDevice, materialsArray.vkBufferMemory, nullptr);
+    UntrackMemory(GpuMemoryCategory::Materials, materialsArray.vkMemorySize);
 }
 
 template<> void GpuDataManager::DestroyArray<Model>()
@@ -29,6 +195,27 @@ template<> void GpuDataManager::DestroyArray<Model>()
     const VkDevice vkDevice = renderer->GetVkDevice();
     if (modelsArray.vkDescriptorSetLayout) vkDestroyDescriptorSetLayout(vkDevice, modelsArray.vkDescriptorSetLayout, nullptr);
     if (modelsArray.vkDescriptorPool)      vkDestroyDescriptorPool     (vkDevice, modelsArray.vkDescriptorPool,      nullptr);
+    if (modelsArray.vkBuffer)              vkDestroyBuffer(vkDevice, modelsArray.vkBuffer,       nullptr);
+    if (modelsArray.vkBufferMemory)        vkFreeMemory   (vkDevice, modelsArray.vkBufferMemory, nullptr);
+    if (modelsArray.vkDrawBuffer)          vkDestroyBuffer(vkDevice, modelsArray.vkDrawBuffer,       nullptr);
+    if (modelsArray.vkDrawBufferMemory)    vkFreeMemory   (vkDevice, modelsArray.vkDrawBufferMemory, nullptr);
+    if (modelsArray.vkVisibleBuffer)       vkDestroyBuffer(vkDevice, modelsArray.vkVisibleBuffer,       nullptr);
+    if (modelsArray.vkVisibleBufferMemory) vkFreeMemory   (vkDevice, modelsArray.vkVisibleBufferMemory, nullptr);
+    UntrackMemory(GpuMemoryCategory::Models, modelsArray.vkMemorySize);
+    UntrackMemory(GpuMemoryCategory::Models, modelsArray.vkDrawMemorySize);
+    UntrackMemory(GpuMemoryCategory::Models, modelsArray.vkVisibleMemorySize);
+}
+
+template<> void GpuDataManager::DestroyArray<Mesh>()
+{
+    const VkDevice vkDevice = renderer->GetVkDevice();
+    if (meshesArray.vkIndexBuffer          ) vkDestroyBuffer(vkDevice, meshesArray.vkIndexBuffer,           nullptr);
+    if (meshesArray.vkIndexBufferMemory    ) vkFreeMemory   (vkDevice, meshesArray.vkIndexBufferMemory,     nullptr);
+    if (meshesArray.vkPositionBuffer       ) vkDestroyBuffer(vkDevice, meshesArray.vkPositionBuffer,        nullptr);
+    if (meshesArray.vkPositionBufferMemory ) vkFreeMemory   (vkDevice, meshesArray.vkPositionBufferMemory,  nullptr);
+    if (meshesArray.vkAttributeBuffer      ) vkDestroyBuffer(vkDevice, meshesArray.vkAttributeBuffer,       nullptr);
+    if (meshesArray.vkAttributeBufferMemory) vkFreeMemory   (vkDevice, meshesArray.vkAttributeBufferMemory, nullptr);
+    UntrackMemory(GpuMemoryCategory::Meshes, meshesArray.vkMemorySize, 3);
 }
 
 template<> void GpuDataManager::DestroyArray<Light>()
@@ -36,109 +223,201 @@ template<> void GpuDataManager::DestroyArray<Light>()
     const VkDevice vkDevice = renderer->GetVkDevice();
     if (lightsArray.vkDescriptorSetLayout) vkDestroyDescriptorSetLayout(vkDevice, lightsArray.vkDescriptorSetLayout, nullptr);
     if (lightsArray.vkDescriptorPool)      vkDestroyDescriptorPool     (vkDevice, lightsArray.vkDescriptorPool,      nullptr);
-    if (lightsArray.vkBuffer)              vkDestroyBuffer(vkDevice, lightsArray.vkBuffer,       nullptr);
-    if (lightsArray.vkBufferMemory)        vkFreeMemory   (vkDevice, lightsArray.vkBufferMemory, nullptr);
+    if (lightsArray.vkBuffer)              vkDestroyBuffer(vkDevice, lightsArray.vkBuffer,              nullptr);
+    if (lightsArray.vkBufferMemory)        vkFreeMemory   (vkDevice, lightsArray.vkBufferMemory,        nullptr);
+    if (lightsArray.vkParamsBuffer)        vkDestroyBuffer(vkDevice, lightsArray.vkParamsBuffer,        nullptr);
+    if (lightsArray.vkParamsBufferMemory)  vkFreeMemory   (vkDevice, lightsArray.vkParamsBufferMemory,  nullptr);
+    if (lightsArray.vkClusterBuffer)       vkDestroyBuffer(vkDevice, lightsArray.vkClusterBuffer,       nullptr);
+    if (lightsArray.vkClusterBufferMemory) vkFreeMemory   (vkDevice, lightsArray.vkClusterBufferMemory, nullptr);
+    UntrackMemory(GpuMemoryCategory::Lights, lightsArray.vkMemorySize, 3);
 }
 
 template<> void GpuDataManager::DestroyData(const Texture& resource)
 {
     if (!CheckData(resource)) return;
     const VkDevice vkDevice = renderer->GetVkDevice();
-    const GpuData<Texture>& data = textures.at(resource.GetID());
-    if (data.vkImage      ) vkDestroyImage    (vkDevice, data.vkImage,       nullptr);
-    if (data.vkImageMemory) vkFreeMemory      (vkDevice, data.vkImageMemory, nullptr);
-    if (data.vkImageView  ) vkDestroyImageView(vkDevice, data.vkImageView,   nullptr);
-    textures.erase(resource.GetID());
+    const GpuData<Texture> data = *textures.Get(resource.gpuHandle);
+    DeferDeletion([this, vkDevice, data]
+    {
+        if (data.vkImage      ) vkDestroyImage    (vkDevice, data.vkImage,       nullptr);
+        if (data.vkImageMemory) vkFreeMemory      (vkDevice, data.vkImageMemory, nullptr);
+        if (data.vkImageView  ) vkDestroyImageView(vkDevice, data.vkImageView,   nullptr);
+        if (data.bindlessIndex != INVALID_BINDLESS_INDEX) materialsArray.freeTextureSlots.push_back(data.bindlessIndex);
+    });
+    UntrackMemory(GpuMemoryCategory::Textures, data.vkMemorySize);
+    if (data.residentMip == 0) residencyList.erase(data.residencyEntry);
+    textures.Erase(resource.gpuHandle);
 }
 
 template<> void GpuDataManager::DestroyData(const Material& resource)
 {
     if (!CheckData(resource)) return;
-    const VkDevice vkDevice = renderer->GetVkDevice();
-    const GpuData<Material>& data = materials.at(resource.GetID());
-    if (data.vkDataBuffer)       vkDestroyBuffer(vkDevice, data.vkDataBuffer,       nullptr);
-    if (data.vkDataBufferMemory) vkFreeMemory   (vkDevice, data.vkDataBufferMemory, nullptr);
-    materials.erase(resource.GetID());
+
+    // The slot is given back once the frames in flight no longer read it.
+    const uint32_t index = materials.Get(resource.gpuHandle)->index;
+    DeferDeletion([this, index]
+    {
+        materialsArray.freeMaterialSlots.push_back(index);
+    });
+    materials.Erase(resource.gpuHandle);
 }
 
 template<> void GpuDataManager::DestroyData(const Mesh& resource)
 {
     if (!CheckData(resource)) return;
-    const VkDevice vkDevice = renderer->GetVkDevice();
-    const GpuData<Mesh>& data = meshes.at(resource.GetID());
-    if (data.vkIndexBuffer       ) vkDestroyBuffer(vkDevice, data.vkIndexBuffer,        nullptr);
-    if (data.vkIndexBufferMemory ) vkFreeMemory   (vkDevice, data.vkIndexBufferMemory,  nullptr);
-    if (data.vkVertexBuffer      ) vkDestroyBuffer(vkDevice, data.vkVertexBuffer,       nullptr);
-    if (data.vkVertexBufferMemory) vkFreeMemory   (vkDevice, data.vkVertexBufferMemory, nullptr);
-    materials.erase(resource.GetID());
+
+    // Evicted meshes have no buffers left, but their data is kept until they are destroyed.
+    const GpuData<Mesh>& data = *meshes.Get(resource.gpuHandle);
+    if (data.resident) {
+        ReleaseMeshData(data);
+        residencyList.erase(data.residencyEntry);
+    }
+    meshes.Erase(resource.gpuHandle);
 }
 
-template<> void GpuDataManager::DestroyData(const Model& resource)
+void GpuDataManager::ReleaseMeshData(const GpuData<Mesh>& data)
 {
-    if (!CheckData(resource)) return;
     const VkDevice vkDevice = renderer->GetVkDevice();
-    const GpuData<Model>& data = models.at(resource.GetID());
-    for (unsigned int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if (data.vkMvpBuffers[i])       vkDestroyBuffer(vkDevice, data.vkMvpBuffers[i],       nullptr);
-        if (data.vkMvpBuffersMemory[i]) vkFreeMemory   (vkDevice, data.vkMvpBuffersMemory[i], nullptr);
+
+    // Give the ranges of shared meshes back to the geometry buffers.
+    if (data.IsShared())
+    {
+        DeferDeletion([this, data]
+        {
+            FreeRange(meshesArray.freeVertexRanges, data.vertexRange);
+            FreeRange(meshesArray.freeIndexRanges,  data.indexRange);
+        });
+        meshesArray.usedBytes -= data.vkMemorySize;
+        return;
+    }
+    
+    DeferDeletion([vkDevice, data]
+    {
+        if (data.vkIndexBuffer          ) vkDestroyBuffer(vkDevice, data.vkIndexBuffer,           nullptr);
+        if (data.vkIndexBufferMemory    ) vkFreeMemory   (vkDevice, data.vkIndexBufferMemory,     nullptr);
+        if (data.vkPositionBuffer       ) vkDestroyBuffer(vkDevice, data.vkPositionBuffer,        nullptr);
+        if (data.vkPositionBufferMemory ) vkFreeMemory   (vkDevice, data.vkPositionBufferMemory,  nullptr);
+        if (data.vkAttributeBuffer      ) vkDestroyBuffer(vkDevice, data.vkAttributeBuffer,       nullptr);
+        if (data.vkAttributeBufferMemory) vkFreeMemory   (vkDevice, data.vkAttributeBufferMemory, nullptr);
+    });
+    UntrackMemory(GpuMemoryCategory::Meshes, data.vkMemorySize, 3);
+}
+
+bool GpuDataManager::AllocateRange(std::vector<GpuRange>& freeRanges, const uint32_t& count, uint32_t& offset)
+{
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+    {
+        if (it->count < count) continue;
+        offset = it->offset;
+        it->offset += count;
+        it->count  -= count;
+        if (it->count == 0) freeRanges.erase(it);
+        return true;
+    }
+    return false;
+}
+
+void GpuDataManager::FreeRange(std::vector<GpuRange>& freeRanges, const GpuRange& range)
+{
+    if (range.count == 0) return;
+
+    // Insert the range in offset order and merge it with its neighbours.
+    auto it = std::lower_bound(freeRanges.begin(), freeRanges.end(), range, [](const GpuRange& a, const GpuRange& b){ return a.offset < b.offset; });
+    it = freeRanges.insert(it, range);
+    if (it + 1 != freeRanges.end() && it->offset + it->count == (it + 1)->offset) {
+        it->count += (it + 1)->count;
+        freeRanges.erase(it + 1);
+    }
+    if (it != freeRanges.begin() && (it - 1)->offset + (it - 1)->count == it->offset) {
+        (it - 1)->count += it->count;
+        freeRanges.erase(it);
+    }
+}
+
+uint32_t GpuDataManager::AllocateSlot(std::vector<uint32_t>& freeSlots, uint32_t& slotCount, const uint32_t& capacity)
+{
+    if (!freeSlots.empty()) {
+        const uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    return slotCount < capacity ? slotCount++ : INVALID_BINDLESS_INDEX;
+}
+
+void GpuDataManager::DeferDeletion(std::function<void()>&& destroy)
+{
+    deletionQueue.push_back({ renderer->GetFrameIndex(), std::move(destroy) });
+}
+
+void GpuDataManager::RetireDeletions(const uint64_t& currentFrameIndex)
+{
+    // Resources are destroyed in order, so stop at the first one that may still be in use.
+    // Each deletion is popped before it runs, since it may defer another one.
+    while (!deletionQueue.empty() && deletionQueue.front().frameIndex + MAX_FRAMES_IN_FLIGHT <= currentFrameIndex)
+    {
+        const std::function<void()> destroy = std::move(deletionQueue.front().destroy);
+        deletionQueue.pop_front();
+        destroy();
     }
-    materials.erase(resource.GetID());
 }
 
-template<> bool GpuDataManager::CheckArray<Material>() const { return materialsArray.vkDescriptorPool && materialsArray.vkDescriptorSetLayout; }
-template<> bool GpuDataManager::CheckArray<Model>()    const { return modelsArray   .vkDescriptorPool && modelsArray   .vkDescriptorSetLayout; }
+void GpuDataManager::FlushDeletions()
+{
+    while (!deletionQueue.empty())
+    {
+        const std::function<void()> destroy = std::move(deletionQueue.front().destroy);
+        deletionQueue.pop_front();
+        destroy();
+    }
+}
+
+template<> bool GpuDataManager::CheckArray<Material>() const { return materialsArray.vkDescriptorPool && materialsArray.vkDescriptorSetLayout
+                                                                   && materialsArray.vkDescriptorSet && materialsArray.vkBuffer && materialsArray.vkBufferMemory; }
+template<> bool GpuDataManager::CheckArray<Model>()    const { return modelsArray   .vkDescriptorPool && modelsArray   .vkDescriptorSetLayout
+                                                                   && modelsArray.vkDescriptorSet && modelsArray.vkBuffer && modelsArray.vkBufferMemory && modelsArray.vkDrawBuffer && modelsArray.vkVisibleBuffer; }
+template<> bool GpuDataManager::CheckArray<Mesh>()     const { return meshesArray   .vkPositionBuffer && meshesArray   .vkPositionBufferMemory && meshesArray.vkAttributeBuffer
+                                                                   && meshesArray.vkAttributeBufferMemory && meshesArray.vkIndexBuffer && meshesArray.vkIndexBufferMemory; }
 template<> bool GpuDataManager::CheckArray<Light>()    const { return lightsArray   .vkDescriptorPool && lightsArray   .vkDescriptorSetLayout
-                                                                   && lightsArray.vkDescriptorSet && lightsArray.vkBuffer && lightsArray.vkBufferMemory; }
+                                                                   && lightsArray.vkDescriptorSet && lightsArray.vkBuffer && lightsArray.vkParamsBuffer && lightsArray.vkClusterBuffer; }
 
-template<> bool GpuDataManager::CheckData(const Texture&  resource) const { const uid_t id = resource.GetID(); return id != UniqueID::unassigned && textures .find(id) != textures .end(); }
-template<> bool GpuDataManager::CheckData(const Material& resource) const { const uid_t id = resource.GetID(); return id != UniqueID::unassigned && materials.find(id) != materials.end(); }
-template<> bool GpuDataManager::CheckData(const Mesh&     resource) const { const uid_t id = resource.GetID(); return id != UniqueID::unassigned && meshes   .find(id) != meshes   .end(); }
-template<> bool GpuDataManager::CheckData(const Model&    resource) const { const uid_t id = resource.GetID(); return id != UniqueID::unassigned && models   .find(id) != models   .end(); }
+template<> bool GpuDataManager::CheckData(const Texture&  resource) const { return textures .Contains(resource.gpuHandle); }
+template<> bool GpuDataManager::CheckData(const Material& resource) const { return materials.Contains(resource.gpuHandle); }
+template<> bool GpuDataManager::CheckData(const Mesh&     resource) const { return meshes   .Contains(resource.gpuHandle); }
 
 template<> const GpuArray<Material>& GpuDataManager::GetArray() const { return materialsArray; }
 template<> const GpuArray<Model>&    GpuDataManager::GetArray() const { return modelsArray;    }
+template<> const GpuArray<Mesh>&     GpuDataManager::GetArray() const { return meshesArray;    }
 template<> const GpuArray<Light>&    GpuDataManager::GetArray() const { return lightsArray;    }
 
 template<> const GpuData<Texture>* GpuDataManager::GetData(const Texture& resource) const
 {
-    const uid_t id = resource.GetID();
-    if (id == UniqueID::unassigned || textures.find(id) == textures.end()) {
-        LogError(LogType::Resources, "No texture with ID " + std::to_string(id));
+    const GpuData<Texture>* data = textures.Get(resource.gpuHandle);
+    if (!data) {
+        LogError(LogType::Resources, "No texture with ID " + std::to_string(resource.GetID()));
         // throw std::runtime_error("RESOURCE_ID_NOT_FOUND");
         return nullptr;
     }
-    return &textures.at(id);
+    return data;
 }
 
 template<> const GpuData<Material>* GpuDataManager::GetData(const Material& resource) const
 {
-    const uid_t id = resource.GetID();
-    if (id == UniqueID::unassigned || materials.find(id) == materials.end()) {
-        LogError(LogType::Resources, "No material with ID " + std::to_string(id));
+    const GpuData<Material>* data = materials.Get(resource.gpuHandle);
+    if (!data) {
+        LogError(LogType::Resources, "No material with ID " + std::to_string(resource.GetID()));
         // throw std::runtime_error("RESOURCE_ID_NOT_FOUND");
         return nullptr;
     }
-    return &materials.at(id);
+    return data;
 }
 
 template<> const GpuData<Mesh>* GpuDataManager::GetData(const Mesh& resource) const
 {
-    const uid_t id = resource.GetID();
-    if (id == UniqueID::unassigned || meshes.find(id) == meshes.end()) {
-        LogError(LogType::Resources, "No mesh with ID " + std::to_string(id));
-        // throw std::runtime_error("RESOURCE_ID_NOT_FOUND");
-        return nullptr;
-    }
-    return &meshes.at(id);
-}
-
-template<> const GpuData<Model>* GpuDataManager::GetData(const Model& resource) const
-{
-    const uid_t id = resource.GetID();
-    if (id == UniqueID::unassigned || models.find(id) == models.end()) {
-        LogError(LogType::Resources, "No model with ID " + std::to_string(id));
+    const GpuData<Mesh>* data = meshes.Get(resource.gpuHandle);
+    if (!data) {
+        LogError(LogType::Resources, "No mesh with ID " + std::to_string(resource.GetID()));
         // throw std::runtime_error("RESOURCE_ID_NOT_FOUND");
         return nullptr;
     }
-    return &models.at(id);
+    return data;
 }
\ No newline at end of file
@@ -10,7 +10,12 @@
 #include <limits>
 #include <algorithm>
 #include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <future>
+#include <mutex>
 #include <GLFW/glfw3.h>
+namespace fs = std::filesystem;
 using namespace Core;
 using namespace GraphicsUtils;
 
@@ -31,6 +36,10 @@ const std::vector<const char*> GraphicsUtils::EXTENSIONS = {
     VK_EXT_SHADER_DEMOTE_TO_HELPER_INVOCATION_EXTENSION_NAME,
 };
 
+const std::vector<const char*> GraphicsUtils::OPTIONAL_EXTENSIONS = {
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+};
+
 SwapChainSupportDetails::SwapChainSupportDetails()
 {
     capabilities = new VkSurfaceCapabilitiesKHR;
@@ -62,18 +71,22 @@ QueueFamilyIndices GraphicsUtils::FindQueueFamilies(const VkPhysicalDevice& devi
     for (const auto& queueFamily : queueFamilies)
     {
         // Find the graphics family.
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) 
+        if (!queueFamilyIndices.graphicsFamily.has_value() && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
             queueFamilyIndices.graphicsFamily = i;
 
         // Find the present family.
         VkBool32 presentSupport = false;
         vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-        if (presentSupport) {
+        if (!queueFamilyIndices.presentFamily.has_value() && presentSupport) {
             queueFamilyIndices.presentFamily = i;
         }
 
+        // Find a compute only family, whose queue runs alongside the graphics queue.
+        if (!queueFamilyIndices.computeFamily.has_value() && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+            queueFamilyIndices.computeFamily = i;
+
         // Exit if the queue family indices have all been set.
-        if (queueFamilyIndices.IsComplete())
+        if (queueFamilyIndices.IsComplete() && queueFamilyIndices.computeFamily.has_value())
             break;
         ++i;
     }
@@ -227,6 +240,22 @@ bool GraphicsUtils::CheckDeviceExtensionSupport(const VkPhysicalDevice& device)
     return requiredExtensions.empty();
 }
 
+bool GraphicsUtils::CheckDeviceExtensionSupport(const VkPhysicalDevice& device, const char* extensionName)
+{
+    // Get an array of all the extensions on the given GPU.
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    // Look for the given extension.
+    for (const VkExtensionProperties& extension : availableExtensions) {
+        if (strcmp(extension.extensionName, extensionName) == 0)
+            return true;
+    }
+    return false;
+}
+
 bool GraphicsUtils::IsDeviceSuitable(const VkPhysicalDevice& device, const VkSurfaceKHR& surface)
 {
     VkPhysicalDeviceFeatures supportedFeatures;
@@ -305,17 +334,91 @@ VkShaderStageFlagBits GraphicsUtils::ShaderStageToFlagBits(const ShaderStage& sh
     }
 }
 
-VkShaderModule GraphicsUtils::CreateShaderModule(const VkDevice& device, const ShaderStage& type, const char* filename)
+// Directory where compiled SPIR-V binaries are cached, named after the hash of everything that affects their compilation.
+// It is relative to the parent of the shader's directory, so that it doesn't depend on the working directory.
+static constexpr const char* SHADER_CACHE_DIRECTORY = "Resources/ShaderCache";
+static constexpr uint32_t    SPIRV_MAGIC            = 0x07230203;
+
+// Hashes the given bytes with FNV-1a, continuing from the given hash.
+static uint64_t HashBytes(const void* data, const size_t& size, uint64_t hash = 14695981039346656037ull)
+{
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ ((const uint8_t*)data)[i]) * 1099511628211ull;
+    return hash;
+}
+static uint64_t HashString(const std::string& str, const uint64_t& hash)
+{
+    return HashBytes(str.data(), str.size() + 1, hash);
+}
+
+// Reads the whole text file, returns false if it couldn't be opened.
+static bool ReadTextFile(const fs::path& filename, std::string& contents)
 {
-    // Read the shader source code.
     std::ifstream f(filename, std::ios::in);
+    if (!f.is_open()) return false;
     std::stringstream buffer;
     buffer << f.rdbuf();
-    f.close();
-    const std::string shaderSourceStr = buffer.str();
-    const char*       shaderSource    = shaderSourceStr.c_str();
+    contents = buffer.str();
+    return true;
+}
+
+// Hashes the contents of the files included by the given source, recursively.
+static uint64_t HashIncludes(const std::string& source, const fs::path& directory, uint64_t hash, const int& depth = 0)
+{
+    constexpr int maxDepth = 16;
+    std::stringstream lines(source);
+    std::string line;
+    while (depth < maxDepth && std::getline(lines, line))
+    {
+        const size_t directive = line.find("#include");
+        const size_t nameStart = line.find('"', directive);
+        const size_t nameEnd   = line.find('"', nameStart + 1);
+        if (directive == std::string::npos || nameStart == std::string::npos || nameEnd == std::string::npos)
+            continue;
+        const fs::path includePath = directory / line.substr(nameStart + 1, nameEnd - nameStart - 1);
+        std::string includeSource;
+        if (!ReadTextFile(includePath, includeSource)) continue;
+        hash = HashString(includeSource, hash);
+        hash = HashIncludes(includeSource, includePath.parent_path(), hash, depth + 1);
+    }
+    return hash;
+}
+
+// Resolves #include "file" directives relative to the including file, or to the compiled shader's directory.
+class ShaderIncluder : public glslang::TShader::Includer
+{
+private:
+    fs::path shaderDirectory;
+
+public:
+    ShaderIncluder(const fs::path& directory) : shaderDirectory(directory) {}
+
+    IncludeResult* includeLocal(const char* headerName, const char* includerName, size_t) override
+    {
+        const fs::path includePath = (includerName[0] != '\0' ? fs::path(includerName).parent_path() : shaderDirectory) / headerName;
+        std::string* contents = new std::string;
+        if (!ReadTextFile(includePath, *contents)) {
+            delete contents;
+            return nullptr;
+        }
+        return new IncludeResult(includePath.string(), contents->data(), contents->size(), contents);
+    }
 
-    glslang::InitializeProcess();
+    void releaseInclude(IncludeResult* result) override
+    {
+        if (!result) return;
+        delete (std::string*)result->userData;
+        delete result;
+    }
+};
+
+// Compiles HLSL source to SPIR-V, filling the error log on failure.
+// Doesn't log anything since it runs on worker threads.
+static std::vector<uint32_t> CompileHlsl(const ShaderStage& type, const char* filename, const std::string& preamble, const std::string& shaderSourceStr, std::string& errorLog)
+{
+    static std::once_flag glslangInitFlag;
+    std::call_once(glslangInitFlag, [] { glslang::InitializeProcess(); });
+    const char* shaderSource = shaderSourceStr.c_str();
     
     // Get the shader kind from the shader type enum value.
     EShLanguage shaderStage = EShLangCount;
@@ -330,8 +433,8 @@ VkShaderModule GraphicsUtils::CreateShaderModule(const VkDevice& device, const S
         default: break;
     }
     if (shaderStage == EShLangCount) {
-        LogError(LogType::Vulkan, "Shader stage not found.");
-        throw std::runtime_error("VULKAN_SHADER_COMPILATION_ERROR");
+        errorLog = "Shader stage not found.";
+        return {};
     }
 
     // Compile the shader.
@@ -340,8 +443,10 @@ VkShaderModule GraphicsUtils::CreateShaderModule(const VkDevice& device, const S
     shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_6);
     shader.setEnvInput(glslang::EShSourceHlsl, shaderStage, glslang::EShClientVulkan, glslang::EShTargetVulkan_1_4);
     shader.setStrings(&shaderSource, 1);
+    shader.setPreamble(preamble.c_str());
     shader.setEntryPoint("main");
-    shader.parse(GetDefaultResources(), 100, false, EShMsgDefault);
+    ShaderIncluder includer(fs::path(filename).parent_path());
+    shader.parse(GetDefaultResources(), 100, false, EShMsgDefault, includer);
     if (const char* infoLog = shader.getInfoLog(); infoLog[0] != '\0')
     {
         std::string message = std::string(infoLog);
@@ -349,8 +454,8 @@ VkShaderModule GraphicsUtils::CreateShaderModule(const VkDevice& device, const S
         while (message[insert] != '\n' && insert != 0)
             --insert;
         message.insert(insert+1, std::string(filename) + " ");
-        LogError(LogType::Vulkan, message);
-        throw std::runtime_error("VULKAN_SHADER_COMPILATION_ERROR");
+        errorLog = message;
+        return {};
     }
 
     // Link the shader program.
@@ -358,39 +463,121 @@ VkShaderModule GraphicsUtils::CreateShaderModule(const VkDevice& device, const S
     program.addShader(&shader);
     if (!program.link(EShMsgDefault))
     {
-        LogError(LogType::Vulkan, program.getInfoLog());
-        throw std::runtime_error("VULKAN_SHADER_COMPILATION_ERROR");
+        errorLog = program.getInfoLog();
+        return {};
     }
 
     // Retrieve the compiled SPIR-V shader code.
     std::vector<uint32_t> compiledCode{};
     glslang::GlslangToSpv(*program.getIntermediate(shaderStage), compiledCode);
+    return compiledCode;
+}
+
+VkShaderModule GraphicsUtils::CreateShaderModule(const VkDevice& device, const ShaderStage& type, const char* filename, const std::vector<std::string>& defines)
+{
+    return CreateShaderModules(device, { { type, filename, defines } })[0];
+}
 
-    // Write binary SPIR-V to a file for debug purposes.
-    // glslang::OutputSpvBin(compiledCode, (std::string(filename) + ".bin").c_str());
+std::vector<VkShaderModule> GraphicsUtils::CreateShaderModules(const VkDevice& device, const std::vector<ShaderDesc>& shaders)
+{
+    // Everything that changes the generated code is part of the cache key, including the compiler version and targets.
+    const glslang::Version compilerVersion = glslang::GetVersion();
+    const std::string compilerKey = std::to_string(compilerVersion.major) + "." + std::to_string(compilerVersion.minor) + "." + std::to_string(compilerVersion.patch)
+                                  + compilerVersion.flavor + " hlsl vulkan1.4 spv1.6 " + std::to_string(glslang::GetSpirvGeneratorVersion());
     
-    // Set shader module creation information.
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = compiledCode.size() * sizeof(uint32_t);
-    createInfo.pCode    = compiledCode.data();
-
-    // Create and return the shader module.
-    VkShaderModule shaderModule{};
-    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-        LogError(LogType::Vulkan, "Failed to create shader module.");
-        throw std::runtime_error("VULKAN_SHADER_MODULE_ERROR");
+    std::vector<std::vector<uint32_t>> compiledCodes(shaders.size());
+    std::vector<std::string>           preambles    (shaders.size());
+    std::vector<std::string>           sources      (shaders.size());
+    std::vector<fs::path>              cachePaths   (shaders.size());
+    for (size_t i = 0; i < shaders.size(); i++)
+    {
+        // Read the shader source code.
+        const ShaderDesc& desc = shaders[i];
+        if (!ReadTextFile(desc.filename, sources[i])) {
+            LogError(LogType::FileIO, std::string("Failed to open file: ") + desc.filename);
+            throw std::runtime_error("FILE_IO_ERROR");
+        }
+        for (const std::string& define : desc.defines)
+            preambles[i] += "#define " + define + "\n";
+
+        // Hash the source, its includes, the defines, the stage and the compiler version.
+        uint64_t hash = HashString(sources[i], HashString(compilerKey, HashBytes(&desc.stage, sizeof(desc.stage))));
+        hash = HashIncludes(sources[i], fs::path(desc.filename).parent_path(), hash);
+        hash = HashString(preambles[i], hash);
+        char hashStr[17];
+        snprintf(hashStr, sizeof(hashStr), "%016llx", (unsigned long long)hash);
+        const fs::path shaderPath = fs::absolute(desc.filename);
+        cachePaths[i] = shaderPath.parent_path().parent_path() / SHADER_CACHE_DIRECTORY / (shaderPath.stem().string() + "_" + hashStr + ".spv");
+
+        // Load the cached binary if there is one, and recompile it if it isn't a whole SPIR-V module.
+        if (std::ifstream f(cachePaths[i], std::ios::ate | std::ios::binary); f.is_open())
+        {
+            const size_t size = (size_t)f.tellg();
+            compiledCodes[i].resize(size / sizeof(uint32_t));
+            f.seekg(0);
+            f.read((char*)compiledCodes[i].data(), (std::streamsize)(compiledCodes[i].size() * sizeof(uint32_t)));
+            if (!f.good() || size % sizeof(uint32_t) != 0 || compiledCodes[i].empty() || compiledCodes[i][0] != SPIRV_MAGIC) {
+                LogWarning(LogType::FileIO, "Discarding invalid shader cache entry: " + cachePaths[i].string());
+                compiledCodes[i].clear();
+            }
+        }
+    }
+
+    // Compile the shaders that weren't cached on worker threads.
+    std::vector<std::string> errorLogs(shaders.size());
+    std::vector<bool>        compiled (shaders.size(), false);
+    std::vector<std::future<void>> compilations;
+    for (size_t i = 0; i < shaders.size(); i++)
+    {
+        if (!compiledCodes[i].empty()) continue;
+        compiled[i] = true;
+        compilations.push_back(std::async(std::launch::async, [&, i] {
+            compiledCodes[i] = CompileHlsl(shaders[i].stage, shaders[i].filename, preambles[i], sources[i], errorLogs[i]);
+        }));
     }
-    return shaderModule;
+    for (std::future<void>& compilation : compilations)
+        compilation.get();
+    
+    std::vector<VkShaderModule> shaderModules(shaders.size());
+    for (size_t i = 0; i < shaders.size(); i++)
+    {
+        if (!errorLogs[i].empty()) {
+            LogError(LogType::Vulkan, errorLogs[i]);
+            throw std::runtime_error("VULKAN_SHADER_COMPILATION_ERROR");
+        }
+        
+        // Write newly compiled binaries to the cache, replacing the invalid entries.
+        if (compiled[i]) {
+            fs::create_directories(cachePaths[i].parent_path());
+            std::ofstream f(cachePaths[i], std::ios::binary | std::ios::trunc);
+            f.write((const char*)compiledCodes[i].data(), (std::streamsize)(compiledCodes[i].size() * sizeof(uint32_t)));
+        }
+        
+        // Set shader module creation information.
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = compiledCodes[i].size() * sizeof(uint32_t);
+        createInfo.pCode    = compiledCodes[i].data();
+
+        // Create the shader module.
+        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModules[i]) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to create shader module.");
+            throw std::runtime_error("VULKAN_SHADER_MODULE_ERROR");
+        }
+    }
+    return shaderModules;
 }
 
-void GraphicsUtils::CreateBuffer(const VkDevice& device, const VkPhysicalDevice& physicalDevice, const VkDeviceSize& size, const VkBufferUsageFlags& usage, const VkMemoryPropertyFlags& properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+void GraphicsUtils::CreateBuffer(const VkDevice& device, const VkPhysicalDevice& physicalDevice, const VkDeviceSize& size, const VkBufferUsageFlags& usage, const VkMemoryPropertyFlags& properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, const std::vector<uint32_t>& sharingFamilies)
 {
+    // Buffers accessed by several queue families are shared concurrently, so that they don't need ownership transfers.
     VkBufferCreateInfo bufferInfo{};
-    bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size        = size;
-    bufferInfo.usage       = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    bufferInfo.sType                 = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size                  = size;
+    bufferInfo.usage                 = usage;
+    bufferInfo.sharingMode           = sharingFamilies.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    bufferInfo.queueFamilyIndexCount = sharingFamilies.size() > 1 ? (uint32_t)sharingFamilies.size() : 0;
+    bufferInfo.pQueueFamilyIndices   = sharingFamilies.size() > 1 ? sharingFamilies.data()           : nullptr;
 
     // Create the buffer.
     if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
@@ -417,7 +604,7 @@ void GraphicsUtils::CreateBuffer(const VkDevice& device, const VkPhysicalDevice&
     vkBindBufferMemory(device, buffer, bufferMemory, 0);
 }
 
-void GraphicsUtils::CopyBuffer(const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& graphicsQueue, VkBuffer srcBuffer, VkBuffer dstBuffer, const VkDeviceSize& size)
+void GraphicsUtils::CopyBuffer(const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& graphicsQueue, VkBuffer srcBuffer, VkBuffer dstBuffer, const VkDeviceSize& size, const VkDeviceSize& dstOffset)
 {
     const VkCommandBuffer commandBuffer = BeginSingleTimeCommands(device, commandPool);
     
@@ -425,13 +612,13 @@ void GraphicsUtils::CopyBuffer(const VkDevice& device, const VkCommandPool& comm
     VkBufferCopy copyRegion{};
     copyRegion.size      = size;
     copyRegion.srcOffset = 0; // Optional
-    copyRegion.dstOffset = 0; // Optional
+    copyRegion.dstOffset = dstOffset;
     vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
     EndSingleTimeCommands(device, commandPool, graphicsQueue, commandBuffer);
 }
 
-void GraphicsUtils::CreateImage(const VkDevice& device, const VkPhysicalDevice& physicalDevice, const uint32_t& width, const uint32_t& height, const uint32_t& mipLevels, const VkSampleCountFlagBits& numSamples, const VkFormat& format, const VkImageTiling& tiling, const VkImageUsageFlags& usage, const VkMemoryPropertyFlags& properties, VkImage& image, VkDeviceMemory& imageMemory)
+void GraphicsUtils::CreateImage(const VkDevice& device, const VkPhysicalDevice& physicalDevice, const uint32_t& width, const uint32_t& height, const uint32_t& mipLevels, const VkSampleCountFlagBits& numSamples, const VkFormat& format, const VkImageTiling& tiling, const VkImageUsageFlags& usage, const VkMemoryPropertyFlags& properties, VkImage& image, VkDeviceMemory& imageMemory, const VkImageCreateFlags& flags, const void* pNext)
 {    
     // Create a vulkan image.
     VkImageCreateInfo imageInfo{};
@@ -448,7 +635,8 @@ void GraphicsUtils::CreateImage(const VkDevice& device, const VkPhysicalDevice&
     imageInfo.usage         = usage;
     imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
     imageInfo.samples       = numSamples;
-    imageInfo.flags         = 0; // Optional.
+    imageInfo.flags         = flags;
+    imageInfo.pNext         = pNext;
     if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
         LogError(LogType::Vulkan, "Failed to create texture image.");
         throw std::runtime_error("VULKAN_TEXTURE_IMAGE_ERROR");
@@ -468,7 +656,7 @@ void GraphicsUtils::CreateImage(const VkDevice& device, const VkPhysicalDevice&
     vkBindImageMemory(device, image, imageMemory, 0);
 }
 
-void GraphicsUtils::CreateImageView(const VkDevice& device, const VkImage& image, const VkFormat& format, const VkImageAspectFlags& aspectFlags, const uint32_t& mipLevels, VkImageView& imageView)
+void GraphicsUtils::CreateImageView(const VkDevice& device, const VkImage& image, const VkFormat& format, const VkImageAspectFlags& aspectFlags, const uint32_t& mipLevels, VkImageView& imageView, const uint32_t& baseMipLevel)
 {
     // Set creation information for the image view.
     VkImageViewCreateInfo viewInfo{};
@@ -485,7 +673,7 @@ void GraphicsUtils::CreateImageView(const VkDevice& device, const VkImage& image
 
     // Choose how the image is used and set the mipmap and layer counts.
     viewInfo.subresourceRange.aspectMask     = aspectFlags;
-    viewInfo.subresourceRange.baseMipLevel   = 0;
+    viewInfo.subresourceRange.baseMipLevel   = baseMipLevel;
     viewInfo.subresourceRange.levelCount     = mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount     = 1;
@@ -575,4 +763,18 @@ void GraphicsUtils::CopyBufferToImage(const VkDevice& device, const VkCommandPoo
     );
     
     EndSingleTimeCommands(device, commandPool, graphicsQueue, commandBuffer);
+}
+
+VkDeviceSize GraphicsUtils::GetBufferMemorySize(const VkDevice& device, const VkBuffer& buffer)
+{
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+    return memRequirements.size;
+}
+
+VkDeviceSize GraphicsUtils::GetImageMemorySize(const VkDevice& device, const VkImage& image)
+{
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+    return memRequirements.size;
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "Core/LightCuller.h"
+#include "Core/ComputePipeline.h"
+#include "Core/GpuDataManager.h"
+#include "Core/Renderer.h"
+#include "Resources/Camera.h"
+#include <vulkan/vulkan.h>
+using namespace Core;
+using namespace GraphicsUtils;
+
+LightCuller::LightCuller(Renderer* _renderer, GpuDataManager* _gpuData)
+    : renderer(_renderer), gpuData(_gpuData)
+{
+    // Create the compute pipeline, which uses the light array's descriptor set as its only set.
+    ComputePipelineDesc desc{ "Shaders/ClusterLights.hlsl", GetShaderDefines() };
+    desc.sharedSetLayouts = { gpuData->GetArray<Resources::Light>().vkDescriptorSetLayout };
+    pipeline = new ComputePipeline(renderer, desc);
+}
+
+LightCuller::~LightCuller()
+{
+    delete pipeline;
+}
+
+std::vector<std::string> LightCuller::GetShaderDefines()
+{
+    return {
+        "MAX_BINDLESS_TEXTURES " + std::to_string(MAX_BINDLESS_TEXTURES),
+        "LIGHT_CLUSTERS_X "      + std::to_string(LIGHT_CLUSTERS_X),
+        "LIGHT_CLUSTERS_Y "      + std::to_string(LIGHT_CLUSTERS_Y),
+        "LIGHT_CLUSTERS_Z "      + std::to_string(LIGHT_CLUSTERS_Z),
+        "MAX_CLUSTER_LIGHTS "    + std::to_string(MAX_CLUSTER_LIGHTS),
+    };
+}
+
+void LightCuller::SetView(const Resources::Camera& camera)
+{
+    const Maths::Mat4 projMat = camera.GetProjMat();
+    viewMat    = camera.GetViewMat();
+    projScaleX = projMat[0][0];
+    projScaleY = projMat[1][1];
+    nearPlane  = camera.GetParams().near;
+    farPlane   = camera.GetParams().far;
+}
+
+void LightCuller::RecordCulling(const VkCommandBuffer& commandBuffer, const uint32_t& frame, const bool& asyncCompute) const
+{
+    // Write the view parameters, the light count and features were written along with the lights.
+    const GpuArray<Resources::Light>& lightArray = gpuData->GetArray<Resources::Light>();
+    LightClusterParams* params = lightArray.GetFrameParams(frame);
+    params->viewMat      = viewMat;
+    params->projScaleX   = projScaleX;
+    params->projScaleY   = projScaleY;
+    params->nearPlane    = nearPlane;
+    params->farPlane     = farPlane;
+    params->screenWidth  = (float)renderer->GetSwapChainWidth();
+    params->screenHeight = (float)renderer->GetSwapChainHeight();
+    params->clustered    = enabled ? 1 : 0;
+    if (!enabled) return;
+
+    // Bin the lights, one thread per cluster and 64 clusters per work group.
+    constexpr uint32_t clusterCount = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+    pipeline->Bind(commandBuffer, 0, { lightArray.vkDescriptorSet }, {
+        (uint32_t)(lightArray.vkFrameSize * frame), (uint32_t)(lightArray.vkParamsStride * frame), (uint32_t)(lightArray.vkClusterFrameSize * frame)
+    });
+    pipeline->Dispatch(commandBuffer, (clusterCount + 63) / 64);
+    if (asyncCompute) return;
+
+    // Make the light lists available to the fragment shaders.
+    VkMemoryBarrier barrier{};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+}
@@ -0,0 +1,341 @@
+#include "Core/MipGenerator.h"
+#include "Core/ComputePipeline.h"
+#include "Core/GpuDataManager.h"
+#include "Core/Renderer.h"
+#include "Core/Logger.h"
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+using namespace Core;
+using namespace GraphicsUtils;
+
+const char* Core::MipFilterToStr(const MipFilter& filter)
+{
+    switch (filter)
+    {
+    case MipFilter::Box:
+        return "Box";
+    case MipFilter::Point:
+        return "Point";
+    case MipFilter::Min:
+        return "Min";
+    case MipFilter::Max:
+        return "Max";
+    default:
+        return "Unknown";
+    }
+}
+
+MipGenerator::MipGenerator(Renderer* _renderer, GpuDataManager* _gpuData)
+    : renderer(_renderer), gpuData(_gpuData)
+{
+    const VkDevice         vkDevice         = renderer->GetVkDevice();
+    const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
+
+    // Create a pool with a begin and end timestamp, to compare the generation methods.
+    if (renderer->IsGpuTimeSupported())
+    {
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = 2;
+        if (vkCreateQueryPool(vkDevice, &poolInfo, nullptr, &vkTimestampQueryPool) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to create mip generation timestamp query pool.");
+            throw std::runtime_error("VULKAN_QUERY_POOL_ERROR");
+        }
+    }
+
+    if (!renderer->IsComputeMipsSupported()) {
+        LogWarning(LogType::Vulkan, "Storage image arrays can't be indexed, mips will be generated with blits.");
+        method = MipMethod::Blit;
+        return;
+    }
+
+    // Create the compute pipeline, with one set per pass that binds the source level, the written levels and the work group counter.
+    ComputePipelineDesc desc{ "Shaders/GenerateMips.hlsl" };
+    desc.bindings         = { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+    desc.bindingCounts    = { 1, MAX_MIPS_PER_PASS, 1 };
+    desc.setCount         = MAX_PASSES;
+    desc.pushConstantSize = sizeof(PassConstants);
+    pipeline = new ComputePipeline(renderer, desc);
+
+    // Create the work group counter, which starts at zero and is reset by the shader after each pass.
+    CreateBuffer(vkDevice, vkPhysicalDevice, sizeof(uint32_t),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 vkCounterBuffer, vkCounterBufferMemory);
+    void* counterMapped;
+    vkMapMemory(vkDevice, vkCounterBufferMemory, 0, sizeof(uint32_t), 0, &counterMapped);
+    memset(counterMapped, 0, sizeof(uint32_t));
+    vkUnmapMemory(vkDevice, vkCounterBufferMemory);
+    vkMemorySize = GetBufferMemorySize(vkDevice, vkCounterBuffer);
+    gpuData->TrackMemory(GpuMemoryCategory::Textures, vkMemorySize);
+    for (uint32_t pass = 0; pass < MAX_PASSES; pass++)
+        pipeline->WriteBuffer(pass, 2, vkCounterBuffer, 0, sizeof(uint32_t));
+}
+
+MipGenerator::~MipGenerator()
+{
+    const VkDevice vkDevice = renderer->GetVkDevice();
+    if (vkTimestampQueryPool) vkDestroyQueryPool(vkDevice, vkTimestampQueryPool, nullptr);
+    if (!pipeline) return;
+    vkDestroyBuffer(vkDevice, vkCounterBuffer,       nullptr);
+    vkFreeMemory   (vkDevice, vkCounterBufferMemory, nullptr);
+    delete pipeline;
+    gpuData->UntrackMemory(GpuMemoryCategory::Textures, vkMemorySize);
+}
+
+VkImageUsageFlags MipGenerator::GetImageUsage() const
+{
+    // Blits only need the transfer usages, storage usage can prevent images from being compressed.
+    constexpr VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    return pipeline ? usage | VK_IMAGE_USAGE_STORAGE_BIT : usage;
+}
+
+VkImageCreateFlags MipGenerator::GetImageFlags(const VkFormat& format) const
+{
+    // sRGB formats usually can't be used as storage images, so their levels are written through UNORM views.
+    if (!pipeline || format != VK_FORMAT_R8G8B8A8_SRGB) return 0;
+    return VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+}
+
+const VkImageFormatListCreateInfo* MipGenerator::GetImageFormatList(const VkFormat& format) const
+{
+    static constexpr VkFormat SRGB_VIEW_FORMATS[2] = { VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM };
+    static const VkImageFormatListCreateInfo SRGB_FORMAT_LIST = { VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO, nullptr, 2, SRGB_VIEW_FORMATS };
+    return GetImageFlags(format) ? &SRGB_FORMAT_LIST : nullptr;
+}
+
+bool MipGenerator::IsLinearBlitSupported(const VkFormat& format) const
+{
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(renderer->GetVkPhysicalDevice(), format, &formatProperties);
+    return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+}
+
+float MipGenerator::Generate(const VkImage& image, const VkFormat& format, const uint32_t& width, const uint32_t& height, const uint32_t& mipLevels,
+                             const VkImageLayout& oldLayout, MipMethod generationMethod)
+{
+    const VkDevice      vkDevice      = renderer->GetVkDevice();
+    const VkCommandPool commandPool   = renderer->GetVkCommandPool();
+    const VkQueue       graphicsQueue = renderer->GetVkGraphicsQueue();
+
+    // Fall back on blits without compute support, and on compute for formats that can't be blitted linearly.
+    // A single level only needs its layout transition, which the blit chain records.
+    if (!pipeline || mipLevels <= 1) generationMethod = MipMethod::Blit;
+    if (generationMethod == MipMethod::Blit && mipLevels > 1 && !IsLinearBlitSupported(format))
+    {
+        if (!pipeline) {
+            LogError(LogType::Resources, "Texture image format does not support linear blitting.");
+            throw std::runtime_error("TEXTURE_BLITTING_ERROR");
+        }
+        generationMethod = MipMethod::Compute;
+    }
+
+    // Record the generation between two timestamps.
+    const VkCommandBuffer commandBuffer = BeginSingleTimeCommands(vkDevice, commandPool);
+    if (vkTimestampQueryPool) {
+        vkCmdResetQueryPool(commandBuffer, vkTimestampQueryPool, 0, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vkTimestampQueryPool, 0);
+    }
+    std::vector<VkImageView> imageViews;
+    if (generationMethod == MipMethod::Compute)
+        RecordComputeMips(commandBuffer, image, format, width, height, mipLevels, oldLayout, imageViews);
+    else
+        RecordBlitMips(commandBuffer, image, width, height, mipLevels, oldLayout);
+    if (vkTimestampQueryPool)
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vkTimestampQueryPool, 1);
+
+    // Submit the commands and wait for them, timing the submission in case timestamps aren't supported.
+    const auto submitStart = std::chrono::high_resolution_clock::now();
+    EndSingleTimeCommands(vkDevice, commandPool, graphicsQueue, commandBuffer);
+    const std::chrono::duration<float, std::milli> submitTime = std::chrono::high_resolution_clock::now() - submitStart;
+    float time = submitTime.count();
+    uint64_t timestamps[2];
+    if (vkTimestampQueryPool && vkGetQueryPoolResults(vkDevice, vkTimestampQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+        time = (float)(timestamps[1] - timestamps[0]) * renderer->GetTimestampPeriod() / 1e6f;
+
+    // The views of the levels are no longer used.
+    for (const VkImageView& imageView : imageViews)
+        vkDestroyImageView(vkDevice, imageView, nullptr);
+
+    if (mipLevels > 1) {
+        MipGenerationStats& methodStats = stats[(size_t)generationMethod];
+        methodStats.textureCount++;
+        methodStats.totalTime += time;
+    }
+    return time;
+}
+
+void MipGenerator::RecordComputeMips(const VkCommandBuffer& commandBuffer, const VkImage& image, const VkFormat& format, const uint32_t& width, const uint32_t& height,
+                                     const uint32_t& mipLevels, const VkImageLayout& oldLayout, std::vector<VkImageView>& imageViews) const
+{
+    const VkDevice vkDevice      = renderer->GetVkDevice();
+    const bool     srgb          = format == VK_FORMAT_R8G8B8A8_SRGB;
+    const VkFormat storageFormat = srgb ? VK_FORMAT_R8G8B8A8_UNORM : format;
+
+    // The first level is sampled by the first pass and the others are written as storage images.
+    VkImageMemoryBarrier barriers[2]{};
+    for (VkImageMemoryBarrier& barrier : barriers) {
+        barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image                           = image;
+        barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+        barrier.oldLayout                       = oldLayout;
+        barrier.srcAccessMask                   = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount     = 1;
+    }
+    barriers[0].newLayout                     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].dstAccessMask                 = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].subresourceRange.baseMipLevel = 0;
+    barriers[0].subresourceRange.levelCount   = 1;
+    barriers[1].newLayout                     = VK_IMAGE_LAYOUT_GENERAL;
+    barriers[1].dstAccessMask                 = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[1].subresourceRange.baseMipLevel = 1;
+    barriers[1].subresourceRange.levelCount   = mipLevels - 1;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, 2, barriers);
+
+    // Each pass reads the last level written by the previous one, images of up to 4096x4096 texels only need one.
+    uint32_t srcLevel = 0;
+    for (uint32_t pass = 0; srcLevel < mipLevels - 1; pass++)
+    {
+        const uint32_t srcWidth  = std::max(width  >> srcLevel, 1u);
+        const uint32_t srcHeight = std::max(height >> srcLevel, 1u);
+
+        // The last work group can only reduce the sixth level when it fits in a single tile.
+        const uint32_t maxMipCount = (std::max(srcWidth, srcHeight) >> (MAX_MIPS_PER_PASS / 2)) > TILE_SIZE ? MAX_MIPS_PER_PASS / 2 : MAX_MIPS_PER_PASS;
+        const uint32_t mipCount    = std::min(mipLevels - 1 - srcLevel, maxMipCount);
+
+        // Create the views of the pass's levels, the source one decodes sRGB and the unused written ones are left null.
+        VkImageView srcView;
+        CreateImageView(vkDevice, image, format, VK_IMAGE_ASPECT_COLOR_BIT, 1, srcView, srcLevel);
+        imageViews.push_back(srcView);
+        std::vector<VkImageView> dstViews(MAX_MIPS_PER_PASS, nullptr);
+        for (uint32_t i = 0; i < mipCount; i++) {
+            CreateImageView(vkDevice, image, storageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, dstViews[i], srcLevel + 1 + i);
+            imageViews.push_back(dstViews[i]);
+        }
+        pipeline->WriteImages(pass, 0, { srcView }, pass == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL);
+        pipeline->WriteImages(pass, 1, dstViews, VK_IMAGE_LAYOUT_GENERAL);
+
+        // Wait for the previous pass to write the level this one reads from and to reset the counter.
+        if (pass > 0) {
+            VkMemoryBarrier memoryBarrier{};
+            memoryBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        }
+
+        // Reduce each tile of the source level.
+        const uint32_t groupCountX = (srcWidth  + TILE_SIZE - 1) / TILE_SIZE;
+        const uint32_t groupCountY = (srcHeight + TILE_SIZE - 1) / TILE_SIZE;
+        const PassConstants constants = { srcWidth, srcHeight, mipCount, groupCountX * groupCountY, (uint32_t)filter, srgb ? 1u : 0u };
+        pipeline->Bind(commandBuffer, pass);
+        pipeline->PushConstants(commandBuffer, &constants);
+        pipeline->Dispatch(commandBuffer, groupCountX, groupCountY);
+        srcLevel += mipCount;
+    }
+
+    // Make the written levels readable by fragment shaders.
+    barriers[1].oldLayout     = VK_IMAGE_LAYOUT_GENERAL;
+    barriers[1].newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barriers[1]);
+}
+
+void MipGenerator::RecordBlitMips(const VkCommandBuffer& commandBuffer, const VkImage& image, const uint32_t& width, const uint32_t& height,
+                                  const uint32_t& mipLevels, const VkImageLayout& oldLayout) const
+{
+    // Create a memory barrier used to create mipmaps.
+    VkImageMemoryBarrier barrier{};
+    barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image                           = image;
+    barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount     = 1;
+
+    // Bring every level to the layout the blits write to.
+    if (oldLayout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+    {
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount   = mipLevels;
+        barrier.oldLayout     = oldLayout;
+        barrier.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+    }
+    barrier.subresourceRange.levelCount = 1;
+
+    // Create texture mipmaps.
+    int32_t mipWidth  = (int32_t)width;
+    int32_t mipHeight = (int32_t)height;
+    for (uint32_t i = 1; i < mipLevels; i++)
+    {
+        barrier.subresourceRange.baseMipLevel = i - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkImageBlit blit{};
+        blit.srcOffsets[0] = {0, 0, 0};
+        blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = i - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.dstOffsets[0] = {0, 0, 0};
+        blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = i;
+        blit.dstSubresource.baseArrayLayer = 0;
+        blit.dstSubresource.layerCount = 1;
+
+        vkCmdBlitImage(commandBuffer,
+            image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit, VK_FILTER_LINEAR);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+        if (mipWidth > 1) mipWidth /= 2;
+        if (mipHeight > 1) mipHeight /= 2;
+    }
+
+    barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+}
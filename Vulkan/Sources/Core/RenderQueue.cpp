@@ -0,0 +1,91 @@
+#include "Core/RenderQueue.h"
+#include "Resources/Mesh.h"
+#include "Core/Engine.h"
+#include <cstring>
+#include <numeric>
+using namespace Core;
+using namespace Resources;
+
+// Material slots are indices in the material buffer, so they all fit in the sort keys' material bits.
+static_assert(Engine::MAX_MATERIALS <= 0x10000, "Engine::MAX_MATERIALS must fit in 16 bits.");
+
+void RenderQueue::Clear()
+{
+    items  .clear();
+    order  .clear();
+    batches.clear();
+}
+
+void RenderQueue::Submit(const Mesh& mesh, const Maths::MvpBuffer& matrices, const uint32_t& pipeline, const uint32_t& materialSlot, const uint32_t& meshSlot)
+{
+    // The draw pass is the material's alpha mode, and the view depth of the model's origin is the w component of its clip space position.
+    static_assert(DrawPass::Opaque == MaterialAlphaMode::Opaque && DrawPass::AlphaTested == MaterialAlphaMode::AlphaTested && DrawPass::Blended == MaterialAlphaMode::Blended);
+    const Material* material = mesh.GetMaterial();
+    const uint32_t  pass     = material->GetAlphaMode();
+    const float     depth    = matrices.mvp[3][3];
+    const bool      sorted   = pass == DrawPass::Blended && sortBlended;
+    items.push_back({ MakeSortKey(pass, pipeline, materialSlot, meshSlot, depth, sorted), &mesh, material, matrices });
+}
+
+void RenderQueue::Build()
+{
+    // Sort the items by key so that identical mesh and material pairs are contiguous.
+    order.resize(items.size());
+    std::iota(order.begin(), order.end(), 0);
+    RadixSort();
+
+    // Group contiguous identical pairs into batches, sorted blended items are kept apart to preserve their back-to-front order.
+    batches.clear();
+    for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+    {
+        const DrawItem& item = items[order[i]];
+        if (instancingEnabled && !batches.empty() && batches.back().mesh == item.mesh && batches.back().material == item.material && (GetSortKeyPass(item.sortKey) != DrawPass::Blended || !sortBlended)) {
+            batches.back().instanceCount++;
+            continue;
+        }
+        batches.push_back({ item.mesh, item.material, GetSortKeyPipeline(item.sortKey), i, 1 });
+    }
+}
+
+uint64_t RenderQueue::MakeSortKey(const uint32_t& pass, const uint32_t& pipeline, const uint32_t& materialSlot, const uint32_t& meshSlot, const float& viewDepth, const bool& backToFront)
+{
+    // Positive floats keep their order when compared as integers, keep the 24 most significant bits.
+    uint32_t depthBits = 0;
+    if (viewDepth > 0) {
+        memcpy(&depthBits, &viewDepth, sizeof(float));
+        depthBits >>= 7;
+    }
+
+    // Mesh slots are reused once freed, so they only wrap around with more than 65536 live meshes, which then merely sort less well.
+    const uint64_t state = ((uint64_t)(materialSlot & 0xFFFF) << 16) | (meshSlot & 0xFFFF);
+    const uint64_t key   = ((uint64_t)(pass & 0x3) << 62) | ((uint64_t)(pipeline & 0x3F) << 56);
+    if (backToFront)
+        return key | ((uint64_t)(~depthBits & 0xFFFFFF) << 32) | state;
+    return key | (state << 24) | (depthBits & 0xFFFFFF);
+}
+
+void RenderQueue::RadixSort()
+{
+    // Least significant digit radix sort of the item indices, one byte per pass.
+    if (order.empty()) return;
+    sortScratch.resize(order.size());
+    for (uint32_t shift = 0; shift < 64; shift += 8)
+    {
+        uint32_t counts[256] = { 0 };
+        for (const uint32_t& idx : order)
+            counts[(items[idx].sortKey >> shift) & 0xFF]++;
+
+        // Skip the pass when every key has the same digit.
+        if (counts[(items[order[0]].sortKey >> shift) & 0xFF] == order.size()) continue;
+
+        uint32_t offset = 0;
+        for (uint32_t& count : counts) {
+            const uint32_t digitCount = count;
+            count   = offset;
+            offset += digitCount;
+        }
+        for (const uint32_t& idx : order)
+            sortScratch[counts[(items[idx].sortKey >> shift) & 0xFF]++] = idx;
+        order.swap(sortScratch);
+    }
+}
@@ -1,6 +1,13 @@
 ﻿#include "Core/Renderer.h"
 #include "Core/Application.h"
+#include "Core/UserInterface.h"
 #include "Core/GpuDataManager.h"
+#include "Core/ResidencyManager.h"
+#include "Core/GeometryDefragmenter.h"
+#include "Core/GpuCuller.h"
+#include "Core/LightCuller.h"
+#include "Core/MipGenerator.h"
+#include "Core/WorkerPool.h"
 #include "Core/Logger.h"
 #include "Core/Window.h"
 #include "Resources/Camera.h"
@@ -12,11 +19,32 @@
 #include <GLFW/glfw3.h>
 #include <set>
 #include <array>
+#include <bitset>
 #include <algorithm>
 #include <fstream>
 #include <functional>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <thread>
 using namespace Core;
 using namespace GraphicsUtils;
+using namespace Maths;
+
+// File the pipeline cache is saved to on shutdown and loaded from on startup.
+static constexpr const char* PIPELINE_CACHE_FILENAME = "Resources/pipeline.cache";
+
+// Written before the pipeline cache data to check that it was created by the same device and driver.
+struct PipelineCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+};
+static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x48434350; // "PCCH"
 
 Renderer::Renderer(Application* application, const char* appName, const char* engineName)
 {
@@ -35,6 +63,7 @@ Renderer::Renderer(Application* application, const char* appName, const char* en
     CreateSurface();
     PickPhysicalDevice();
     CreateLogicalDevice();
+    gpuData->UpdateMemoryBudget();
     CreateSwapChain();
     CreateImageViews();
     vkDepthImageFormat = FindSupportedFormat(vkPhysicalDevice,
@@ -44,20 +73,40 @@ Renderer::Renderer(Application* application, const char* appName, const char* en
     );
     CreateRenderPass();
     CreateDescriptorLayoutsAndPools();
+    CreatePipelineCache();
     CreateGraphicsPipeline();
+    CreateDepthPrepassPipeline();
+    CreateCompositePipeline();
     CreateColorResources();
     CreateDepthResources();
+    CreateTransparencyResources();
     CreateFramebuffers();
     CreateCommandPool();
     CreateTextureSampler();
     CreateCommandBuffers();
+    CreateWorkerCommandBuffers();
     CreateSyncObjects();
+    CreateTimestampQueries();
     SetDistanceFogParams(0, 60, 100);
+    residency    = new ResidencyManager(this, gpuData);
+    defragmenter = new GeometryDefragmenter(this, gpuData);
+    culler       = new GpuCuller(this, gpuData);
+    lightCuller  = new LightCuller(this, gpuData);
+    mipGenerator = new MipGenerator(this, gpuData);
 }
 
 Renderer::~Renderer()
 {
     WaitUntilIdle();
+    delete workerPool;
+    delete mipGenerator;
+    delete lightCuller;
+    delete culler;
+    delete defragmenter;
+    delete residency;
+    ReleaseTransparencyReadback();
+    gpuData->FlushDeletions();
+    SavePipelineCache();
     const auto vkDestroyDebugUtilsMessengerEXT = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(vkInstance, "vkDestroyDebugUtilsMessengerEXT");
     
     vkDestroyBuffer(vkDevice, fogParamsBuffer,       nullptr);
@@ -65,13 +114,27 @@ Renderer::~Renderer()
     for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroySemaphore(vkDevice, vkRenderFinishedSemaphores[i], nullptr);
         vkDestroySemaphore(vkDevice, vkImageAvailableSemaphores[i], nullptr);
+        if (vkComputeQueue) vkDestroySemaphore(vkDevice, vkComputeFinishedSemaphores[i], nullptr);
         vkDestroyFence    (vkDevice, vkInFlightFences[i],           nullptr);
     }
     DestroySwapChain();
     DestroyDescriptorLayoutsAndPools();
+    for (const VkCommandPool& workerCommandPool : vkWorkerCommandPools)
+        vkDestroyCommandPool(vkDevice, workerCommandPool, nullptr);
+    for (const VkPipeline& pipelineVariant : vkPipelineVariants)
+        vkDestroyPipeline(vkDevice, pipelineVariant, nullptr);
+    vkDestroyPipeline(vkDevice, vkPrepassPipeline,   nullptr);
+    vkDestroyPipeline(vkDevice, vkCompositePipeline, nullptr);
+    vkDestroyPipelineLayout(vkDevice, vkCompositeLayout, nullptr);
+    if (vkTimestampQueryPool) vkDestroyQueryPool(vkDevice, vkTimestampQueryPool, nullptr);
+    vkDestroyShaderModule          (vkDevice, vkFragShaderModule, nullptr);
+    vkDestroyShaderModule          (vkDevice, vkVertShaderModule, nullptr);
+    for (const VkShaderModule& tessModule : vkTessModules)
+        if (tessModule) vkDestroyShaderModule(vkDevice, tessModule, nullptr);
     vkDestroySampler               (vkDevice, vkTextureSampler,   nullptr);
     vkDestroyCommandPool           (vkDevice, vkCommandPool,      nullptr);
-    vkDestroyPipeline              (vkDevice, vkGraphicsPipeline, nullptr);
+    if (vkComputeCommandPool) vkDestroyCommandPool(vkDevice, vkComputeCommandPool, nullptr);
+    vkDestroyPipelineCache         (vkDevice, vkPipelineCache,    nullptr);
     vkDestroyPipelineLayout        (vkDevice, vkPipelineLayout,   nullptr);
     vkDestroyRenderPass            (vkDevice, vkRenderPass,       nullptr);
     vkDestroyDevice                (vkDevice,                     nullptr);
@@ -82,7 +145,14 @@ Renderer::~Renderer()
 
 template<ShaderStage S> void Renderer::SetShaderFrameConstants(const ShaderFrameConstants<S>& constants)
 {
-    vkCmdPushConstants(GetCurVkCommandBuffer(), GetVkPipelineLayout(), ShaderStageToFlagBits(S), 0, sizeof(ShaderFrameConstants<S>), &constants);
+    // Keep the constants to push them in each command buffer that records draws.
+    const uint8_t* data = (const uint8_t*)&constants;
+    for (auto& [stage, stageData] : frameConstants) {
+        if (stage != S) continue;
+        stageData.assign(data, data + sizeof(ShaderFrameConstants<S>));
+        return;
+    }
+    frameConstants.emplace_back(S, std::vector<uint8_t>(data, data + sizeof(ShaderFrameConstants<S>)));
 }
 template void Renderer::SetShaderFrameConstants(const ShaderFrameConstants<ShaderStage::Vertex>&);
 template void Renderer::SetShaderFrameConstants(const ShaderFrameConstants<ShaderStage::TessellationControl>&);
@@ -148,42 +218,385 @@ void Renderer::SetDistanceFogParams(const Maths::RGB& color, const float& start,
 void Renderer::BeginRender()
 {
     NewFrame();
-    BeginRenderPass();
+    gpuData->UpdateMemoryBudget();
+    UpdateTransparencyBenchmark();
+    if (oitRequested != oitEnabled)
+        RecreateRenderPass();
+
+    // Copy the last frame drawn with sorted blending, the one recorded before the benchmark switches methods, and the first one drawn after the switch.
+    TransparencyBenchmark& benchmark = transparencyBenchmark;
+    const bool lastSortedFrame = !oitEnabled && benchmark.remainingFrames == 1 && benchmark.skippedFrames == 0;
+    benchmark.captureFrame = benchmark.readbackBuffer && (lastSortedFrame || (oitEnabled && benchmark.captured[0] && !benchmark.captured[1]))
+                          && benchmark.captureExtent.width == vkSwapChainWidth && benchmark.captureExtent.height == vkSwapChainHeight;
+    renderQueue.Clear();
+    UpdateLightFeatures();
+    if (tessellationSupported)
+        SetShaderFrameConstants<ShaderStage::TessellationControl>({ { (float)vkSwapChainWidth, (float)vkSwapChainHeight }, tessellationEdgeLength });
+    BeginCommandBuffer();
+    residency->Update(vkCommandBuffers[currentFrame]);
+    defragmenter->Update(vkCommandBuffers[currentFrame]);
+}
+
+void Renderer::DrawModel(const Resources::Model& model, const Resources::Camera& camera)
+{
+    DrawModel(model, camera, model.transform.GetLocalMat());
+}
+
+void Renderer::DrawModel(const Resources::Model& model, const Resources::Camera& camera, const Maths::Mat4& localMat)
+{
+    // Submit each of the model's meshes to the render queue.
+    const Maths::MvpBuffer matrices = { localMat, localMat * camera.GetViewMat() * camera.GetProjMat() };
+    for (const Resources::Mesh& mesh : model.GetMeshes())
+        DrawMesh(mesh, matrices);
+}
+
+void Renderer::DrawMesh(const Resources::Mesh& mesh, const Maths::MvpBuffer& matrices)
+{
+    const Resources::Material* material = mesh.GetMaterial();
+    if (!material) return;
+
+    // Sort by the material's slot in the material buffer and the mesh's slot in the GPU data table, which are dense and unique while they exist.
+    const GpuData<Resources::Material>* materialData = gpuData->GetData(gpuData->GetHandle(*material));
+    const uint32_t materialSlot = materialData ? materialData->index : 0;
+    renderQueue.Submit(mesh, matrices, GetPipelineVariant(*material), materialSlot, gpuData->GetHandle(mesh).index);
 }
 
-void Renderer::DrawModel(const Resources::Model& model, const Resources::Camera& camera) const
+uint32_t Renderer::GetPipelineVariant(const Resources::Material& material)
 {
-    // Get the light array as well as the model's GPU data and update it.
-    const GpuArray<Resources::Light>& lightArray = gpuData->GetArray<Resources::Light>();
-    const GpuData <Resources::Model>* modelData  = gpuData->GetData(model);
-    if (!modelData) return;
-    model.UpdateMvpBuffer(camera, currentFrame, modelData);
-
-    // Draw each of the model's meshes one by one.
-    const std::vector<Resources::Mesh>& meshes = model.GetMeshes();
-    for (const Resources::Mesh& mesh : meshes)
+    using namespace Resources;
+
+    // Enable the features of the material's textures and alpha mode, along with the scene's light types.
+    const uint32_t alphaMode = material.GetAlphaMode();
+    uint32_t shaderFeatures = ShaderFeature::All;
+    if (shaderPermutationsEnabled)
+    {
+        shaderFeatures = frameLightFeatures | (alphaMode != MaterialAlphaMode::Opaque ? ShaderFeature::AlphaTest : 0);
+        for (size_t i = 0; i < MaterialTextureType::COUNT; i++)
+            if (material.textures[i]) shaderFeatures |= 1u << i;
+    }
+    if (tessellationEnabled && tessellationSupported && material.textures[MaterialTextureType::Depth])
+        shaderFeatures |= ShaderFeature::Tessellation;
+
+    // Set the pipeline state of the alpha mode, only opaque materials are drawn in the depth pre-pass since the others' depth depends on their fragment shader.
+    // Tessellated materials are left out of it too, since it doesn't displace them.
+    switch (alphaMode)
+    {
+    case MaterialAlphaMode::Opaque:
+        if (depthPrepassEnabled && !(shaderFeatures & ShaderFeature::Tessellation)) shaderFeatures |= ShaderFeature::DepthPrepass;
+        break;
+    case MaterialAlphaMode::AlphaTested:
+        if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) shaderFeatures |= ShaderFeature::AlphaToCoverage;
+        break;
+    default:
+        shaderFeatures |= ShaderFeature::Blending | (oitEnabled ? ShaderFeature::OrderIndependent : 0);
+        break;
+    }
+
+    // Reuse the variant if it was already created.
+    const auto it = pipelineVariantIndices.find(shaderFeatures);
+    if (it != pipelineVariantIndices.end()) return it->second;
+
+    // Once the specialized variants run out, use the closest variant with the same pipeline state, preferably one that has all the material's features.
+    // If there is none, the reserved variants make room for one with all shader features for that pipeline state.
+    if (vkPipelineVariants.size() >= MAX_PIPELINE_VARIANTS - RESERVED_PIPELINE_VARIANTS)
     {
-        // Get the mesh and material GPU data.
-        const GpuData<Resources::Mesh>*     meshData     = gpuData->GetData(mesh);
-        const GpuData<Resources::Material>* materialData = gpuData->GetData(*mesh.GetMaterial());
+        if (gpuData->IssueWarning(GpuWarning::PipelineVariants))
+            LogWarning(LogType::Vulkan, "Too many pipeline variants, the remaining materials are drawn with the closest variant of the same pipeline state.");
+        const uint32_t closestIdx     = FindClosestPipelineVariant(shaderFeatures);
+        const bool     hasAllFeatures = closestIdx != UINT32_MAX && (shaderFeatures & ~pipelineVariantFeatures[closestIdx]) == 0;
+        if (hasAllFeatures || vkPipelineVariants.size() >= MAX_PIPELINE_VARIANTS)
+            return closestIdx != UINT32_MAX ? closestIdx : 0;
+        shaderFeatures = (shaderFeatures & ShaderFeature::PipelineState) | ShaderFeature::All;
+    }
+
+    // Create the variant, the pipeline cache makes this fast once it has been created in a previous run.
+    const auto creationStart = std::chrono::high_resolution_clock::now();
+    const uint32_t variantIdx = (uint32_t)vkPipelineVariants.size();
+    vkPipelineVariants     .push_back(CreatePipelineVariant(shaderFeatures));
+    pipelineVariantFeatures.push_back(shaderFeatures);
+    pipelineVariantIndices[shaderFeatures] = variantIdx;
+    const std::chrono::duration<float, std::milli> creationTime = std::chrono::high_resolution_clock::now() - creationStart;
+    char featuresStr[9];
+    snprintf(featuresStr, sizeof(featuresStr), "%05x", shaderFeatures);
+    LogInfo(LogType::Vulkan, "Created pipeline variant " + std::to_string(variantIdx) + " for shader features 0x" + featuresStr + " in " + std::to_string(creationTime.count()) + "ms.");
+    return variantIdx;
+}
+
+uint32_t Renderer::FindClosestPipelineVariant(const uint32_t& shaderFeatures) const
+{
+    // Only shader features can differ, missing ones change how the material looks while extra ones only cost performance.
+    uint32_t closestIdx = UINT32_MAX, closestDistance = UINT32_MAX;
+    for (uint32_t i = 0; i < (uint32_t)pipelineVariantFeatures.size(); i++)
+    {
+        const uint32_t features = pipelineVariantFeatures[i];
+        if ((features & ShaderFeature::PipelineState) != (shaderFeatures & ShaderFeature::PipelineState))
+            continue;
+        const uint32_t distance = (uint32_t)std::bitset<32>(shaderFeatures & ~features).count() * 32 + (uint32_t)std::bitset<32>(features & ~shaderFeatures).count();
+        if (distance < closestDistance) {
+            closestIdx      = i;
+            closestDistance = distance;
+        }
+    }
+    return closestIdx;
+}
+
+void Renderer::UpdateLightFeatures()
+{
+    // The frame's lights aren't written yet, so use the light features written along with the previous frame's lights.
+    const uint32_t previousFrame = (currentFrame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+    frameLightFeatures = gpuData->GetArray<Resources::Light>().GetFrameParams(previousFrame)->lightFeatures;
+}
+
+void Renderer::DrawRenderQueue()
+{
+    const auto recordStart = std::chrono::high_resolution_clock::now();
+    renderStats = { (uint32_t)renderQueue.GetItemCount() };
+    renderStats.gpuTime = gpuTime;
+    
+    // Get this frame's regions of the instance data, visible instances and commands ring buffers.
+    const GpuArray<Resources::Model>& modelArray = gpuData->GetArray<Resources::Model>();
+    InstanceData*                 const frameInstances = (InstanceData*)((char*)modelArray.vkBufferMapped + modelArray.vkFrameSize * currentFrame);
+    uint32_t*                     const frameVisible   = (uint32_t*)modelArray.vkVisibleBufferMapped + modelArray.capacity * currentFrame;
+    VkDrawIndexedIndirectCommand* const frameCommands  = (VkDrawIndexedIndirectCommand*)modelArray.vkDrawBufferMapped + modelArray.capacity * currentFrame;
+
+    // In indirect mode, the instances can be culled on the GPU, which then fills in the commands' instance counts.
+    // The previous culling results of this frame's buffers are complete since the frame's fence has signaled.
+    const bool indirect = indirectDrawEnabled && indirectDrawSupported;
+    const bool culling  = indirect && culler->IsEnabled();
+    CullInstance* const frameCullInstances = culler->GetFrameInstances(currentFrame);
+    culler->ReadBackCounters(currentFrame);
+
+    // Sort the queue and write one command per group of identical mesh and material pairs.
+    renderQueue.Build();
+    queuedDraws.clear();
+    uint32_t instanceCount = 0;
+    if (renderQueue.GetItemCount() <= modelArray.capacity)
+        gpuData->ResetWarning(GpuWarning::InstanceCount);
+    for (const DrawBatch& batch : renderQueue.GetBatches())
+    {
+        // Make sure there is room left in this frame's region of the ring buffers.
+        if (instanceCount + batch.instanceCount > modelArray.capacity) {
+            if (gpuData->IssueWarning(GpuWarning::InstanceCount))
+                LogWarning(LogType::Vulkan, "Too many mesh instances drawn in a single frame, increase Engine::MAX_INSTANCES.");
+            break;
+        }
+        
+        // Get the mesh and material GPU data, evicted meshes are skipped until they are re-uploaded for the next frame.
+        if (!residency->MarkUsed(*batch.mesh)) continue;
+        const GpuData<Resources::Mesh>*     meshData     = gpuData->GetData(*batch.mesh);
+        const GpuData<Resources::Material>* materialData = gpuData->GetData(*batch.material);
         if (!meshData || !materialData) continue;
+
+        // Write the instance matrices and material index to the ring buffer, along with their bounds when culling or their own index otherwise.
+        const uint32_t commandIdx = (uint32_t)queuedDraws.size();
+        for (uint32_t i = 0; i < batch.instanceCount; i++)
+        {
+            frameInstances[instanceCount + i] = { renderQueue.GetItem(batch.firstItem + i).matrices, materialData->index };
+            if (culling) frameCullInstances[instanceCount + i] = { batch.mesh->GetBoundsCenter(), batch.mesh->GetBoundsRadius(), commandIdx };
+            else         frameVisible      [instanceCount + i] = instanceCount + i;
+        }
+
+        // Write the command that draws the mesh instances from the mesh's range of its geometry buffers.
+        frameCommands[commandIdx] = { meshData->indexRange.count, culling ? 0 : batch.instanceCount, meshData->indexRange.offset, (int32_t)meshData->vertexRange.offset, instanceCount };
+        const bool depthPrepass = (pipelineVariantFeatures[batch.pipeline] & ShaderFeature::DepthPrepass) != 0;
+        queuedDraws.push_back({ vkPipelineVariants[batch.pipeline], meshData->vkPositionBuffer, meshData->vkAttributeBuffer, meshData->vkIndexBuffer, depthPrepass });
+        instanceCount += batch.instanceCount;
+    }
+    renderQueue.Clear();
+
+    // Cull the instances before the render pass begins.
+    if (culling) {
+        culler->RecordCulling(vkCommandBuffers[currentFrame], currentFrame, instanceCount);
+        renderStats.visibleInstances = culler->GetVisibleCount();
+        renderStats.culledInstances  = culler->GetCulledCount();
+    }
+    else {
+        renderStats.visibleInstances = instanceCount;
+    }
+
+    // Bin the lights into clusters before the render pass begins, or on the async compute queue so that it overlaps the graphics work until the fragment shaders.
+    if (IsAsyncComputeEnabled())
+        lightCuller->RecordCulling(GetAsyncComputeCommandBuffer(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT), currentFrame, true);
+    else
+        lightCuller->RecordCulling(vkCommandBuffers[currentFrame], currentFrame);
+
+    // Record the draws on this thread, or split them across workers that each record a secondary command buffer.
+    const uint32_t drawCount   = (uint32_t)queuedDraws.size();
+    const uint32_t workerCount = parallelRecordingEnabled ? std::min(recordWorkerCount, drawCount / MIN_DRAWS_PER_WORKER) : 0;
+    renderStats.recordThreads = std::max(workerCount, 1u);
+    if (workerCount <= 1)
+    {
+        BeginRenderPass();
+        if (depthPrepassEnabled)
+            RecordDraws(vkCommandBuffers[currentFrame], 0, drawCount, indirect, renderStats, true);
+        RecordDraws(vkCommandBuffers[currentFrame], 0, drawCount, indirect, renderStats);
+        BeginCompositeSubpass();
+    }
+    else
+    {
+        BeginRenderPass(true);
         
-        // Bind the vertex and index buffers.
-        const VkBuffer vertexBuffer = meshData->vkVertexBuffer;
-        const VkBuffer indexBuffer  = meshData->vkIndexBuffer ;
-        constexpr VkDeviceSize vertexOffset = 0;
-        vkCmdBindVertexBuffers(vkCommandBuffers[currentFrame], 0, 1, &vertexBuffer, &vertexOffset);
-        vkCmdBindIndexBuffer  (vkCommandBuffers[currentFrame], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-
-        // Bind the descriptor sets and draw.
-        const VkDescriptorSet descriptorSets[4] = { modelData->vkDescriptorSets[currentFrame], constDataDescriptorSet, materialData->vkDescriptorSet, lightArray.vkDescriptorSet };
-        vkCmdBindDescriptorSets(vkCommandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, vkPipelineLayout, 0, 4, descriptorSets, 0, nullptr);
-        vkCmdDrawIndexed(vkCommandBuffers[currentFrame], mesh.GetIndexCount(), 1, 0, 0, 0);
+        // Each worker resets its own pool and records a contiguous range of draws, so the draw order is kept.
+        const uint32_t drawsPerWorker = (drawCount + workerCount - 1) / workerCount;
+        const auto recordWorker = [this, drawCount, drawsPerWorker, indirect](const uint32_t worker) {
+            const uint32_t        firstDraw     = std::min(drawsPerWorker * worker, drawCount);
+            const uint32_t        workerIdx     = currentFrame * recordWorkerCount + worker;
+            const VkCommandBuffer commandBuffer = vkWorkerCommandBuffers[workerIdx];
+            RenderStats stats;
+            vkResetCommandPool(vkDevice, vkWorkerCommandPools[workerIdx], 0);
+            BeginSecondaryCommandBuffer(commandBuffer);
+            RecordDraws(commandBuffer, firstDraw, std::min(drawsPerWorker, drawCount - firstDraw), indirect, stats);
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+                throw std::runtime_error("VULKAN_RECORD_COMMAND_BUFFER_ERROR");
+            return stats;
+        };
+        std::vector<std::future<RenderStats>> workers;
+        for (uint32_t worker = 1; worker < workerCount; worker++)
+            workers.push_back(workerPool->Submit([recordWorker, worker] { return recordWorker(worker); }));
+        std::vector<RenderStats> workerStats = { recordWorker(0) };
+
+        // The depth pre-pass is recorded by this thread while the other workers record their draws, and executed before all of them.
+        if (depthPrepassEnabled)
+        {
+            BeginSecondaryCommandBuffer(vkPrepassCommandBuffers[currentFrame]);
+            RecordDraws(vkPrepassCommandBuffers[currentFrame], 0, drawCount, indirect, renderStats, true);
+            if (vkEndCommandBuffer(vkPrepassCommandBuffers[currentFrame]) != VK_SUCCESS) {
+                LogError(LogType::Vulkan, "Failed to record depth pre-pass command buffer.");
+                throw std::runtime_error("VULKAN_RECORD_COMMAND_BUFFER_ERROR");
+            }
+            vkCmdExecuteCommands(vkCommandBuffers[currentFrame], 1, &vkPrepassCommandBuffers[currentFrame]);
+        }
+        for (std::future<RenderStats>& worker : workers)
+            workerStats.push_back(worker.get());
+        for (const RenderStats& stats : workerStats) {
+            renderStats.drawCalls += stats.drawCalls;
+            renderStats.bindCalls += stats.bindCalls;
+        }
+        vkCmdExecuteCommands(vkCommandBuffers[currentFrame], workerCount, &vkWorkerCommandBuffers[currentFrame * recordWorkerCount]);
+        BeginCompositeSubpass(true);
     }
+
+    const std::chrono::duration<float, std::milli> recordTime = std::chrono::high_resolution_clock::now() - recordStart;
+    renderStats.recordTime = recordTime.count();
+}
+
+void Renderer::RecordDraws(const VkCommandBuffer& commandBuffer, const uint32_t& firstDraw, const uint32_t& drawCount, const bool& indirect, RenderStats& stats, const bool& depthPrepass) const
+{
+    const GpuArray<Resources::Light>&    lightArray    = gpuData->GetArray<Resources::Light>();
+    const GpuArray<Resources::Model>&    modelArray    = gpuData->GetArray<Resources::Model>();
+    const GpuArray<Resources::Material>& materialArray = gpuData->GetArray<Resources::Material>();
+    const VkDrawIndexedIndirectCommand* frameCommands = (VkDrawIndexedIndirectCommand*)modelArray.vkDrawBufferMapped + modelArray.capacity * currentFrame;
+    
+    // Push the frame constants, since secondary command buffers don't inherit them.
+    for (const auto& [stage, data] : frameConstants) {
+        const uint32_t offset = stage == ShaderStage::TessellationControl ? TESSELLATION_CONSTANTS_OFFSET : 0;
+        vkCmdPushConstants(commandBuffer, vkPipelineLayout, ShaderStageToFlagBits(stage), offset, (uint32_t)data.size(), data.data());
+    }
+
+    // Set the viewport.
+    VkViewport viewport{};
+    viewport.x        = 0.0f;
+    viewport.y        = 0.0f;
+    viewport.width    = (float)vkSwapChainWidth;
+    viewport.height   = (float)vkSwapChainHeight;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    // Set the scissor.
+    VkRect2D scissor{};
+    scissor.offset = { 0, 0 };
+    scissor.extent = { vkSwapChainWidth, vkSwapChainHeight };
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    // Bind the descriptor sets shared by all draws, with the dynamic offsets of this frame's instance data, visible instances, lights and light clusters.
+    // Materials are read from the bindless material set with each instance's material index, so they don't need binds of their own.
+    const VkDescriptorSet sharedSets[4] = { modelArray.vkDescriptorSet, constDataDescriptorSet, materialArray.vkDescriptorSet, lightArray.vkDescriptorSet };
+    const uint32_t dynamicOffsets[5] = {
+        (uint32_t)(modelArray.vkFrameSize * currentFrame), (uint32_t)(sizeof(uint32_t) * modelArray.capacity * currentFrame),
+        (uint32_t)(lightArray.vkFrameSize * currentFrame), (uint32_t)(lightArray.vkParamsStride * currentFrame), (uint32_t)(lightArray.vkClusterFrameSize * currentFrame),
+    };
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkPipelineLayout, 0, 4, sharedSets, 5, dynamicOffsets);
+
+    // Bind each draw's pipeline and buffers if they changed, and in indirect mode submit the pending commands each time they change.
+    // The depth pre-pass draws its opaque draws with the depth only pipeline and skips the others.
+    uint32_t   firstPendingCommand = firstDraw;
+    VkPipeline boundPipeline       = nullptr;
+    VkBuffer   boundVertexBuffer   = nullptr; // Position buffer, the attribute buffer always changes along with it.
+    for (uint32_t commandIdx = firstDraw; commandIdx < firstDraw + drawCount; commandIdx++)
+    {
+        const QueuedDraw& draw     = queuedDraws[commandIdx];
+        const VkPipeline  pipeline = depthPrepass ? vkPrepassPipeline : draw.pipeline;
+        if (depthPrepass && !draw.depthPrepass)
+        {
+            if (indirect)
+                SubmitIndirectDraws(commandBuffer, firstPendingCommand, commandIdx - firstPendingCommand, stats);
+            firstPendingCommand = commandIdx + 1;
+            continue;
+        }
+        
+        // Submit the pending indirect draws before the bound state changes.
+        const bool stateChanged = pipeline != boundPipeline || draw.positionBuffer != boundVertexBuffer;
+        if (indirect && stateChanged) {
+            SubmitIndirectDraws(commandBuffer, firstPendingCommand, commandIdx - firstPendingCommand, stats);
+            firstPendingCommand = commandIdx;
+        }
+
+        // Bind the pipeline variant if it changed.
+        if (pipeline != boundPipeline)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            boundPipeline = pipeline;
+            stats.bindCalls++;
+        }
+        
+        // Bind the vertex and index buffers if they changed, the depth pre-pass only binds the position stream.
+        if (draw.positionBuffer != boundVertexBuffer)
+        {
+            const VkBuffer     vertexBuffers[2] = { draw.positionBuffer, draw.attributeBuffer };
+            const VkDeviceSize vertexOffsets[2] = { 0, 0 };
+            vkCmdBindVertexBuffers(commandBuffer, 0, depthPrepass ? 1 : 2, vertexBuffers, vertexOffsets);
+            vkCmdBindIndexBuffer  (commandBuffer, draw.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+            boundVertexBuffer = draw.positionBuffer;
+            stats.bindCalls++;
+        }
+
+        // Draw directly from the written command when not in indirect mode.
+        if (!indirect) {
+            const VkDrawIndexedIndirectCommand& command = frameCommands[commandIdx];
+            vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+            stats.drawCalls++;
+        }
+    }
+    if (indirect)
+        SubmitIndirectDraws(commandBuffer, firstPendingCommand, firstDraw + drawCount - firstPendingCommand, stats);
+}
+
+void Renderer::SubmitIndirectDraws(const VkCommandBuffer& commandBuffer, const uint32_t& firstCommand, const uint32_t& commandCount, RenderStats& stats) const
+{
+    if (commandCount == 0) return;
+    
+    // Submit all the commands at once if the device supports it, or one by one otherwise.
+    const GpuArray<Resources::Model>& modelArray = gpuData->GetArray<Resources::Model>();
+    constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceSize offset = (VkDeviceSize)stride * (modelArray.capacity * currentFrame + firstCommand);
+    if (multiDrawSupported) {
+        vkCmdDrawIndexedIndirect(commandBuffer, modelArray.vkDrawBuffer, offset, commandCount, stride);
+        stats.drawCalls++;
+        return;
+    }
+    for (uint32_t i = 0; i < commandCount; i++)
+        vkCmdDrawIndexedIndirect(commandBuffer, modelArray.vkDrawBuffer, offset + (VkDeviceSize)stride * i, 1, stride);
+    stats.drawCalls += commandCount;
 }
 
 void Renderer::EndRender()
 {
+    // Begin the render pass if the render queue wasn't drawn this frame.
+    if (!renderPassActive) {
+        BeginRenderPass();
+        BeginCompositeSubpass();
+    }
     EndRenderPass();
     PresentFrame();
 }
@@ -365,7 +778,9 @@ void Renderer::CreateLogicalDevice()
 
     // Set creation information for all required queues.
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    const std::set<uint32_t> uniqueQueueFamilies = { vkQueueFamilyIndices.graphicsFamily.value(), vkQueueFamilyIndices.presentFamily.value() };
+    std::set<uint32_t> uniqueQueueFamilies = { vkQueueFamilyIndices.graphicsFamily.value(), vkQueueFamilyIndices.presentFamily.value() };
+    if (vkQueueFamilyIndices.computeFamily.has_value())
+        uniqueQueueFamilies.insert(vkQueueFamilyIndices.computeFamily.value());
     for (const uint32_t& queueFamily : uniqueQueueFamilies)
     {
         const float queuePriority = 1.0f;
@@ -383,15 +798,39 @@ void Renderer::CreateLogicalDevice()
     deviceFeatures.sampleRateShading = VK_TRUE;
     deviceFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
 
+    // Enable indirect draws when the first instance of each command can be used to index instance data.
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(vkPhysicalDevice, &supportedFeatures);
+    deviceFeatures.multiDrawIndirect         = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    indirectDrawSupported = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+    multiDrawSupported    = supportedFeatures.multiDrawIndirect         == VK_TRUE;
+
+    // Enable tessellation for the depth map displacement variants.
+    deviceFeatures.tessellationShader = supportedFeatures.tessellationShader;
+    tessellationSupported = supportedFeatures.tessellationShader == VK_TRUE;
+
+    // Enable indexing of storage image arrays for the mip generation shader, which writes every level through one array.
+    deviceFeatures.shaderStorageImageArrayDynamicIndexing = supportedFeatures.shaderStorageImageArrayDynamicIndexing;
+    computeMipsSupported = supportedFeatures.shaderStorageImageArrayDynamicIndexing == VK_TRUE;
+
+    // Enable independent blending for order independent transparency, which blends each of the scene sub-pass' color targets differently.
+    deviceFeatures.independentBlend = supportedFeatures.independentBlend;
+    oitSupported = supportedFeatures.independentBlend == VK_TRUE;
+
     // Enable null descriptors.
     VkPhysicalDeviceRobustness2FeaturesEXT deviceRobustnessFeatures{};
     deviceRobustnessFeatures.sType          = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ROBUSTNESS_2_FEATURES_EXT;
     deviceRobustnessFeatures.nullDescriptor = VK_TRUE;
 
-    // Enable uniform buffer update after bind.
+    // Enable uniform buffer update after bind, and the bindless texture array: partially bound, updated after bind and indexed per instance.
     VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
     indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
     indexingFeatures.descriptorBindingUniformBufferUpdateAfterBind = VK_TRUE;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind  = VK_TRUE;
+    indexingFeatures.descriptorBindingUpdateUnusedWhilePending     = VK_TRUE;
+    indexingFeatures.descriptorBindingPartiallyBound               = VK_TRUE;
+    indexingFeatures.shaderSampledImageArrayNonUniformIndexing     = VK_TRUE;
     indexingFeatures.pNext = &deviceRobustnessFeatures;
 
     // Enable VK 1.3 features
@@ -400,14 +839,24 @@ void Renderer::CreateLogicalDevice()
     features13.shaderDemoteToHelperInvocation = VK_TRUE;
     features13.pNext = &indexingFeatures;
 
+    // Enable the optional extensions supported by the physical device.
+    std::vector<const char*> enabledExtensions = EXTENSIONS;
+    for (const char* extension : OPTIONAL_EXTENSIONS)
+    {
+        if (!CheckDeviceExtensionSupport(vkPhysicalDevice, extension)) continue;
+        enabledExtensions.push_back(extension);
+        if (strcmp(extension, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            memoryBudgetSupported = true;
+    }
+
     // Set the logical device creation information.
     VkDeviceCreateInfo deviceCreateInfo{};
     deviceCreateInfo.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     deviceCreateInfo.queueCreateInfoCount    = (uint32_t)queueCreateInfos.size();
     deviceCreateInfo.pQueueCreateInfos       = queueCreateInfos.data();
     deviceCreateInfo.pEnabledFeatures        = &deviceFeatures;
-    deviceCreateInfo.enabledExtensionCount   = static_cast<uint32_t>(EXTENSIONS.size());
-    deviceCreateInfo.ppEnabledExtensionNames = EXTENSIONS.data();
+    deviceCreateInfo.enabledExtensionCount   = static_cast<uint32_t>(enabledExtensions.size());
+    deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
     deviceCreateInfo.pNext                   = &features13;
     if (VALIDATION_LAYERS_ENABLED) {
         deviceCreateInfo.enabledLayerCount   = static_cast<uint32_t>(VALIDATION_LAYERS.size());
@@ -422,9 +871,13 @@ void Renderer::CreateLogicalDevice()
         throw std::runtime_error("VULKAN_LOGICAL_DEVICE_ERROR");
     }
 
-    // Get the graphics and present queue handles.
+    // Get the graphics and present queue handles, and the async compute queue handle if the device has a compute only family.
     vkGetDeviceQueue(vkDevice, vkQueueFamilyIndices.graphicsFamily.value(), 0, &vkGraphicsQueue);
     vkGetDeviceQueue(vkDevice, vkQueueFamilyIndices.presentFamily .value(), 0, &vkPresentQueue );
+    if (vkQueueFamilyIndices.computeFamily.has_value())
+        vkGetDeviceQueue(vkDevice, vkQueueFamilyIndices.computeFamily.value(), 0, &vkComputeQueue);
+    else
+        LogInfo(LogType::Vulkan, "The device has no compute only queue family, compute work stays on the graphics queue.");
 }
 
 void Renderer::CreateSwapChain()
@@ -457,6 +910,12 @@ void Renderer::CreateSwapChain()
     createInfo.presentMode      = presentMode;
     createInfo.oldSwapchain     = VK_NULL_HANDLE;
 
+    // Swap chain images are copied to compare transparency methods, only 8 bit formats are compared.
+    const std::set<VkFormat> copyFormats = { VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_B8G8R8A8_UNORM };
+    swapChainCopySupported = (swapChainSupport.capabilities->supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) && copyFormats.count(surfaceFormat.format);
+    if (swapChainCopySupported)
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
     // Set the used queue families.
     const QueueFamilyIndices indices = FindQueueFamilies(vkPhysicalDevice, vkSurface);
     const uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
@@ -553,33 +1012,69 @@ void Renderer::CreateRenderPass()
     colorAttachmentResolveRef.attachment = 2;
     colorAttachmentResolveRef.layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-    // Create a single sub-pass.
-    VkSubpassDescription subpass{};
-    subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount    = 1;
-    subpass.pColorAttachments       = &colorAttachmentRef;
-    subpass.pDepthStencilAttachment = &depthAttachmentRef;
-    subpass.pResolveAttachments     = &colorAttachmentResolveRef;
-
-    // Create a sub-pass dependency.
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass    = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass    = 0;
-    dependency.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT          | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    // Set the weighted blended transparency attachments, which are only used within the render pass.
+    VkAttachmentDescription accumAttachment{};
+    accumAttachment.format         = OIT_ACCUM_FORMAT;
+    accumAttachment.samples        = msaaSamples;
+    accumAttachment.loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    accumAttachment.storeOp        = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    accumAttachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    accumAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    accumAttachment.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+    accumAttachment.finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkAttachmentDescription revealAttachment = accumAttachment;
+    revealAttachment.format = OIT_REVEAL_FORMAT;
+    const VkAttachmentReference sceneColorRefs[3] = {
+        colorAttachmentRef,
+        { 3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+        { 4, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+    };
+    const VkAttachmentReference transparencyInputRefs[2] = {
+        { 3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+        { 4, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+    };
+
+    // Create the scene sub-pass, which draws to the color and transparency targets.
+    // The composite sub-pass then reads the transparency targets, blends them over the color target and resolves it, the user interface is drawn in it too.
+    // Without order independent transparency, the render pass has no transparency targets and the composite sub-pass only resolves the color target.
+    std::array<VkSubpassDescription, 2> subpasses{};
+    subpasses[0].pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpasses[0].colorAttachmentCount    = oitEnabled ? 3 : 1;
+    subpasses[0].pColorAttachments       = sceneColorRefs;
+    subpasses[0].pDepthStencilAttachment = &depthAttachmentRef;
+    subpasses[1].pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpasses[1].inputAttachmentCount    = oitEnabled ? 2 : 0;
+    subpasses[1].pInputAttachments       = oitEnabled ? transparencyInputRefs : nullptr;
+    subpasses[1].colorAttachmentCount    = 1;
+    subpasses[1].pColorAttachments       = &colorAttachmentRef;
+    subpasses[1].pResolveAttachments     = &colorAttachmentResolveRef;
+
+    // Create the sub-pass dependencies.
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass      = 0;
+    dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask   = 0;
+    dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT          | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].srcSubpass      = 0;
+    dependencies[1].dstSubpass      = 1;
+    dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].dstAccessMask   = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT   | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
     // Set the render pass creation information.
-    const std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
+    const std::array<VkAttachmentDescription, 5> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve, accumAttachment, revealAttachment };
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = (uint32_t)attachments.size();
+    renderPassInfo.attachmentCount = oitEnabled ? (uint32_t)attachments.size() : 3;
     renderPassInfo.pAttachments    = attachments.data();
-    renderPassInfo.subpassCount    = 1;
-    renderPassInfo.pSubpasses      = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies   = &dependency;
+    renderPassInfo.subpassCount    = (uint32_t)subpasses.size();
+    renderPassInfo.pSubpasses      = subpasses.data();
+    renderPassInfo.dependencyCount = (uint32_t)dependencies.size();
+    renderPassInfo.pDependencies   = dependencies.data();
 
     // Create the render pass.
     if (vkCreateRenderPass(vkDevice, &renderPassInfo, nullptr, &vkRenderPass) != VK_SUCCESS) {
@@ -592,6 +1087,7 @@ void Renderer::CreateDescriptorLayoutsAndPools()
 {
     // Create layouts and pools for lights, models and materials.
     gpuData->CreateArray<Resources::Model>();
+    gpuData->CreateArray<Resources::Mesh>();
     gpuData->CreateArray<Resources::Material>();
     gpuData->CreateArray<Resources::Light>();
 
@@ -641,25 +1137,197 @@ void Renderer::CreateDescriptorLayoutsAndPools()
             throw std::runtime_error("VULKAN_DESCRIPTOR_SET_ALLOCATION_ERROR");
         }
     }
+
+    // Create layout, pool and descriptor for the transparency targets, written when they are created.
+    {
+        VkDescriptorSetLayoutBinding layoutBindings[2]{};
+        for (uint32_t i = 0; i < 2; i++) {
+            layoutBindings[i].binding         = i;
+            layoutBindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            layoutBindings[i].descriptorCount = 1;
+            layoutBindings[i].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+        }
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 2;
+        layoutInfo.pBindings    = layoutBindings;
+        if (vkCreateDescriptorSetLayout(vkDevice, &layoutInfo, nullptr, &oitDescriptorLayout) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
+        }
+
+        VkDescriptorPoolSize poolSize;
+        poolSize.type            = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        poolSize.descriptorCount = 2;
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes    = &poolSize;
+        poolInfo.maxSets       = 1;
+        if (vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &oitDescriptorPool) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to create descriptor pool.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_POOL_ERROR");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool     = oitDescriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts        = &oitDescriptorLayout;
+        if (vkAllocateDescriptorSets(vkDevice, &allocInfo, &oitDescriptorSet) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to allocate descriptor sets.");
+            throw std::runtime_error("VULKAN_DESCRIPTOR_SET_ALLOCATION_ERROR");
+        }
+    }
+}
+
+void Renderer::CreatePipelineCache()
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkPhysicalDevice, &properties);
+
+    // Read the cache file and only keep its data if it was saved by the same device and driver.
+    std::vector<char> cacheData;
+    if (std::ifstream f(PIPELINE_CACHE_FILENAME, std::ios::binary); f.is_open())
+    {
+        PipelineCacheFileHeader header{};
+        f.read((char*)&header, sizeof(header));
+        const bool valid = f.good()
+                        && header.magic         == PIPELINE_CACHE_MAGIC
+                        && header.vendorID      == properties.vendorID
+                        && header.deviceID      == properties.deviceID
+                        && header.driverVersion == properties.driverVersion
+                        && memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        if (valid) {
+            cacheData.resize((size_t)header.dataSize);
+            f.read(cacheData.data(), (std::streamsize)cacheData.size());
+            if (!f.good()) cacheData.clear();
+        }
+        if (cacheData.empty())
+            LogInfo(LogType::Vulkan, "Discarding pipeline cache created by another device or driver.");
+    }
+
+    // Create the pipeline cache, filled with the file's data if it was valid.
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = cacheData.size();
+    cacheInfo.pInitialData    = cacheData.data();
+    if (vkCreatePipelineCache(vkDevice, &cacheInfo, nullptr, &vkPipelineCache) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, "Failed to create pipeline cache.");
+        throw std::runtime_error("VULKAN_PIPELINE_CACHE_ERROR");
+    }
+    pipelineCacheWarm = !cacheData.empty();
+}
+
+void Renderer::SavePipelineCache() const
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkPhysicalDevice, &properties);
+
+    // Get the pipeline cache data.
+    size_t dataSize = 0;
+    vkGetPipelineCacheData(vkDevice, vkPipelineCache, &dataSize, nullptr);
+    std::vector<char> cacheData(dataSize);
+    if (dataSize == 0 || vkGetPipelineCacheData(vkDevice, vkPipelineCache, &dataSize, cacheData.data()) != VK_SUCCESS)
+        return;
+
+    // Write it to the cache file after the header that identifies the device and driver.
+    PipelineCacheFileHeader header{};
+    header.magic         = PIPELINE_CACHE_MAGIC;
+    header.vendorID      = properties.vendorID;
+    header.deviceID      = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    header.dataSize      = dataSize;
+    memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    std::ofstream f(PIPELINE_CACHE_FILENAME, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) {
+        LogWarning(LogType::FileIO, std::string("Failed to save pipeline cache to ") + PIPELINE_CACHE_FILENAME);
+        return;
+    }
+    f.write((const char*)&header, sizeof(header));
+    f.write(cacheData.data(), (std::streamsize)dataSize);
 }
 
 void Renderer::CreateGraphicsPipeline()
+{
+    const auto creationStart = std::chrono::high_resolution_clock::now();
+
+    // Load vulkan fragment and vertex shaders, they are kept to create pipeline variants.
+    const std::vector<VkShaderModule> shaderModules = CreateShaderModules(vkDevice, {
+        { ShaderStage::Vertex,   "Shaders/MainVert.hlsl" },
+        { ShaderStage::Fragment, "Shaders/MainFrag.hlsl", LightCuller::GetShaderDefines() },
+    });
+    vkVertShaderModule = shaderModules[0];
+    vkFragShaderModule = shaderModules[1];
+
+    // Load the shaders of tessellated variants if the device supports them, the evaluation shader samples depth maps from the bindless textures.
+    if (tessellationSupported)
+    {
+        const std::vector<VkShaderModule> tessModules = CreateShaderModules(vkDevice, {
+            { ShaderStage::Vertex,                 "Shaders/TessVert.hlsl" },
+            { ShaderStage::TessellationControl,    "Shaders/TessControl.hlsl" },
+            { ShaderStage::TessellationEvaluation, "Shaders/TessEval.hlsl", LightCuller::GetShaderDefines() },
+        });
+        std::copy(tessModules.begin(), tessModules.end(), vkTessModules);
+    }
+
+    // Define the push constants (viewPos, then the screen size and edge length of tessellated variants) and 4 descriptor set layouts (model, fog, material, lights).
+    const VkPushConstantRange pushConstantRanges[2] = {
+        { VK_SHADER_STAGE_FRAGMENT_BIT,             0,                             sizeof(ShaderFrameConstants<ShaderStage::Fragment>) },
+        { VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, TESSELLATION_CONSTANTS_OFFSET, sizeof(ShaderFrameConstants<ShaderStage::TessellationControl>) },
+    };
+    const VkDescriptorSetLayout setLayouts[4] = {
+        gpuData->GetArray<Resources::Model>().vkDescriptorSetLayout,
+        constDataDescriptorLayout,
+        gpuData->GetArray<Resources::Material>().vkDescriptorSetLayout,
+        gpuData->GetArray<Resources::Light>().vkDescriptorSetLayout,
+    };
+
+    // Set the pipeline layout creation information.
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount         = 4;
+    pipelineLayoutInfo.pSetLayouts            = setLayouts;
+    pipelineLayoutInfo.pushConstantRangeCount = tessellationSupported ? 2 : 1;
+    pipelineLayoutInfo.pPushConstantRanges    = pushConstantRanges;
+
+    // Create the pipeline layout.
+    if (vkCreatePipelineLayout(vkDevice, &pipelineLayoutInfo, nullptr, &vkPipelineLayout) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, "Failed to create pipeline layout.");
+        throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+    }
+
+    // Create the variant with all the shader features, the others are created when a material first needs them.
+    vkPipelineVariants     .push_back(CreatePipelineVariant(ShaderFeature::All));
+    pipelineVariantFeatures.push_back(ShaderFeature::All);
+    pipelineVariantIndices[ShaderFeature::All] = 0;
+
+    // Log the creation time to compare cold and warm pipeline caches.
+    const std::chrono::duration<float, std::milli> creationTime = std::chrono::high_resolution_clock::now() - creationStart;
+    LogInfo(LogType::Vulkan, "Created graphics pipeline in " + std::to_string(creationTime.count()) + "ms with a " + (pipelineCacheWarm ? "warm" : "cold") + " pipeline cache.");
+}
+
+VkPipeline Renderer::CreatePipelineVariant(const uint32_t& shaderFeatures) const
 {
     // Setup vertex bindings and attributes.
-    auto bindingDescription    = Resources::Mesh::GetVertexBindingDescription();
+    auto bindingDescriptions   = Resources::Mesh::GetVertexBindingDescriptions();
     auto attributeDescriptions = Resources::Mesh::GetVertexAttributeDescriptions();
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount   = 1;
+    vertexInputInfo.vertexBindingDescriptionCount   = (uint32_t)bindingDescriptions.size();
     vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t)attributeDescriptions.size();
-    vertexInputInfo.pVertexBindingDescriptions      = &bindingDescription;
+    vertexInputInfo.pVertexBindingDescriptions      = bindingDescriptions.data();
     vertexInputInfo.pVertexAttributeDescriptions    = attributeDescriptions.data();
 
-    // Specify the kind of geometry to be drawn.
+    // Specify the kind of geometry to be drawn, tessellated variants draw each triangle as a patch of 3 control points.
+    const bool tessellation = (shaderFeatures & ShaderFeature::Tessellation) != 0;
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssembly.topology               = tessellation ? VK_PRIMITIVE_TOPOLOGY_PATCH_LIST : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     inputAssembly.primitiveRestartEnable = VK_FALSE;
+    VkPipelineTessellationStateCreateInfo tessellationState{};
+    tessellationState.sType              = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+    tessellationState.patchControlPoints = 3;
 
     // Specify the scissor rectangle (pixels outside it will be discarded).
     VkRect2D scissor{};
@@ -694,12 +1362,14 @@ void Renderer::CreateGraphicsPipeline()
     rasterizer.depthBiasClamp          = 0.f; // Optional.
     rasterizer.depthBiasSlopeFactor    = 0.f; // Optional.
 
-    // Depth and stencil buffer parameters.
+    // Depth and stencil buffer parameters, depth is only tested for equality if it was written by the depth pre-pass and isn't written by blended draws.
+    const bool depthPrepass = (shaderFeatures & ShaderFeature::DepthPrepass) != 0;
+    const bool blending     = (shaderFeatures & ShaderFeature::Blending)     != 0;
     VkPipelineDepthStencilStateCreateInfo depthStencil{};
     depthStencil.sType                 = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencil.depthTestEnable       = VK_TRUE;
-    depthStencil.depthWriteEnable      = VK_TRUE;
-    depthStencil.depthCompareOp        = VK_COMPARE_OP_LESS;
+    depthStencil.depthWriteEnable      = depthPrepass || blending ? VK_FALSE : VK_TRUE;
+    depthStencil.depthCompareOp        = depthPrepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
     depthStencil.depthBoundsTestEnable = VK_FALSE;
     depthStencil.minDepthBounds        = 0.f; // Optional.
     depthStencil.maxDepthBounds        = 1.f; // Optional.
@@ -707,26 +1377,43 @@ void Renderer::CreateGraphicsPipeline()
     depthStencil.front                 = {}; // Optional.
     depthStencil.back                  = {}; // Optional.
 
-    // Load vulkan fragment and vertex shaders.
-    VkShaderModule vertShaderModule = CreateShaderModule(vkDevice, ShaderStage::Vertex,   "Shaders/MainVert.hlsl");
-    VkShaderModule fragShaderModule = CreateShaderModule(vkDevice, ShaderStage::Fragment, "Shaders/MainFrag.hlsl");
-
     // Set the vertex shader's pipeline stage and entry point.
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vertShaderStageInfo.stage  = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.module = tessellation ? vkTessModules[0] : vkVertShaderModule;
     vertShaderStageInfo.pName  = "main";
 
-    // Set the fragment shader's pipeline stage and entry point.
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
+    // Specialize the fragment shader for the given features, so that the branches of the others are compiled out.
+    const VkSpecializationMapEntry specializationEntry = { 0, 0, sizeof(uint32_t) };
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = 1;
+    specializationInfo.pMapEntries   = &specializationEntry;
+    specializationInfo.dataSize      = sizeof(uint32_t);
+    specializationInfo.pData         = &shaderFeatures;
 
-    // Create an array of both pipeline stage info structures.
-    VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+    // Set the fragment shader's pipeline stage, entry point and specialization.
+    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+    fragShaderStageInfo.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragShaderStageInfo.stage               = VK_SHADER_STAGE_FRAGMENT_BIT;
+    fragShaderStageInfo.module              = vkFragShaderModule;
+    fragShaderStageInfo.pName               = "main";
+    fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
+    // Set the tessellation control and evaluation shaders' pipeline stages and entry points.
+    VkPipelineShaderStageCreateInfo tessControlStageInfo{};
+    tessControlStageInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    tessControlStageInfo.stage  = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    tessControlStageInfo.module = vkTessModules[1];
+    tessControlStageInfo.pName  = "main";
+    VkPipelineShaderStageCreateInfo tessEvalStageInfo{};
+    tessEvalStageInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    tessEvalStageInfo.stage  = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    tessEvalStageInfo.module = vkTessModules[2];
+    tessEvalStageInfo.pName  = "main";
+
+    // Create an array of the pipeline stage info structures, the tessellation stages are only used by tessellated variants.
+    VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo, tessControlStageInfo, tessEvalStageInfo };
 
     // Set multisampling parameters.
     VkPipelineMultisampleStateCreateInfo multisampling{};
@@ -735,62 +1422,65 @@ void Renderer::CreateGraphicsPipeline()
     multisampling.sampleShadingEnable   = VK_TRUE;
     multisampling.minSampleShading      = .2f;
     multisampling.pSampleMask           = nullptr;  // Optional.
-    multisampling.alphaToCoverageEnable = VK_FALSE; // Optional.
+    multisampling.alphaToCoverageEnable = (shaderFeatures & ShaderFeature::AlphaToCoverage) ? VK_TRUE : VK_FALSE;
     multisampling.alphaToOneEnable      = VK_FALSE; // Optional.
 
-    // Set color blending parameters for current framebuffer (alpha blending enabled).
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask      = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable         = VK_TRUE;
+    // Set color blending parameters for current framebuffer (alpha blending enabled for blended materials only).
+    // Order independent variants only write to the transparency targets: accumulation adds up, and revealage is multiplied by each surface's transmittance.
+    const bool orderIndependent = (shaderFeatures & ShaderFeature::OrderIndependent) != 0;
+    VkPipelineColorBlendAttachmentState colorBlendAttachments[3]{};
+    VkPipelineColorBlendAttachmentState& colorBlendAttachment = colorBlendAttachments[0];
+    colorBlendAttachment.colorWriteMask      = orderIndependent ? 0 : VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable         = blending && !orderIndependent ? VK_TRUE : VK_FALSE;
     colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
     colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
     colorBlendAttachment.colorBlendOp        = VK_BLEND_OP_ADD;
     colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
     colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
     colorBlendAttachment.alphaBlendOp        = VK_BLEND_OP_ADD;
+    if (orderIndependent)
+    {
+        VkPipelineColorBlendAttachmentState& accumBlendAttachment = colorBlendAttachments[1];
+        accumBlendAttachment.colorWriteMask      = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        accumBlendAttachment.blendEnable         = VK_TRUE;
+        accumBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        accumBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        accumBlendAttachment.colorBlendOp        = VK_BLEND_OP_ADD;
+        accumBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        accumBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        accumBlendAttachment.alphaBlendOp        = VK_BLEND_OP_ADD;
+
+        VkPipelineColorBlendAttachmentState& revealBlendAttachment = colorBlendAttachments[2];
+        revealBlendAttachment.colorWriteMask      = VK_COLOR_COMPONENT_R_BIT;
+        revealBlendAttachment.blendEnable         = VK_TRUE;
+        revealBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+        revealBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
+        revealBlendAttachment.colorBlendOp        = VK_BLEND_OP_ADD;
+        revealBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        revealBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        revealBlendAttachment.alphaBlendOp        = VK_BLEND_OP_ADD;
+    }
 
     // Set color blending parameters for all framebuffers.
     VkPipelineColorBlendStateCreateInfo colorBlending{};
     colorBlending.sType             = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     colorBlending.logicOpEnable     = VK_FALSE;
     colorBlending.logicOp           = VK_LOGIC_OP_COPY; // Optional.
-    colorBlending.attachmentCount   = 1;
-    colorBlending.pAttachments      = &colorBlendAttachment;
+    colorBlending.attachmentCount   = oitEnabled ? 3 : 1;
+    colorBlending.pAttachments      = colorBlendAttachments;
     colorBlending.blendConstants[0] = 0.f; // Optional.
     colorBlending.blendConstants[1] = 0.f; // Optional.
     colorBlending.blendConstants[2] = 0.f; // Optional.
     colorBlending.blendConstants[3] = 0.f; // Optional.
 
-    // Define 1 push constant (viewPos) and 3 descriptor set layouts (model, material, lights).
-    const VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(Maths::Vector3) };
-    const VkDescriptorSetLayout setLayouts[4] = {
-        gpuData->GetArray<Resources::Model>().vkDescriptorSetLayout,
-        constDataDescriptorLayout,
-        gpuData->GetArray<Resources::Material>().vkDescriptorSetLayout,
-        gpuData->GetArray<Resources::Light>().vkDescriptorSetLayout,
-    };
-
-    // Set the pipeline layout creation information.
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount         = 4;
-    pipelineLayoutInfo.pSetLayouts            = setLayouts;
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges    = &pushConstantRange;
-
-    // Create the pipeline layout.
-    if (vkCreatePipelineLayout(vkDevice, &pipelineLayoutInfo, nullptr, &vkPipelineLayout) != VK_SUCCESS) {
-        LogError(LogType::Vulkan, "Failed to create pipeline layout.");
-        throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
-    }
-
     // Set the graphics pipeline creation information.
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount          = 2;
+    pipelineInfo.stageCount          = tessellation ? 4 : 2;
     pipelineInfo.pStages             = shaderStages;
     pipelineInfo.pVertexInputState   = &vertexInputInfo;
     pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pTessellationState  = tessellation ? &tessellationState : nullptr;
     pipelineInfo.pViewportState      = &viewportState;
     pipelineInfo.pRasterizationState = &rasterizer;
     pipelineInfo.pMultisampleState   = &multisampling;
@@ -802,21 +1492,190 @@ void Renderer::CreateGraphicsPipeline()
     pipelineInfo.subpass             = 0;
 
     // Create the graphics pipeline.
-    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &vkGraphicsPipeline) != VK_SUCCESS) {
+    VkPipeline pipeline = nullptr;
+    if (vkCreateGraphicsPipelines(vkDevice, vkPipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
         LogError(LogType::Vulkan, "Failed to create graphics pipeline.");
         throw std::runtime_error("VULKAN_GRAPHICS_PIPELINE_ERROR");
     }
+    return pipeline;
+}
+
+void Renderer::CreateDepthPrepassPipeline()
+{
+    // Load the depth only vertex shader, the pre-pass has no fragment shader.
+    const VkShaderModule vertShaderModule = CreateShaderModule(vkDevice, ShaderStage::Vertex, "Shaders/DepthVert.hlsl");
+    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+    vertShaderStageInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertShaderStageInfo.stage  = VK_SHADER_STAGE_VERTEX_BIT;
+    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.pName  = "main";
+
+    // Only bind the position stream.
+    auto bindingDescriptions   = Resources::Mesh::GetVertexBindingDescriptions();
+    auto attributeDescriptions = Resources::Mesh::GetVertexAttributeDescriptions();
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount   = 1;
+    vertexInputInfo.vertexAttributeDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions      = &bindingDescriptions[0];
+    vertexInputInfo.pVertexAttributeDescriptions    = &attributeDescriptions[0];
+
+    // Use the same geometry, viewport and rasterizer states as the main pipeline variants.
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    const VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates    = dynamicStates;
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount  = 1;
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType       = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth   = 1.f;
+    rasterizer.cullMode    = VK_CULL_MODE_BACK_BIT;
+    rasterizer.frontFace   = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = msaaSamples;
 
-    // Destroy both shader modules.
-    vkDestroyShaderModule(vkDevice, fragShaderModule, nullptr);
+    // Write depth without writing to any of the scene sub-pass' color targets.
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType            = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable  = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp   = VK_COMPARE_OP_LESS;
+    const VkPipelineColorBlendAttachmentState colorBlendAttachments[3]{};
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType           = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = oitEnabled ? 3 : 1;
+    colorBlending.pAttachments    = colorBlendAttachments;
+
+    // Create the pipeline with the main pipeline layout, so that the descriptor sets bound for the draws stay valid.
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount          = 1;
+    pipelineInfo.pStages             = &vertShaderStageInfo;
+    pipelineInfo.pVertexInputState   = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState      = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState   = &multisampling;
+    pipelineInfo.pDepthStencilState  = &depthStencil;
+    pipelineInfo.pColorBlendState    = &colorBlending;
+    pipelineInfo.pDynamicState       = &dynamicState;
+    pipelineInfo.layout              = vkPipelineLayout;
+    pipelineInfo.renderPass          = vkRenderPass;
+    pipelineInfo.subpass             = 0;
+    if (vkCreateGraphicsPipelines(vkDevice, vkPipelineCache, 1, &pipelineInfo, nullptr, &vkPrepassPipeline) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, "Failed to create depth pre-pass pipeline.");
+        throw std::runtime_error("VULKAN_GRAPHICS_PIPELINE_ERROR");
+    }
     vkDestroyShaderModule(vkDevice, vertShaderModule, nullptr);
 }
 
+void Renderer::CreateCompositePipeline()
+{
+    // Create the pipeline layout, with the transparency targets as its only descriptor set.
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts    = &oitDescriptorLayout;
+    if (vkCreatePipelineLayout(vkDevice, &pipelineLayoutInfo, nullptr, &vkCompositeLayout) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, "Failed to create composite pipeline layout.");
+        throw std::runtime_error("VULKAN_PIPELINE_LAYOUT_ERROR");
+    }
+
+    // The pipeline is only created for render passes with transparency targets.
+    if (!oitEnabled) return;
+
+    // Load the fullscreen triangle and composite shaders, which read the transparency targets per sample when multisampling.
+    std::vector<std::string> fragDefines;
+    if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) fragDefines.emplace_back("MSAA 1");
+    const std::vector<VkShaderModule> shaderModules = CreateShaderModules(vkDevice, {
+        { ShaderStage::Vertex,   "Shaders/CompositeVert.hlsl" },
+        { ShaderStage::Fragment, "Shaders/CompositeFrag.hlsl", fragDefines },
+    });
+    VkPipelineShaderStageCreateInfo shaderStages[2]{};
+    for (uint32_t i = 0; i < 2; i++) {
+        shaderStages[i].sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[i].stage  = i == 0 ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+        shaderStages[i].module = shaderModules[i];
+        shaderStages[i].pName  = "main";
+    }
+
+    // The triangle is generated from vertex indices and drawn without depth.
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    const VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates    = dynamicStates;
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount  = 1;
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType       = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth   = 1.f;
+    rasterizer.cullMode    = VK_CULL_MODE_NONE;
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = msaaSamples;
+
+    // Blend the average transparent color over the color target, weighted by how much of the surfaces behind is hidden.
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask      = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable         = VK_TRUE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp        = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.alphaBlendOp        = VK_BLEND_OP_ADD;
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType           = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments    = &colorBlendAttachment;
+
+    // Create the pipeline in the composite sub-pass.
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount          = 2;
+    pipelineInfo.pStages             = shaderStages;
+    pipelineInfo.pVertexInputState   = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState      = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState   = &multisampling;
+    pipelineInfo.pColorBlendState    = &colorBlending;
+    pipelineInfo.pDynamicState       = &dynamicState;
+    pipelineInfo.layout              = vkCompositeLayout;
+    pipelineInfo.renderPass          = vkRenderPass;
+    pipelineInfo.subpass             = 1;
+    if (vkCreateGraphicsPipelines(vkDevice, vkPipelineCache, 1, &pipelineInfo, nullptr, &vkCompositePipeline) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, "Failed to create composite pipeline.");
+        throw std::runtime_error("VULKAN_GRAPHICS_PIPELINE_ERROR");
+    }
+    for (const VkShaderModule& shaderModule : shaderModules)
+        vkDestroyShaderModule(vkDevice, shaderModule, nullptr);
+}
+
 void Renderer::CreateColorResources()
 {
     // Create the color image and image view.
     CreateImage(vkDevice, vkPhysicalDevice, vkSwapChainWidth, vkSwapChainHeight, 1, msaaSamples, vkSwapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkColorImage, vkColorImageMemory);
     CreateImageView(vkDevice, vkColorImage, vkSwapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, vkColorImageView);
+    gpuData->TrackMemory(GpuMemoryCategory::RenderTargets, GetImageMemorySize(vkDevice, vkColorImage));
 }
 
 void Renderer::CreateDepthResources()
@@ -824,6 +1683,32 @@ void Renderer::CreateDepthResources()
     // Create the depth image and image view.
     CreateImage(vkDevice, vkPhysicalDevice, vkSwapChainWidth, vkSwapChainHeight, 1, msaaSamples, vkDepthImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkDepthImage, vkDepthImageMemory);
     CreateImageView(vkDevice, vkDepthImage, vkDepthImageFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, vkDepthImageView);
+    gpuData->TrackMemory(GpuMemoryCategory::RenderTargets, GetImageMemorySize(vkDevice, vkDepthImage));
+}
+
+void Renderer::CreateTransparencyResources()
+{
+    // Create the accumulation and revealage images and image views, they only live in tile memory on devices that support it.
+    if (!oitEnabled) return;
+    constexpr VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+    CreateImage(vkDevice, vkPhysicalDevice, vkSwapChainWidth, vkSwapChainHeight, 1, msaaSamples, OIT_ACCUM_FORMAT,  VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkAccumImage,  vkAccumImageMemory);
+    CreateImage(vkDevice, vkPhysicalDevice, vkSwapChainWidth, vkSwapChainHeight, 1, msaaSamples, OIT_REVEAL_FORMAT, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkRevealImage, vkRevealImageMemory);
+    CreateImageView(vkDevice, vkAccumImage,  OIT_ACCUM_FORMAT,  VK_IMAGE_ASPECT_COLOR_BIT, 1, vkAccumImageView);
+    CreateImageView(vkDevice, vkRevealImage, OIT_REVEAL_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, 1, vkRevealImageView);
+    gpuData->TrackMemory(GpuMemoryCategory::RenderTargets, GetImageMemorySize(vkDevice, vkAccumImage) + GetImageMemorySize(vkDevice, vkRevealImage), 2);
+
+    // Point the composite's input attachments to the new image views.
+    VkDescriptorImageInfo imageInfos[2]{};
+    imageInfos[0] = { nullptr, vkAccumImageView,  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    imageInfos[1] = { nullptr, vkRevealImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet          = oitDescriptorSet;
+    descriptorWrite.dstBinding      = 0;
+    descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    descriptorWrite.descriptorCount = 2;
+    descriptorWrite.pImageInfo      = imageInfos;
+    vkUpdateDescriptorSets(vkDevice, 1, &descriptorWrite, 0, nullptr);
 }
 
 void Renderer::CreateFramebuffers()
@@ -832,17 +1717,19 @@ void Renderer::CreateFramebuffers()
 
     for (size_t i = 0; i < vkSwapChainImageViews.size(); i++)
     {
-        std::array<VkImageView, 3> attachments = {
+        std::array<VkImageView, 5> attachments = {
             vkColorImageView,
             vkDepthImageView,
-            vkSwapChainImageViews[i]
+            vkSwapChainImageViews[i],
+            vkAccumImageView,
+            vkRevealImageView
         };
         
-        // Create the current framebuffer creation information.
+        // Create the current framebuffer creation information, the transparency targets are left out when they aren't enabled.
         VkFramebufferCreateInfo framebufferInfo{};
         framebufferInfo.sType           = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass      = vkRenderPass;
-        framebufferInfo.attachmentCount = (uint32_t)attachments.size();
+        framebufferInfo.attachmentCount = oitEnabled ? (uint32_t)attachments.size() : 3;
         framebufferInfo.pAttachments    = attachments.data();
         framebufferInfo.width           = vkSwapChainWidth;
         framebufferInfo.height          = vkSwapChainHeight;
@@ -871,6 +1758,14 @@ void Renderer::CreateCommandPool()
         LogError(LogType::Vulkan, "Failed to create command pool.");
         throw std::runtime_error("VULKAN_COMMAND_POOL_ERROR");
     }
+
+    // Create the async compute command pool.
+    if (!vkComputeQueue) return;
+    poolInfo.queueFamilyIndex = vkQueueFamilyIndices.computeFamily.value();
+    if (vkCreateCommandPool(vkDevice, &poolInfo, nullptr, &vkComputeCommandPool) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, "Failed to create async compute command pool.");
+        throw std::runtime_error("VULKAN_COMMAND_POOL_ERROR");
+    }
 }
 
 void Renderer::CreateTextureSampler()
@@ -915,13 +1810,68 @@ void Renderer::CreateCommandBuffers()
         LogError(LogType::Vulkan, "Failed to allocate command buffers.");
         throw std::runtime_error("VULKAN_COMMAND_BUFFER_ERROR");
     }
+
+    // Allocate the async compute command buffers.
+    if (!vkComputeQueue) return;
+    allocInfo.commandPool = vkComputeCommandPool;
+    vkComputeCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    if (vkAllocateCommandBuffers(vkDevice, &allocInfo, vkComputeCommandBuffers.data()) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, "Failed to allocate async compute command buffers.");
+        throw std::runtime_error("VULKAN_COMMAND_BUFFER_ERROR");
+    }
+}
+
+void Renderer::CreateWorkerCommandBuffers()
+{
+    // Allocate the secondary command buffers recorded before and after parallel draws.
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool        = vkCommandPool;
+    allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+    vkOverlayCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    vkPrepassCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    if (vkAllocateCommandBuffers(vkDevice, &allocInfo, vkOverlayCommandBuffers.data()) != VK_SUCCESS ||
+        vkAllocateCommandBuffers(vkDevice, &allocInfo, vkPrepassCommandBuffers.data()) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, "Failed to allocate command buffers.");
+        throw std::runtime_error("VULKAN_COMMAND_BUFFER_ERROR");
+    }
+    
+    // Command pools must only be used by one thread at a time, so each worker has its own pool for each frame in flight.
+    recordWorkerCount = std::clamp(std::thread::hardware_concurrency(), 1u, MAX_RECORD_WORKERS);
+    vkWorkerCommandPools  .resize(recordWorkerCount * MAX_FRAMES_IN_FLIGHT);
+    vkWorkerCommandBuffers.resize(recordWorkerCount * MAX_FRAMES_IN_FLIGHT);
+    for (size_t i = 0; i < vkWorkerCommandPools.size(); i++)
+    {
+        // Create the worker's command pool, it is reset as a whole each frame.
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = vkQueueFamilyIndices.graphicsFamily.value();
+        if (vkCreateCommandPool(vkDevice, &poolInfo, nullptr, &vkWorkerCommandPools[i]) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to create command pool.");
+            throw std::runtime_error("VULKAN_COMMAND_POOL_ERROR");
+        }
+
+        // Allocate the worker's secondary command buffer.
+        allocInfo.commandPool        = vkWorkerCommandPools[i];
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(vkDevice, &allocInfo, &vkWorkerCommandBuffers[i]) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to allocate command buffers.");
+            throw std::runtime_error("VULKAN_COMMAND_BUFFER_ERROR");
+        }
+    }
+
+    // The first worker is the main thread, the others are kept alive to record each frame without creating threads.
+    workerPool = new WorkerPool(recordWorkerCount - 1);
 }
 
 void Renderer::CreateSyncObjects()
 {
-    vkImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    vkRenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    vkInFlightFences          .resize(MAX_FRAMES_IN_FLIGHT);
+    vkImageAvailableSemaphores .resize(MAX_FRAMES_IN_FLIGHT);
+    vkRenderFinishedSemaphores .resize(MAX_FRAMES_IN_FLIGHT);
+    vkComputeFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    vkInFlightFences           .resize(MAX_FRAMES_IN_FLIGHT);
     
     // Set the semaphore and fence creation information.
     VkSemaphoreCreateInfo semaphoreInfo{};
@@ -940,6 +1890,33 @@ void Renderer::CreateSyncObjects()
             LogError(LogType::Vulkan, "Failed to create semaphores and fence.");
             throw std::runtime_error("VULKAN_SYNC_OBJECTS_ERROR");
         }
+        if (vkComputeQueue && vkCreateSemaphore(vkDevice, &semaphoreInfo, nullptr, &vkComputeFinishedSemaphores[i]) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to create async compute semaphore.");
+            throw std::runtime_error("VULKAN_SYNC_OBJECTS_ERROR");
+        }
+    }
+}
+
+void Renderer::CreateTimestampQueries()
+{
+    // Timestamps are optional, the render pass GPU time just isn't measured without them.
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkPhysicalDevice, &properties);
+    timestampsSupported = properties.limits.timestampComputeAndGraphics == VK_TRUE;
+    timestampPeriod     = properties.limits.timestampPeriod;
+    if (!timestampsSupported) {
+        LogWarning(LogType::Vulkan, "Timestamp queries are not supported, the render pass GPU time won't be measured.");
+        return;
+    }
+
+    // Create a pool with a begin and end timestamp for each frame in flight.
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = 2 * MAX_FRAMES_IN_FLIGHT;
+    if (vkCreateQueryPool(vkDevice, &poolInfo, nullptr, &vkTimestampQueryPool) != VK_SUCCESS) {
+        LogError(LogType::Vulkan, "Failed to create timestamp query pool.");
+        throw std::runtime_error("VULKAN_QUERY_POOL_ERROR");
     }
 }
 #pragma endregion
@@ -954,11 +1931,48 @@ void Renderer::RecreateSwapChain()
     CreateImageViews();
     CreateColorResources();
     CreateDepthResources();
+    CreateTransparencyResources();
+    CreateFramebuffers();
+}
+
+void Renderer::RecreateRenderPass()
+{
+    // Framebuffers and pipelines are only compatible with render passes that have the same attachments, so they are recreated along with it.
+    WaitUntilIdle();
+    oitEnabled = oitRequested;
+    renderQueue.SetBlendedSortingEnabled(!oitEnabled);
+    for (const VkFramebuffer& vkSwapChainFramebuffer : vkSwapChainFramebuffers)
+        vkDestroyFramebuffer(vkDevice, vkSwapChainFramebuffer, nullptr);
+    for (const VkPipeline& pipelineVariant : vkPipelineVariants)
+        vkDestroyPipeline(vkDevice, pipelineVariant, nullptr);
+    vkPipelineVariants     .clear();
+    pipelineVariantFeatures.clear();
+    pipelineVariantIndices .clear();
+    vkDestroyPipeline      (vkDevice, vkPrepassPipeline,   nullptr);
+    vkDestroyPipeline      (vkDevice, vkCompositePipeline, nullptr);
+    vkDestroyPipelineLayout(vkDevice, vkCompositeLayout,   nullptr);
+    vkCompositePipeline = nullptr;
+    DestroyTransparencyResources();
+    vkDestroyRenderPass(vkDevice, vkRenderPass, nullptr);
+
+    // The other variants are recreated when a material first needs them, from the pipeline cache.
+    CreateRenderPass();
+    vkPipelineVariants     .push_back(CreatePipelineVariant(ShaderFeature::All));
+    pipelineVariantFeatures.push_back(ShaderFeature::All);
+    pipelineVariantIndices[ShaderFeature::All] = 0;
+    CreateDepthPrepassPipeline();
+    CreateCompositePipeline();
+    CreateTransparencyResources();
     CreateFramebuffers();
+
+    // The user interface is drawn in the composite sub-pass, so its pipeline is recreated too.
+    app->GetUi()->RecreateRenderPassObjects();
 }
 
-void Renderer::DestroySwapChain() const
+void Renderer::DestroySwapChain()
 {
+    gpuData->UntrackMemory(GpuMemoryCategory::RenderTargets, GetImageMemorySize(vkDevice, vkColorImage) + GetImageMemorySize(vkDevice, vkDepthImage), 2);
+    DestroyTransparencyResources();
     for (const VkFramebuffer& vkSwapChainFramebuffer : vkSwapChainFramebuffers)
         vkDestroyFramebuffer(vkDevice, vkSwapChainFramebuffer, nullptr);
     for (const VkImageView& vkSwapChainImageView : vkSwapChainImageViews)
@@ -972,14 +1986,35 @@ void Renderer::DestroySwapChain() const
     vkDestroySwapchainKHR (vkDevice, vkSwapChain,              nullptr);
 }
 
+void Renderer::DestroyTransparencyResources()
+{
+    if (!vkAccumImage) return;
+    gpuData->UntrackMemory(GpuMemoryCategory::RenderTargets, GetImageMemorySize(vkDevice, vkAccumImage) + GetImageMemorySize(vkDevice, vkRevealImage), 2);
+    vkDestroyImageView(vkDevice, vkAccumImageView,    nullptr);
+    vkDestroyImage    (vkDevice, vkAccumImage,        nullptr);
+    vkFreeMemory      (vkDevice, vkAccumImageMemory,  nullptr);
+    vkDestroyImageView(vkDevice, vkRevealImageView,   nullptr);
+    vkDestroyImage    (vkDevice, vkRevealImage,       nullptr);
+    vkFreeMemory      (vkDevice, vkRevealImageMemory, nullptr);
+    vkAccumImage        = nullptr;
+    vkAccumImageMemory  = nullptr;
+    vkAccumImageView    = nullptr;
+    vkRevealImage       = nullptr;
+    vkRevealImageMemory = nullptr;
+    vkRevealImageView   = nullptr;
+}
+
 void Renderer::DestroyDescriptorLayoutsAndPools() const
 {
     gpuData->DestroyArray<Resources::Model>();
+    gpuData->DestroyArray<Resources::Mesh>();
     gpuData->DestroyArray<Resources::Material>();
     gpuData->DestroyArray<Resources::Light>();
 
     if (constDataDescriptorLayout) vkDestroyDescriptorSetLayout(vkDevice, constDataDescriptorLayout, nullptr);
     if (constDataDescriptorPool)   vkDestroyDescriptorPool     (vkDevice, constDataDescriptorPool,   nullptr);
+    if (oitDescriptorLayout)       vkDestroyDescriptorSetLayout(vkDevice, oitDescriptorLayout,       nullptr);
+    if (oitDescriptorPool)         vkDestroyDescriptorPool     (vkDevice, oitDescriptorPool,         nullptr);
 }
 #pragma endregion 
 
@@ -989,6 +2024,10 @@ void Renderer::NewFrame()
     // Wait for the previous frame to finish.
     vkWaitForFences(vkDevice, 1, &vkInFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
 
+    // Destroy the resources that are no longer used by any frame in flight.
+    gpuData->RetireDeletions(frameIndex);
+    ReadBackTimestamps();
+
     // Acquire an image from the swap chain.
     const VkResult result = vkAcquireNextImageKHR(vkDevice, vkSwapChain, UINT64_MAX, vkImageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &vkSwapChainImageIndex);
 
@@ -1006,7 +2045,177 @@ void Renderer::NewFrame()
     vkResetFences(vkDevice, 1, &vkInFlightFences[currentFrame]);
 }
 
-void Renderer::BeginRenderPass() const
+void Renderer::ReadBackTimestamps()
+{
+    if (!timestampsWritten[currentFrame]) return;
+    timestampsWritten[currentFrame] = false;
+
+    // The frame's fence has signaled, so its timestamps are available.
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(vkDevice, vkTimestampQueryPool, currentFrame * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+        gpuTime = (float)(timestamps[1] - timestamps[0]) * timestampPeriod / 1e6f;
+}
+
+void Renderer::BenchmarkTransparency(const uint32_t& frameCount)
+{
+    if (!timestampsSupported || !oitSupported) {
+        LogWarning(LogType::Vulkan, "Transparency can't be benchmarked without timestamps and order independent transparency.");
+        return;
+    }
+
+    // Start with sorted blending, the selected method is restored once both are measured.
+    ReleaseTransparencyReadback();
+    transparencyBenchmark = {};
+    transparencyBenchmark.frameCount      = std::max(frameCount, 1u);
+    transparencyBenchmark.remainingFrames = transparencyBenchmark.frameCount;
+    transparencyBenchmark.skippedFrames   = MAX_FRAMES_IN_FLIGHT;
+    transparencyBenchmark.restoreOit      = oitRequested;
+    SetOrderIndependentTransparencyEnabled(false);
+
+    // Create the buffer that both images are copied to, in the swap chain's format.
+    if (!swapChainCopySupported) {
+        LogWarning(LogType::Vulkan, "Swap chain images can't be copied, the transparency methods' images won't be compared.");
+        return;
+    }
+    const VkDeviceSize imageSize = (VkDeviceSize)vkSwapChainWidth * vkSwapChainHeight * 4;
+    transparencyBenchmark.captureExtent = { vkSwapChainWidth, vkSwapChainHeight };
+    CreateBuffer(vkDevice, vkPhysicalDevice, imageSize * 2, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 transparencyBenchmark.readbackBuffer, transparencyBenchmark.readbackBufferMemory);
+    gpuData->TrackMemory(GpuMemoryCategory::RenderTargets, GetBufferMemorySize(vkDevice, transparencyBenchmark.readbackBuffer));
+}
+
+void Renderer::UpdateTransparencyBenchmark()
+{
+    TransparencyBenchmark& benchmark = transparencyBenchmark;
+    if (benchmark.remainingFrames == 0) return;
+
+    // The timestamps read back lag behind by the frames in flight, so the ones drawn before the last switch are skipped.
+    if (benchmark.skippedFrames > 0) {
+        benchmark.skippedFrames--;
+        return;
+    }
+    benchmark.totalTimes[oitEnabled ? 1 : 0] += gpuTime;
+    if (--benchmark.remainingFrames > 0) return;
+
+    // Measure order independent transparency once sorted blending is done.
+    if (!oitEnabled) {
+        benchmark.remainingFrames = benchmark.frameCount;
+        benchmark.skippedFrames   = MAX_FRAMES_IN_FLIGHT;
+        SetOrderIndependentTransparencyEnabled(true);
+        return;
+    }
+
+    // Log the average times along with the memory of the transparency targets, which are only allocated for order independent transparency.
+    const VkDeviceSize targetBytes = GetImageMemorySize(vkDevice, vkAccumImage) + GetImageMemorySize(vkDevice, vkRevealImage);
+    LogInfo(LogType::Vulkan, "Transparency benchmark over " + std::to_string(benchmark.frameCount) + " frames each: "
+            + "sorted blending " + std::to_string(benchmark.totalTimes[0] / (float)benchmark.frameCount) + "ms, "
+            + "order independent " + std::to_string(benchmark.totalTimes[1] / (float)benchmark.frameCount) + "ms of render pass GPU time, "
+            + "with " + std::to_string(targetBytes >> 20) + "MB of transparency targets.");
+    SetOrderIndependentTransparencyEnabled(benchmark.restoreOit);
+
+    // Both copies were made more than MAX_FRAMES_IN_FLIGHT frames ago, so their frames have completed.
+    if (benchmark.captured[0] && benchmark.captured[1])
+        CompareTransparencyImages();
+    else if (benchmark.readbackBuffer)
+        LogWarning(LogType::Vulkan, "The swap chain was resized during the transparency benchmark, the methods' images weren't compared.");
+    ReleaseTransparencyReadback();
+}
+
+void Renderer::CaptureTransparencyImage()
+{
+    TransparencyBenchmark& benchmark     = transparencyBenchmark;
+    const VkCommandBuffer  commandBuffer = vkCommandBuffers[currentFrame];
+    const VkImage          image         = vkSwapChainImages[vkSwapChainImageIndex];
+    const uint32_t         method        = oitEnabled ? 1 : 0;
+
+    // Wait for the render pass to write the image before copying it.
+    VkImageMemoryBarrier barrier{};
+    barrier.sType                       = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask               = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask               = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout                   = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barrier.newLayout                   = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image                       = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+
+    // Copy the image to the method's half of the readback buffer.
+    VkBufferImageCopy region{};
+    region.bufferOffset                = (VkDeviceSize)method * benchmark.captureExtent.width * benchmark.captureExtent.height * 4;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent                 = { benchmark.captureExtent.width, benchmark.captureExtent.height, 1 };
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, benchmark.readbackBuffer, 1, &region);
+
+    // Give the image back to presentation and make the copy visible to the host.
+    VkMemoryBarrier hostBarrier{};
+    hostBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout     = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+        1, &hostBarrier, 0, nullptr, 1, &barrier);
+    benchmark.captured[method] = true;
+}
+
+void Renderer::CompareTransparencyImages() const
+{
+    const TransparencyBenchmark& benchmark = transparencyBenchmark;
+    const size_t   pixelCount = (size_t)benchmark.captureExtent.width * benchmark.captureExtent.height;
+    const uint8_t* pixels     = nullptr;
+    vkMapMemory(vkDevice, benchmark.readbackBufferMemory, 0, pixelCount * 4 * 2, 0, (void**)&pixels);
+
+    // Compare the color channels in the swap chain's encoding, the alpha channel isn't displayed.
+    const uint8_t* sorted           = pixels;
+    const uint8_t* orderIndependent = pixels + pixelCount * 4;
+    double   squaredErrorSum = 0;
+    uint32_t maxError        = 0;
+    size_t   differentPixels = 0;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        uint32_t pixelError = 0;
+        for (size_t c = 0; c < 3; c++) {
+            const int error = (int)sorted[i * 4 + c] - (int)orderIndependent[i * 4 + c];
+            squaredErrorSum += (double)(error * error);
+            pixelError       = std::max(pixelError, (uint32_t)std::abs(error));
+        }
+        maxError         = std::max(maxError, pixelError);
+        differentPixels += pixelError > 0 ? 1 : 0;
+    }
+    vkUnmapMemory(vkDevice, benchmark.readbackBufferMemory);
+
+    const float rmsError = (float)std::sqrt(squaredErrorSum / (double)(pixelCount * 3)) / 255;
+    const std::string message = "Order independent transparency differs from sorted blending by " + std::to_string(rmsError) + " RMS (threshold "
+                              + std::to_string(OIT_MAX_IMAGE_ERROR) + "), up to " + std::to_string(maxError) + "/255 on "
+                              + std::to_string(differentPixels * 100 / std::max(pixelCount, (size_t)1)) + "% of the pixels.";
+    if (rmsError <= OIT_MAX_IMAGE_ERROR) LogInfo   (LogType::Vulkan, message);
+    else                                 LogWarning(LogType::Vulkan, message);
+}
+
+void Renderer::ReleaseTransparencyReadback()
+{
+    TransparencyBenchmark& benchmark = transparencyBenchmark;
+    if (!benchmark.readbackBuffer) return;
+    gpuData->UntrackMemory(GpuMemoryCategory::RenderTargets, GetBufferMemorySize(vkDevice, benchmark.readbackBuffer));
+    vkDestroyBuffer(vkDevice, benchmark.readbackBuffer,       nullptr);
+    vkFreeMemory   (vkDevice, benchmark.readbackBufferMemory, nullptr);
+    benchmark.readbackBuffer       = VK_NULL_HANDLE;
+    benchmark.readbackBufferMemory = VK_NULL_HANDLE;
+    benchmark.captureFrame         = false;
+}
+
+void Renderer::BeginCommandBuffer() const
 {
     // Reset the command buffer.
     vkResetCommandBuffer(vkCommandBuffers[currentFrame],  0);
@@ -1018,11 +2227,61 @@ void Renderer::BeginRenderPass() const
         LogError(LogType::Vulkan, "Failed to begin recording command buffer.");
         throw std::runtime_error("VULKAN_BEGIN_COMMAND_BUFFER_ERROR");
     }
+}
 
+VkCommandBuffer Renderer::GetAsyncComputeCommandBuffer(const VkPipelineStageFlags& waitStages)
+{
+    // Begin recording the frame's async compute command buffer on first use.
+    // It can be reset since the frame's graphics work, which waited for its last submission, has completed.
+    const VkCommandBuffer commandBuffer = vkComputeCommandBuffers[currentFrame];
+    if (asyncComputeWaitStages == 0)
+    {
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to begin recording async compute command buffer.");
+            throw std::runtime_error("VULKAN_BEGIN_COMMAND_BUFFER_ERROR");
+        }
+    }
+    asyncComputeWaitStages |= waitStages;
+    return commandBuffer;
+}
+
+std::vector<uint32_t> Renderer::GetSharedQueueFamilies() const
+{
+    if (!vkComputeQueue) return {};
+    return { vkQueueFamilyIndices.graphicsFamily.value(), vkQueueFamilyIndices.computeFamily.value() };
+}
+
+void Renderer::BeginSecondaryCommandBuffer(const VkCommandBuffer& commandBuffer, const uint32_t& subpass) const
+{
+    // Secondary command buffers continue the given subpass of the frame's render pass.
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass  = vkRenderPass;
+    inheritanceInfo.subpass     = subpass;
+    inheritanceInfo.framebuffer = vkSwapChainFramebuffers[vkSwapChainImageIndex];
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    // The error isn't logged since this runs on recording workers, it is rethrown on the main thread.
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        throw std::runtime_error("VULKAN_BEGIN_COMMAND_BUFFER_ERROR");
+}
+
+void Renderer::BeginRenderPass(const bool& secondaryContents)
+{
     // Define the clear color.
-    std::array<VkClearValue, 2> clearValues{};
+    // The transparency targets start with no accumulated color and everything behind them revealed.
+    std::array<VkClearValue, 5> clearValues{};
     clearValues[0].color        = {{ 0.0f, 0.0f, 0.0f, 1.0f }};
     clearValues[1].depthStencil = { 1.0f, 0 };
+    clearValues[3].color        = {{ 0.0f, 0.0f, 0.0f, 0.0f }};
+    clearValues[4].color        = {{ 1.0f, 0.0f, 0.0f, 0.0f }};
 
     // Begin the render pass.
     VkRenderPassBeginInfo renderPassInfo{};
@@ -1031,34 +2290,63 @@ void Renderer::BeginRenderPass() const
     renderPassInfo.framebuffer       = vkSwapChainFramebuffers[vkSwapChainImageIndex];
     renderPassInfo.renderArea.offset = { 0, 0 };
     renderPassInfo.renderArea.extent = { vkSwapChainWidth, vkSwapChainHeight };
-    renderPassInfo.clearValueCount   = (uint32_t)clearValues.size();
+    renderPassInfo.clearValueCount   = oitEnabled ? (uint32_t)clearValues.size() : 3;
     renderPassInfo.pClearValues      = clearValues.data();
-    vkCmdBeginRenderPass(vkCommandBuffers[currentFrame], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    // Bind the graphics pipeline.
-    vkCmdBindPipeline(vkCommandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, vkGraphicsPipeline);
 
-    // Set the viewport.
-    VkViewport viewport{};
-    viewport.x        = 0.0f;
-    viewport.y        = 0.0f;
-    viewport.width    = (float)vkSwapChainWidth;
-    viewport.height   = (float)vkSwapChainHeight;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(vkCommandBuffers[currentFrame], 0, 1, &viewport);
+    // Reset the frame's timestamps and write the first one, queries can't be reset inside a render pass.
+    if (timestampsSupported) {
+        vkCmdResetQueryPool(vkCommandBuffers[currentFrame], vkTimestampQueryPool, currentFrame * 2, 2);
+        vkCmdWriteTimestamp(vkCommandBuffers[currentFrame], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vkTimestampQueryPool, currentFrame * 2);
+    }
+    vkCmdBeginRenderPass(vkCommandBuffers[currentFrame], &renderPassInfo, secondaryContents ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    renderPassActive = true;
+}
 
-    // Set the scissor.
-    VkRect2D scissor{};
-    scissor.offset = { 0, 0 };
-    scissor.extent = { vkSwapChainWidth, vkSwapChainHeight };
-    vkCmdSetScissor(vkCommandBuffers[currentFrame], 0, 1, &scissor);
+void Renderer::BeginCompositeSubpass(const bool& secondaryContents)
+{
+    // Move on to the composite subpass, anything recorded after it goes to the overlay command buffer if the draws were recorded in parallel.
+    vkCmdNextSubpass(vkCommandBuffers[currentFrame], secondaryContents ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    if (secondaryContents) {
+        BeginSecondaryCommandBuffer(vkOverlayCommandBuffers[currentFrame], 1);
+        overlayRecording = true;
+    }
+    if (!oitEnabled) return;
+
+    // Composite the transparency targets over the color target with a fullscreen triangle.
+    const VkCommandBuffer commandBuffer = GetCurVkCommandBuffer();
+    const VkViewport viewport = { 0, 0, (float)vkSwapChainWidth, (float)vkSwapChainHeight, 0, 1 };
+    const VkRect2D   scissor  = { { 0, 0 }, { vkSwapChainWidth, vkSwapChainHeight } };
+    vkCmdSetViewport       (commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor        (commandBuffer, 0, 1, &scissor);
+    vkCmdBindPipeline      (commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkCompositePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkCompositeLayout, 0, 1, &oitDescriptorSet, 0, nullptr);
+    vkCmdDraw              (commandBuffer, 3, 1, 0, 0);
 }
 
-void Renderer::EndRenderPass() const
+void Renderer::EndRenderPass()
 {
+    // Execute the overlay command buffer if the draws were recorded in parallel.
+    if (overlayRecording)
+    {
+        if (vkEndCommandBuffer(vkOverlayCommandBuffers[currentFrame]) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to record command buffer.");
+            throw std::runtime_error("VULKAN_RECORD_COMMAND_BUFFER_ERROR");
+        }
+        vkCmdExecuteCommands(vkCommandBuffers[currentFrame], 1, &vkOverlayCommandBuffers[currentFrame]);
+        overlayRecording = false;
+    }
+    
     // End the render pass.
     vkCmdEndRenderPass(vkCommandBuffers[currentFrame]);
+    renderPassActive = false;
+
+    // Write the frame's last timestamp once all the render pass work is done.
+    if (timestampsSupported) {
+        vkCmdWriteTimestamp(vkCommandBuffers[currentFrame], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vkTimestampQueryPool, currentFrame * 2 + 1);
+        timestampsWritten[currentFrame] = true;
+    }
+    if (transparencyBenchmark.captureFrame)
+        CaptureTransparencyImage();
 
     // Stop recording the command buffer.
     if (vkEndCommandBuffer(vkCommandBuffers[currentFrame]) != VK_SUCCESS) {
@@ -1069,13 +2357,35 @@ void Renderer::EndRenderPass() const
 
 void Renderer::PresentFrame()
 {
+    // Submit the frame's async compute work first, the graphics work then waits for it at the stages that read its results.
+    uint32_t waitCount = 1;
+    if (asyncComputeWaitStages != 0)
+    {
+        if (vkEndCommandBuffer(vkComputeCommandBuffers[currentFrame]) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to record async compute command buffer.");
+            throw std::runtime_error("VULKAN_RECORD_COMMAND_BUFFER_ERROR");
+        }
+        VkSubmitInfo computeSubmitInfo{};
+        computeSubmitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        computeSubmitInfo.commandBufferCount   = 1;
+        computeSubmitInfo.pCommandBuffers      = &vkComputeCommandBuffers[currentFrame];
+        computeSubmitInfo.signalSemaphoreCount = 1;
+        computeSubmitInfo.pSignalSemaphores    = &vkComputeFinishedSemaphores[currentFrame];
+        if (vkQueueSubmit(vkComputeQueue, 1, &computeSubmitInfo, nullptr) != VK_SUCCESS) {
+            LogError(LogType::Vulkan, "Failed to submit async compute command buffer.");
+            throw std::runtime_error("VULKAN_SUBMIT_COMMAND_BUFFER_ERROR");
+        }
+        waitCount = 2;
+    }
+
     // Set the command buffer submit information.
-    const VkSemaphore          waitSemaphores  [] = { vkImageAvailableSemaphores[currentFrame] };
-    const VkPipelineStageFlags waitStages      [] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    const VkSemaphore          waitSemaphores  [] = { vkImageAvailableSemaphores[currentFrame], vkComputeQueue ? vkComputeFinishedSemaphores[currentFrame] : nullptr };
+    const VkPipelineStageFlags waitStages      [] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, asyncComputeWaitStages };
     const VkSemaphore          signalSemaphores[] = { vkRenderFinishedSemaphores[currentFrame] };
+    asyncComputeWaitStages = 0;
     VkSubmitInfo submitInfo{};
     submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount   = 1;
+    submitInfo.waitSemaphoreCount   = waitCount;
     submitInfo.pWaitSemaphores      = waitSemaphores;
     submitInfo.pWaitDstStageMask    = waitStages;
     submitInfo.commandBufferCount   = 1;
@@ -1113,5 +2423,6 @@ void Renderer::PresentFrame()
 
     // Move to the next frame.
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    frameIndex++;
 }
 #pragma endregion
@@ -0,0 +1,329 @@
+#include "Core/ResidencyManager.h"
+#include "Core/Logger.h"
+#include "Core/Renderer.h"
+#include "Resources/Texture.h"
+#include "Resources/Material.h"
+#include "Resources/Mesh.h"
+#include <vulkan/vulkan.h>
+#include <stb_image.h>
+#include <algorithm>
+#include <chrono>
+using namespace Core;
+using namespace Resources;
+using namespace GraphicsUtils;
+
+ResidencyManager::~ResidencyManager()
+{
+    // Wait for the workers and free the pixels they decoded.
+    for (StreamRequest& request : streamRequests)
+        if (unsigned char* pixels = request.pixels.get())
+            stbi_image_free(pixels);
+}
+
+bool ResidencyManager::MarkUsed(const Mesh& mesh)
+{
+    const uint64_t        frameIndex = renderer->GetFrameIndex();
+    const GpuHandle<Mesh> handle     = gpuData->GetHandle(mesh);
+    GpuData<Mesh>* meshData = gpuData->meshes.Get(handle);
+    if (!meshData) return false;
+
+    // Move the mesh to the back of the residency list, or request it to be re-uploaded if it was evicted.
+    ResidencyList& residencyList = gpuData->residencyList;
+    meshData->lastUsedFrame = frameIndex;
+    if (meshData->resident) {
+        residencyList.splice(residencyList.end(), residencyList, meshData->residencyEntry);
+    }
+    else if (!meshData->uploadRequested) {
+        meshData->uploadRequested = true;
+        uploadRequests.push_back({ handle, &mesh });
+    }
+
+    // Mark the material's textures as used, and request evicted ones to be streamed back in.
+    const Material* material = mesh.GetMaterial();
+    if (!material) return meshData->resident;
+    for (const Texture* texture : material->textures)
+    {
+        if (!texture) continue;
+        const GpuHandle<Texture> textureHandle = gpuData->GetHandle(*texture);
+        GpuData<Texture>* textureData = gpuData->textures.Get(textureHandle);
+        if (!textureData) continue;
+        textureData->lastUsedFrame = frameIndex;
+        if (textureData->residentMip == 0) {
+            residencyList.splice(residencyList.end(), residencyList, textureData->residencyEntry);
+        }
+        else if (!textureData->streamRequested && !textureData->sourceFile.empty()) {
+            textureData->streamRequested = true;
+            streamQueue.push_back(textureHandle);
+        }
+    }
+    return meshData->resident;
+}
+
+void ResidencyManager::Update(const VkCommandBuffer& commandBuffer)
+{
+    const uint64_t frameIndex = renderer->GetFrameIndex();
+    gpuData->vkUploadCommandBuffer = commandBuffer;
+
+    // Re-upload the meshes drawn while evicted, unless they were destroyed since.
+    const bool meshesUploaded = !uploadRequests.empty();
+    for (const UploadRequest& request : uploadRequests)
+    {
+        GpuData<Mesh>* data = gpuData->meshes.Get(request.handle);
+        if (!data || data->resident) continue;
+        data->uploadRequested = false;
+        gpuData->UploadMeshData(*data, *request.mesh);
+    }
+    uploadRequests.clear();
+
+    // Upload the textures that are done decoding.
+    for (auto it = streamRequests.begin(); it != streamRequests.end();)
+    {
+        if (it->pixels.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        unsigned char* pixels = it->pixels.get();
+        if (GpuData<Texture>* data = gpuData->textures.Get(it->handle))
+            StreamTexture(it->handle, *data, pixels);
+        if (pixels) stbi_image_free(pixels);
+        it = streamRequests.erase(it);
+    }
+
+    // Decode the next requested textures on worker threads, unless they were destroyed since.
+    while (!streamQueue.empty() && streamRequests.size() < maxStreamsPerFrame)
+    {
+        const GpuHandle<Texture> handle = streamQueue.front();
+        streamQueue.pop_front();
+        const GpuData<Texture>* data = gpuData->textures.Get(handle);
+        if (!data) continue;
+        streamRequests.push_back({ handle, std::async(std::launch::async, [file = data->sourceFile, width = data->width, height = data->height]() -> unsigned char*
+        {
+            int loadedWidth, loadedHeight, channels;
+            stbi_set_flip_vertically_on_load_thread(true);
+            unsigned char* pixels = stbi_load(file.c_str(), &loadedWidth, &loadedHeight, &channels, STBI_rgb_alpha);
+            if (pixels && ((uint32_t)loadedWidth != width || (uint32_t)loadedHeight != height)) {
+                stbi_image_free(pixels);
+                return nullptr;
+            }
+            return pixels;
+        }) });
+    }
+
+    // Evict the least recently used data until back under budget.
+    // The residency list is ordered by last use, so the walk stops at the first entry used too recently.
+    VkDeviceSize residentBytes = GetResidentBytes();
+    ResidencyList& residencyList = gpuData->residencyList;
+    for (auto it = residencyList.begin(); it != residencyList.end() && residentBytes > budget;)
+    {
+        const ResidencyEntry entry = *it++;
+        if (GpuData<Mesh>* mesh = gpuData->meshes.Get(entry.mesh))
+        {
+            if (mesh->lastUsedFrame + minIdleFrames > frameIndex) break;
+            EvictMesh(*mesh);
+        }
+        else if (GpuData<Texture>* texture = gpuData->textures.Get(entry.texture))
+        {
+            if (texture->lastUsedFrame + minIdleFrames > frameIndex) break;
+            if (GetPlaceholderBaseMip(*texture) == 0) continue;
+            if (!EvictTexture(commandBuffer, *texture)) break;
+        }
+        residentBytes = GetResidentBytes();
+    }
+
+    // Make the re-uploaded meshes visible to the draws, textures are transitioned by their own barriers.
+    if (meshesUploaded)
+    {
+        VkMemoryBarrier barrier{};
+        barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+    gpuData->vkUploadCommandBuffer = nullptr;
+}
+
+VkDeviceSize ResidencyManager::GetResidentBytes() const
+{
+    // Evicting a shared mesh doesn't free any memory but makes room in the shared buffers, so count their used ranges rather than their size.
+    const GpuArray<Mesh>& meshesArray = gpuData->meshesArray;
+    return gpuData->trackedMemory[GpuMemoryCategory::Textures] + gpuData->trackedMemory[GpuMemoryCategory::Meshes] - meshesArray.vkMemorySize + meshesArray.usedBytes;
+}
+
+size_t ResidencyManager::GetEvictedMeshCount() const
+{
+    size_t count = 0;
+    gpuData->meshes.ForEach([&](const GpuHandle<Mesh>&, const GpuData<Mesh>& data){ if (!data.resident) count++; });
+    return count;
+}
+
+size_t ResidencyManager::GetEvictedTextureCount() const
+{
+    size_t count = 0;
+    gpuData->textures.ForEach([&](const GpuHandle<Texture>&, const GpuData<Texture>& data){ if (data.residentMip > 0) count++; });
+    return count;
+}
+
+uint32_t ResidencyManager::GetPlaceholderBaseMip(const GpuData<Texture>& data) const
+{
+    // Find the first mip level that fits in the placeholder size.
+    uint32_t baseMip = 0;
+    while (baseMip + 1 < data.mipLevels && std::max(data.width >> baseMip, data.height >> baseMip) > placeholderSize)
+        baseMip++;
+    return baseMip;
+}
+
+bool ResidencyManager::EvictTexture(const VkCommandBuffer& commandBuffer, GpuData<Texture>& data)
+{
+    const VkDevice         vkDevice         = renderer->GetVkDevice();
+    const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
+    uint32_t newSlot;
+    if (!AllocateReplacementSlot(data, newSlot)) return false;
+
+    // Create an image for the lowest mips.
+    const uint32_t baseMip    = GetPlaceholderBaseMip(data);
+    const uint32_t tailLevels = data.mipLevels - baseMip;
+    const uint32_t tailWidth  = std::max(data.width  >> baseMip, 1u);
+    const uint32_t tailHeight = std::max(data.height >> baseMip, 1u);
+    VkImage        tailImage;
+    VkDeviceMemory tailImageMemory;
+    VkImageView    tailImageView;
+    CreateImage(vkDevice, vkPhysicalDevice, tailWidth, tailHeight, tailLevels, VK_SAMPLE_COUNT_1_BIT, data.vkImageFormat, VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                tailImage, tailImageMemory);
+
+    // Transition the source mips and the placeholder image for the copy, the frames in flight don't sample the source since it has been idle.
+    VkImageMemoryBarrier barriers[2] = {{},{}};
+    for (VkImageMemoryBarrier& barrier : barriers) {
+        barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount     = tailLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount     = 1;
+    }
+    barriers[0].image                         = data.vkImage;
+    barriers[0].subresourceRange.baseMipLevel = baseMip;
+    barriers[0].oldLayout                     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout                     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].srcAccessMask                 = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].dstAccessMask                 = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[1].image                         = tailImage;
+    barriers[1].subresourceRange.baseMipLevel = 0;
+    barriers[1].oldLayout                     = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout                     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].srcAccessMask                 = 0;
+    barriers[1].dstAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+    // Copy the lowest mips to the placeholder image.
+    std::vector<VkImageCopy> regions(tailLevels);
+    for (uint32_t i = 0; i < tailLevels; i++)
+    {
+        regions[i].srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, baseMip + i, 0, 1 };
+        regions[i].dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i,           0, 1 };
+        regions[i].srcOffset      = { 0, 0, 0 };
+        regions[i].dstOffset      = { 0, 0, 0 };
+        regions[i].extent         = { std::max(tailWidth >> i, 1u), std::max(tailHeight >> i, 1u), 1 };
+    }
+    vkCmdCopyImage(commandBuffer, data.vkImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, tailImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, tailLevels, regions.data());
+
+    // Make the placeholder image readable by shaders.
+    barriers[1].oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barriers[1]);
+    CreateImageView(vkDevice, tailImage, data.vkImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, tailLevels, tailImageView);
+
+    // Replace the full image with the placeholder, which doesn't take part in the residency list until streamed back in.
+    ReplaceTextureImage(data, newSlot, tailImage, tailImageMemory, tailImageView, baseMip);
+    gpuData->residencyList.erase(data.residencyEntry);
+    return true;
+}
+
+void ResidencyManager::StreamTexture(const GpuHandle<Texture>& handle, GpuData<Texture>& data, const unsigned char* pixels)
+{
+    if (!pixels) {
+        LogError(LogType::Resources, "Unable to stream texture " + data.sourceFile + " back in, keeping its placeholder.");
+        data.sourceFile.clear();
+        data.streamRequested = false;
+        return;
+    }
+
+    // Try again later if there is no free slot to move the texture to.
+    uint32_t newSlot;
+    if (!AllocateReplacementSlot(data, newSlot)) {
+        streamQueue.push_back(handle);
+        return;
+    }
+
+    // Record the upload of the full mip chain and replace the placeholder with it.
+    GpuData<Texture> streamed = data;
+    gpuData->UploadTextureImage(streamed, pixels);
+    ReplaceTextureImage(data, newSlot, streamed.vkImage, streamed.vkImageMemory, streamed.vkImageView, 0);
+    data.streamRequested = false;
+    data.residencyEntry  = gpuData->residencyList.insert(gpuData->residencyList.end(), { handle, {} });
+}
+
+void ResidencyManager::EvictMesh(GpuData<Mesh>& data)
+{
+    // Keep the mesh's data without buffers, so that it can be re-uploaded when it is drawn again.
+    gpuData->ReleaseMeshData(data);
+    gpuData->residencyList.erase(data.residencyEntry);
+    const uint64_t lastUsedFrame = data.lastUsedFrame;
+    data = GpuData<Mesh>();
+    data.lastUsedFrame = lastUsedFrame;
+    data.resident      = false;
+}
+
+bool ResidencyManager::AllocateReplacementSlot(const GpuData<Texture>& data, uint32_t& newSlot) const
+{
+    newSlot = INVALID_BINDLESS_INDEX;
+    if (data.bindlessIndex == INVALID_BINDLESS_INDEX) return true;
+    GpuArray<Material>& materialsArray = gpuData->materialsArray;
+    newSlot = GpuDataManager::AllocateSlot(materialsArray.freeTextureSlots, materialsArray.textureSlotCount, MAX_BINDLESS_TEXTURES);
+    return newSlot != INVALID_BINDLESS_INDEX;
+}
+
+void ResidencyManager::ReplaceTextureImage(GpuData<Texture>& data, const uint32_t& newSlot, const VkImage& image,
+                                           const VkDeviceMemory& imageMemory, const VkImageView& imageView, const uint32_t& residentMip)
+{
+    // Retire the old image and slot along with the frames in flight that may still sample them.
+    const VkDevice       vkDevice       = renderer->GetVkDevice();
+    const VkImage        oldImage       = data.vkImage;
+    const VkDeviceMemory oldImageMemory = data.vkImageMemory;
+    const VkImageView    oldImageView   = data.vkImageView;
+    const uint32_t       oldSlot        = data.bindlessIndex;
+    GpuDataManager*      manager        = gpuData;
+    const auto retireOldImage = [vkDevice, manager, oldImage, oldImageMemory, oldImageView, oldSlot]
+    {
+        vkDestroyImageView(vkDevice, oldImageView,   nullptr);
+        vkDestroyImage    (vkDevice, oldImage,       nullptr);
+        vkFreeMemory      (vkDevice, oldImageMemory, nullptr);
+        if (oldSlot != INVALID_BINDLESS_INDEX) manager->materialsArray.freeTextureSlots.push_back(oldSlot);
+    };
+    gpuData->UntrackMemory(GpuMemoryCategory::Textures, data.vkMemorySize);
+    data.vkImage       = image;
+    data.vkImageMemory = imageMemory;
+    data.vkImageView   = imageView;
+    data.vkMemorySize  = GetImageMemorySize(vkDevice, image);
+    data.residentMip   = residentMip;
+    gpuData->TrackMemory(GpuMemoryCategory::Textures, data.vkMemorySize);
+
+    if (oldSlot == INVALID_BINDLESS_INDEX) {
+        gpuData->DeferDeletion(retireOldImage);
+        return;
+    }
+
+    // Write the new image to the new slot, which no frame in flight uses.
+    // The frames in flight read the material buffer when they execute, before this frame's command buffer uploads the new image,
+    // so the materials are only pointed to the new slot once this frame has completed. The old image is then retired with the frames that may still sample it.
+    data.bindlessIndex = newSlot;
+    gpuData->WriteTextureDescriptor(data);
+    gpuData->DeferDeletion([manager, oldSlot, newSlot, retireOldImage]
+    {
+        manager->RemapTextureSlot(oldSlot, newSlot);
+        manager->DeferDeletion(retireOldImage);
+    });
+}
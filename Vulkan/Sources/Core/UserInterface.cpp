@@ -4,6 +4,12 @@
 #include "Core/Window.h"
 #include "Core/Renderer.h"
 #include "Core/Engine.h"
+#include "Core/GpuDataManager.h"
+#include "Core/ResidencyManager.h"
+#include "Core/GeometryDefragmenter.h"
+#include "Core/GpuCuller.h"
+#include "Core/LightCuller.h"
+#include "Core/MipGenerator.h"
 #include "Resources/Camera.h"
 #include "Resources/Model.h"
 #include "Resources/Mesh.h"
@@ -74,10 +80,16 @@ void UserInterface::CreateDescriptorPool()
     }
 }
 
+void UserInterface::RecreateRenderPassObjects() const
+{
+    // The renderer backend's pipeline is created for the render pass, so the backend is initialized again with the new one.
+    ImGui_ImplVulkan_Shutdown();
+    InitImGuiVulkan();
+    UploadImGuiFonts();
+}
+
 void UserInterface::InitImGui() const
 {
-    const Renderer* renderer = app->GetRenderer();
-    
     // Create ImGui context.
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -87,15 +99,21 @@ void UserInterface::InitImGui() const
 
     // Setup platform/renderer backends.
     ImGui_ImplGlfw_InitForVulkan(app->GetWindow()->GetGlfwWindow(), true);
+    InitImGuiVulkan();
+}
+
+void UserInterface::InitImGuiVulkan() const
+{
+    const Renderer* renderer = app->GetRenderer();
     ImGui_ImplVulkan_InitInfo initInfo = {};
     initInfo.Instance        = renderer->GetVkInstance();
     initInfo.PhysicalDevice  = renderer->GetVkPhysicalDevice();
     initInfo.Device          = renderer->GetVkDevice();
     initInfo.QueueFamily     = renderer->GetVkGraphicsQueueIndex();
     initInfo.Queue           = renderer->GetVkGraphicsQueue();
-    initInfo.PipelineCache   = VK_NULL_HANDLE;
+    initInfo.PipelineCache   = renderer->GetVkPipelineCache();
     initInfo.DescriptorPool  = vkDescriptorPool;
-    initInfo.Subpass         = 0;
+    initInfo.Subpass         = 1; // Drawn in the composite sub-pass, after transparent surfaces.
     initInfo.MinImageCount   = renderer->GetVkSwapChainImageCount();
     initInfo.ImageCount      = renderer->GetVkSwapChainImageCount();
     initInfo.MSAASamples     = renderer->GetMsaaSamples();
@@ -121,6 +139,7 @@ void UserInterface::Render() const
     NewFrame();
     
     ShowStatsWindow();
+    ShowMemoryWindow();
     ShowLogsWindow();
     ShowResourcesWindow();
     
@@ -135,6 +154,172 @@ void UserInterface::ShowStatsWindow() const
         ImGui::Text("FPS: %d | Delta Time: %.4fs", roundInt(1 / deltaTime), deltaTime);
         const Vector3 camPos = engine->GetCamera()->transform.GetPosition();
         ImGui::Text("Camera position: %.2f, %.2f, %.2f", camPos.x, camPos.y, camPos.z);
+
+        // Show the draw calls recorded for the submitted meshes and toggle instancing to compare.
+        Renderer*          renderer    = app->GetRenderer();
+        const RenderStats& renderStats = renderer->GetRenderStats();
+        ImGui::Text("Draw calls: %u | Binds: %u | Meshes: %u | Record time: %.3fms on %u thread(s)", renderStats.drawCalls, renderStats.bindCalls, renderStats.submittedMeshes, renderStats.recordTime, renderStats.recordThreads);
+        bool frustumCulling = engine->IsFrustumCullingEnabled();
+        if (ImGui::Checkbox("Frustum culling", &frustumCulling))
+            engine->SetFrustumCullingEnabled(frustumCulling);
+        ImGui::SameLine();
+        if (ImGui::Button("Benchmark culling"))
+            engine->BenchmarkFrustumCulling();
+        bool instancing = renderer->GetRenderQueue().IsInstancingEnabled();
+        if (ImGui::Checkbox("Instancing", &instancing))
+            renderer->GetRenderQueue().SetInstancingEnabled(instancing);
+        bool parallelRecording = renderer->IsParallelRecordingEnabled();
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Parallel recording", &parallelRecording))
+            renderer->SetParallelRecordingEnabled(parallelRecording);
+        if (renderer->IsIndirectDrawSupported()) {
+            bool indirect = renderer->IsIndirectDrawEnabled();
+            ImGui::SameLine();
+            if (ImGui::Checkbox("Indirect draws", &indirect))
+                renderer->SetIndirectDrawEnabled(indirect);
+            if (indirect) {
+                bool culling = renderer->GetCuller()->IsEnabled();
+                ImGui::SameLine();
+                if (ImGui::Checkbox("GPU culling", &culling))
+                    renderer->GetCuller()->SetEnabled(culling);
+                ImGui::Text("Visible instances: %u | Culled instances: %u", renderStats.visibleInstances, renderStats.culledInstances);
+            }
+        }
+
+        // Toggle the pipeline variants specialized per material to compare the render pass GPU time.
+        bool shaderPermutations = renderer->IsShaderPermutationsEnabled();
+        if (ImGui::Checkbox("Shader permutations", &shaderPermutations))
+            renderer->SetShaderPermutationsEnabled(shaderPermutations);
+        ImGui::SameLine();
+        ImGui::Text("(%u pipeline variant(s))", renderer->GetPipelineVariantCount());
+
+        // Toggle the depth pre-pass, which lays down opaque depth first so that each pixel is shaded once.
+        bool depthPrepass = renderer->IsDepthPrepassEnabled();
+        if (ImGui::Checkbox("Depth pre-pass", &depthPrepass))
+            renderer->SetDepthPrepassEnabled(depthPrepass);
+
+        // Toggle weighted blended transparency, to compare it with sorted blending, or measure both over the same frames.
+        if (renderer->IsOrderIndependentTransparencySupported()) {
+            if (renderer->IsTransparencyBenchmarkRunning()) {
+                ImGui::Text("Benchmarking transparency...");
+            }
+            else {
+                bool orderIndependent = renderer->IsOrderIndependentTransparencyEnabled();
+                if (ImGui::Checkbox("Order independent transparency", &orderIndependent))
+                    renderer->SetOrderIndependentTransparencyEnabled(orderIndependent);
+                ImGui::SameLine();
+                if (renderer->IsGpuTimeSupported() && ImGui::Button("Benchmark transparency"))
+                    renderer->BenchmarkTransparency(300);
+            }
+        }
+
+        // Toggle depth map displacement by tessellation, to compare it with parallax mapping, and set its target edge length.
+        if (renderer->IsTessellationSupported()) {
+            bool tessellation = renderer->IsTessellationEnabled();
+            if (ImGui::Checkbox("Tessellation displacement", &tessellation))
+                renderer->SetTessellationEnabled(tessellation);
+            float edgeLength = renderer->GetTessellationEdgeLength();
+            if (tessellation && ImGui::SliderFloat("Tessellated edge length (px)", &edgeLength, 2, 64))
+                renderer->SetTessellationEdgeLength(edgeLength);
+        }
+
+        // Scale the shading LOD distances of all materials, 0 disables shading LOD to compare GPU times on large surfaces.
+        float lodScale = renderer->GetShadingLodScale();
+        if (ImGui::SliderFloat("Shading LOD distance scale", &lodScale, 0, 4, lodScale > 0 ? "%.2f" : "Disabled"))
+            renderer->SetShadingLodScale(lodScale);
+        if (renderer->IsGpuTimeSupported())
+            ImGui::Text("Render pass GPU time: %.3fms", renderStats.gpuTime);
+
+        // Scatter lights and toggle light clustering to compare how the lighting scales.
+        int lightCount = (int)engine->GetLightCount();
+        if (ImGui::SliderInt("Lights", &lightCount, 1, (int)Engine::MAX_LIGHTS))
+            engine->ScatterLights((size_t)lightCount);
+        bool clusteredLighting = renderer->GetLightCuller()->IsEnabled();
+        if (ImGui::Checkbox("Clustered lighting", &clusteredLighting))
+            renderer->GetLightCuller()->SetEnabled(clusteredLighting);
+        if (renderer->IsAsyncComputeSupported()) {
+            bool asyncCompute = renderer->IsAsyncComputeEnabled();
+            if (ImGui::Checkbox("Bin lights on async compute", &asyncCompute))
+                renderer->SetAsyncComputeEnabled(asyncCompute);
+        }
+
+        // Select how the mips of loaded textures are generated and compare the times of both methods.
+        if (renderer->IsComputeMipsSupported()) {
+            MipGenerator* mipGenerator = renderer->GetMipGenerator();
+            bool computeMips = mipGenerator->GetMethod() == MipMethod::Compute;
+            if (ImGui::Checkbox("Compute mip generation", &computeMips))
+                mipGenerator->SetMethod(computeMips ? MipMethod::Compute : MipMethod::Blit);
+            const char* filters[] = { MipFilterToStr(MipFilter::Box), MipFilterToStr(MipFilter::Point), MipFilterToStr(MipFilter::Min), MipFilterToStr(MipFilter::Max) };
+            int filter = (int)mipGenerator->GetFilter();
+            if (computeMips && ImGui::Combo("Mip filter", &filter, filters, IM_ARRAYSIZE(filters)))
+                mipGenerator->SetFilter((MipFilter)filter);
+            if (ImGui::Button("Benchmark mip generation"))
+                app->GetGpuData()->BenchmarkMipGeneration();
+            const MipGenerationStats& computeStats = mipGenerator->GetStats(MipMethod::Compute);
+            const MipGenerationStats& blitStats    = mipGenerator->GetStats(MipMethod::Blit);
+            ImGui::Text("Mip generation: compute %.3fms for %u texture(s) | blit %.3fms for %u texture(s)",
+                        computeStats.totalTime, computeStats.textureCount, blitStats.totalTime, blitStats.textureCount);
+        }
+    }
+    ImGui::End();
+}
+
+void UserInterface::ShowMemoryWindow() const
+{
+    if (ImGui::Begin("GPU Memory", NULL))
+    {
+        GpuDataManager*      gpuData = app->GetGpuData();
+        const GpuMemoryStats stats   = gpuData->GetMemoryStats();
+        constexpr float      toMB    = 1.f / (1024 * 1024);
+
+        // Show device usage against the budget, in red when over the warning threshold.
+        const float usageRatio = stats.deviceBudget > 0 ? (float)stats.deviceUsage / (float)stats.deviceBudget : 0;
+        const bool  overBudget = usageRatio >= gpuData->GetMemoryWarningRatio();
+        if (overBudget) ImGui::PushStyleColor(ImGuiCol_PlotHistogram, { 1, 0, 0, 1 });
+        const std::string usageStr = std::to_string(roundInt(stats.deviceUsage * toMB)) + "MB / " + std::to_string(roundInt(stats.deviceBudget * toMB)) + "MB";
+        ImGui::ProgressBar(usageRatio, { -1, 0 }, usageStr.c_str());
+        if (overBudget) ImGui::PopStyleColor();
+        if (!stats.budgetQueried)
+            ImGui::TextDisabled("VK_EXT_memory_budget unavailable, showing estimates.");
+
+        // Show the memory used by each resource class.
+        for (size_t i = 0; i < GpuMemoryCategory::COUNT; i++)
+            ImGui::Text("%s: %.2fMB (%u allocations)", GpuMemoryCategoryToStr(i), stats.categoryBytes[i] * toMB, stats.categoryAllocations[i]);
+        ImGui::Text("Total tracked: %.2fMB", stats.trackedBytes * toMB);
+        ImGui::Text("Shared geometry used: %.2fMB / %.2fMB", stats.sharedGeometryUsedBytes * toMB, stats.sharedGeometryBytes * toMB);
+        ImGui::Text("Allocations: %u / %u", stats.allocationCount, stats.maxAllocationCount);
+
+        // Let the user configure the warning threshold.
+        float warningRatio = gpuData->GetMemoryWarningRatio();
+        if (ImGui::SliderFloat("Warning threshold", &warningRatio, 0.1f, 1.f, "%.2f"))
+            gpuData->SetMemoryWarningRatio(warningRatio);
+
+        // Show residency stats and let the user configure the budget.
+        ResidencyManager* residency = app->GetRenderer()->GetResidency();
+        ImGui::Separator();
+        ImGui::Text("Resident textures and meshes: %.2fMB", residency->GetResidentBytes() * toMB);
+        ImGui::Text("Evicted textures: %zu | Evicted meshes: %zu", residency->GetEvictedTextureCount(), residency->GetEvictedMeshCount());
+        int budgetMB = roundInt(residency->GetBudget() * toMB);
+        if (ImGui::DragInt("Residency budget (MB)", &budgetMB, 1, 1, 1 << 16))
+            residency->SetBudget((VkDeviceSize)budgetMB << 20);
+
+        // Show the fragmentation of the shared geometry buffers and let the user configure their compaction.
+        GeometryDefragmenter* defragmenter = app->GetRenderer()->GetDefragmenter();
+        const DefragmentationStats& defragStats = defragmenter->GetStats();
+        ImGui::Separator();
+        ImGui::Text("Free vertex ranges: %u | Free index ranges: %u", defragStats.freeVertexRanges, defragStats.freeIndexRanges);
+        ImGui::Text("Moved meshes: %u | Migrated meshes: %u | Copied: %.2fKB", defragStats.movedMeshes, defragStats.migratedMeshes, defragStats.copiedBytes / 1024.f);
+        ImGui::Text("Freed since startup: %u range(s), %.2fMB", defragStats.freedRanges, defragStats.freedBytes * toMB);
+        bool defragEnabled = defragmenter->IsEnabled();
+        if (ImGui::Checkbox("Compact geometry buffers", &defragEnabled))
+            defragmenter->SetEnabled(defragEnabled);
+        int maxMoves = (int)defragmenter->GetMaxMovesPerFrame();
+        if (ImGui::DragInt("Max moves per frame", &maxMoves, 1, 1, 256))
+            defragmenter->SetMaxMovesPerFrame((uint32_t)maxMoves);
+
+        // Compare the cost of GPU data lookups by handle and by resource ID.
+        if (ImGui::Button("Benchmark GPU data lookups"))
+            GpuDataManager::BenchmarkDataLookups();
     }
     ImGui::End();
 }
@@ -282,7 +467,9 @@ void UserInterface::NewFrame() const
 
 void UserInterface::RenderFrame() const
 {
+    // The overlay is left out of the frames the transparency benchmark compares.
     ImGui::Render();
+    if (app->GetRenderer()->IsCapturingFrame()) return;
     ImDrawData* drawData = ImGui::GetDrawData();
     ImGui_ImplVulkan_RenderDrawData(drawData, app->GetRenderer()->GetCurVkCommandBuffer());
 }
@@ -262,6 +262,7 @@ std::unordered_map<std::string, Model> WavefrontParser::ParseObj(const std::stri
     }
     else {
         model.meshes.back().FinalizeLoading();
+        model.UpdateBounds();
         newModels[model.name] = std::move(model);
     }
 
@@ -367,8 +368,14 @@ void WavefrontParser::ParseObjTriangle(const std::string& line, std::array<std::
 #pragma region Line Parsing
 void WavefrontParser::ParseObjObjectLine(const std::string& line, Model& model, std::unordered_map<std::string, Model>& newModels)
 {
-    if (!model.name.empty())
+    // Finalize loading of the previous model, like the last one once the file has been parsed.
+    if (!model.name.empty()) {
+        if (!model.meshes.empty()) {
+            model.meshes.back().FinalizeLoading();
+            model.UpdateBounds();
+        }
         newModels[model.name] = std::move(model);
+    }
     model = Model(line.substr(2, line.size()-3));
 }
 
@@ -0,0 +1,41 @@
+#include "Core/WorkerPool.h"
+using namespace Core;
+
+WorkerPool::WorkerPool(const uint32_t& threadCount)
+{
+    threads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+        threads.emplace_back(&WorkerPool::RunJobs, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    // Let the threads finish the queued jobs before joining them.
+    {
+        const std::lock_guard<std::mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobsAvailable.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void WorkerPool::RunJobs()
+{
+    while (true)
+    {
+        // Wait for a job, or for the pool to be destroyed once the queue is empty.
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            jobsAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        // Exceptions are stored in the job's future, so they are rethrown on the thread that waits for it.
+        job();
+    }
+}
@@ -6,6 +6,7 @@
 #include "Core/Engine.h"
 #include "Core/GraphicsUtils.h"
 #include <vulkan/vulkan_core.h>
+#include <algorithm>
 
 #include "Maths/AngleAxis.h"
 using namespace Resources;
@@ -42,74 +43,117 @@ Light Light::Spot(const Vector3& _position, const Vector3& _direction, const RGB
 
 void Light::UpdateBufferData(const std::vector<Light>& lights, const GpuArray<Light>* lightsArray)
 {
+    const Application* app = Application::Get();
     if (!lightsArray)
-    {
-        const Application* app = Application::Get();
         lightsArray = &app->GetGpuData()->GetArray<Light>();
+
+    // Only the lights that fit in the buffer are drawn.
+    const uint32_t lightCount = (uint32_t)std::min(lights.size(), Engine::MAX_LIGHTS);
+    if (lightCount == lights.size()) {
+        app->GetGpuData()->ResetWarning(GpuWarning::LightCount);
+    }
+    else if (app->GetGpuData()->IssueWarning(GpuWarning::LightCount)) {
+        LogWarning(LogType::Resources, "Too many lights, increase Engine::MAX_LIGHTS.");
     }
-    
-    memcpy(lightsArray->vkBufferMapped, lights.data(), sizeof(Light) * Engine::MAX_LIGHTS);
+
+    // Write the lights to the current frame's region, along with their count and the shader features of their types.
+    const uint32_t frame = app->GetRenderer()->GetCurrentFrame();
+    memcpy((char*)lightsArray->vkBufferMapped + lightsArray->vkFrameSize * frame, lights.data(), sizeof(Light) * lightCount);
+    uint32_t lightFeatures = 0;
+    for (uint32_t i = 0; i < lightCount; i++)
+        if (lights[i].type == LightType::Directional || lights[i].type == LightType::Point || lights[i].type == LightType::Spot)
+            lightFeatures |= GraphicsUtils::ShaderFeature::DirectionalLights << ((int)lights[i].type - (int)LightType::Directional);
+    GraphicsUtils::LightClusterParams* params = lightsArray->GetFrameParams(frame);
+    params->lightCount    = lightCount;
+    params->lightFeatures = lightFeatures;
 }
 
 
 template<> const GpuArray<Light>& GpuDataManager::CreateArray()
 {
     using namespace GraphicsUtils;
-    if (lightsArray.vkDescriptorSetLayout && lightsArray.vkDescriptorPool && lightsArray.vkBuffer && lightsArray.vkBufferMemory) return lightsArray;
+    if (CheckArray<Light>()) return lightsArray;
 
     // Get the necessary vulkan resources.
     const VkDevice         vkDevice         = renderer->GetVkDevice();
     const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
 
-    // Set the binding of the data buffer object.
-    VkDescriptorSetLayoutBinding layoutBinding{};
-    layoutBinding.binding         = 0;
-    layoutBinding.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    layoutBinding.descriptorCount = 1;
-    layoutBinding.stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-    // Enable modification of the light data after it is bound to a command buffer.
-    constexpr VkDescriptorBindingFlags bindingFlag = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
-    VkDescriptorSetLayoutBindingFlagsCreateInfo extendedLayoutInfo{};
-    extendedLayoutInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
-    extendedLayoutInfo.bindingCount  = 1;
-    extendedLayoutInfo.pBindingFlags = &bindingFlag;
-    
+    // Set the bindings of the lights, cluster parameters and cluster light lists.
+    // They are read by the fragment shader and the light culling shader, which writes the light lists.
+    constexpr uint32_t bindingCount = 3;
+    const VkDescriptorType descriptorTypes[bindingCount] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC };
+    VkDescriptorSetLayoutBinding layoutBindings[bindingCount] = {};
+    for (uint32_t i = 0; i < bindingCount; i++) {
+        layoutBindings[i].binding         = i;
+        layoutBindings[i].descriptorType  = descriptorTypes[i];
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
     // Create the descriptor set layout.
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings    = &layoutBinding;
-    layoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
-    layoutInfo.pNext        = &extendedLayoutInfo;
+    layoutInfo.bindingCount = bindingCount;
+    layoutInfo.pBindings    = layoutBindings;
     if (vkCreateDescriptorSetLayout(vkDevice, &layoutInfo, nullptr, &lightsArray.vkDescriptorSetLayout) != VK_SUCCESS) {
         LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
         throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
     }
 
     // Set the type and number of descriptors.
-    VkDescriptorPoolSize poolSize{};
-    poolSize.type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount = 1;
+    VkDescriptorPoolSize poolSizes[2] = {};
+    poolSizes[0].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 2;
+    poolSizes[1].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[1].descriptorCount = 1;
 
     // Create the descriptor pool.
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 1;
-    poolInfo.pPoolSizes    = &poolSize;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes    = poolSizes;
     poolInfo.maxSets       = 1;
-    poolInfo.flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
     if (vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &lightsArray.vkDescriptorPool) != VK_SUCCESS) {
         LogError(LogType::Vulkan, "Failed to create descriptor pool.");
         throw std::runtime_error("VULKAN_DESCRIPTOR_POOL_ERROR");
     }
 
-    // Create the light data buffer.
-    lightsArray.vkBufferSize = sizeof(Light) * Engine::MAX_LIGHTS;
-    CreateBuffer(vkDevice, vkPhysicalDevice, lightsArray.vkBufferSize,
-                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                 lightsArray.vkBuffer, lightsArray.vkBufferMemory);
-    vkMapMemory(vkDevice, lightsArray.vkBufferMemory, 0, lightsArray.vkBufferSize, 0, &lightsArray.vkBufferMapped);
+    // Align each frame's regions to the device's dynamic offset alignments.
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(vkPhysicalDevice, &deviceProperties);
+    const VkDeviceSize storageAlignment = deviceProperties.limits.minStorageBufferOffsetAlignment;
+    const VkDeviceSize uniformAlignment = deviceProperties.limits.minUniformBufferOffsetAlignment;
+    constexpr uint32_t clusterCount = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+    lightsArray.vkFrameSize        = (sizeof(Light) * Engine::MAX_LIGHTS + storageAlignment - 1) & ~(storageAlignment - 1);
+    lightsArray.vkParamsStride     = (sizeof(LightClusterParams) + uniformAlignment - 1) & ~(uniformAlignment - 1);
+    lightsArray.vkClusterFrameSize = (sizeof(uint32_t) * clusterCount * (1 + MAX_CLUSTER_LIGHTS) + storageAlignment - 1) & ~(storageAlignment - 1);
+
+    // Create the light ring buffer and keep it mapped.
+    // The light buffers are shared with the async compute queue if there is one, since the lights can be binned on it.
+    const std::vector<uint32_t> sharingFamilies = renderer->GetSharedQueueFamilies();
+    CreateBuffer(vkDevice, vkPhysicalDevice, lightsArray.vkFrameSize * MAX_FRAMES_IN_FLIGHT,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 lightsArray.vkBuffer, lightsArray.vkBufferMemory, sharingFamilies);
+    vkMapMemory(vkDevice, lightsArray.vkBufferMemory, 0, lightsArray.vkFrameSize * MAX_FRAMES_IN_FLIGHT, 0, &lightsArray.vkBufferMapped);
+
+    // Create the cluster parameters ring buffer and keep it mapped.
+    // The light features start with all the light types, since they are read from the previous frame's parameters.
+    CreateBuffer(vkDevice, vkPhysicalDevice, lightsArray.vkParamsStride * MAX_FRAMES_IN_FLIGHT,
+                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 lightsArray.vkParamsBuffer, lightsArray.vkParamsBufferMemory, sharingFamilies);
+    vkMapMemory(vkDevice, lightsArray.vkParamsBufferMemory, 0, lightsArray.vkParamsStride * MAX_FRAMES_IN_FLIGHT, 0, &lightsArray.vkParamsBufferMapped);
+    for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+        *lightsArray.GetFrameParams(frame) = {};
+        lightsArray.GetFrameParams(frame)->lightFeatures = ShaderFeature::Lights;
+    }
+
+    // Create the cluster light lists buffer, only accessed by the GPU.
+    CreateBuffer(vkDevice, vkPhysicalDevice, lightsArray.vkClusterFrameSize * MAX_FRAMES_IN_FLIGHT,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 lightsArray.vkClusterBuffer, lightsArray.vkClusterBufferMemory, sharingFamilies);
+    lightsArray.vkMemorySize = GetBufferMemorySize(vkDevice, lightsArray.vkBuffer) + GetBufferMemorySize(vkDevice, lightsArray.vkParamsBuffer)
+                             + GetBufferMemorySize(vkDevice, lightsArray.vkClusterBuffer);
+    TrackMemory(GpuMemoryCategory::Lights, lightsArray.vkMemorySize, 3);
 
     // Allocate the descriptor set.
     VkDescriptorSetAllocateInfo allocInfo = {};
@@ -118,25 +162,27 @@ template<> const GpuArray<Light>& GpuDataManager::CreateArray()
     allocInfo.descriptorSetCount = 1;
     allocInfo.pSetLayouts        = &lightsArray.vkDescriptorSetLayout;
     if (vkAllocateDescriptorSets(vkDevice, &allocInfo, &lightsArray.vkDescriptorSet) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate descriptor sets!");
+        LogError(LogType::Vulkan, "Failed to allocate descriptor sets.");
+        throw std::runtime_error("VULKAN_DESCRIPTOR_SET_ALLOCATION_ERROR");
     }
 
-    // Define info for the light data buffer.
-    VkDescriptorBufferInfo bufferInfo = {};
-    bufferInfo.buffer = lightsArray.vkBuffer;
-    bufferInfo.offset = 0;
-    bufferInfo.range  = lightsArray.vkBufferSize;
-
-    // Populate the descriptor set.
-    VkWriteDescriptorSet descriptorWrite = {};
-    descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite.dstSet          = lightsArray.vkDescriptorSet;
-    descriptorWrite.dstBinding      = 0;
-    descriptorWrite.dstArrayElement = 0;
-    descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrite.descriptorCount = 1;
-    descriptorWrite.pBufferInfo     = &bufferInfo;
-    vkUpdateDescriptorSets(vkDevice, 1, &descriptorWrite, 0, nullptr);
+    // Point the descriptors to a single frame's regions, the dynamic offsets select which one.
+    const VkDescriptorBufferInfo bufferInfos[bindingCount] = {
+        { lightsArray.vkBuffer,        0, lightsArray.vkFrameSize        },
+        { lightsArray.vkParamsBuffer,  0, sizeof(LightClusterParams)     },
+        { lightsArray.vkClusterBuffer, 0, lightsArray.vkClusterFrameSize },
+    };
+    VkWriteDescriptorSet descriptorWrites[bindingCount] = {};
+    for (uint32_t i = 0; i < bindingCount; i++) {
+        descriptorWrites[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].dstSet          = lightsArray.vkDescriptorSet;
+        descriptorWrites[i].dstBinding      = i;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorType  = descriptorTypes[i];
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].pBufferInfo     = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(vkDevice, bindingCount, descriptorWrites, 0, nullptr);
 
     return lightsArray;
 }
\ No newline at end of file
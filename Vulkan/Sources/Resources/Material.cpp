@@ -24,6 +24,7 @@ Material::Material(const RGB& _albedo, const RGB& _emissive, const float& _metal
     textures[MaterialTextureType::AOcclusion] = aoMap;
     textures[MaterialTextureType::Alpha     ] = alphaMap;
     textures[MaterialTextureType::Normal    ] = normalMap;
+    ClassifyAlphaMode();
 }
 
 Material& Material::operator=(Material&& other) noexcept
@@ -35,6 +36,12 @@ Material& Material::operator=(Material&& other) noexcept
     metallic  = other.metallic ; other.metallic   = 0;
     roughness = other.roughness; other.roughness  = 0;
     alpha     = other.alpha;     other.alpha      = 0;
+    alphaCutoff         = other.alphaCutoff;
+    parallaxLodDistance = other.parallaxLodDistance;
+    normalLodDistance   = other.normalLodDistance;
+    detailLodDistance   = other.detailLodDistance;
+    alphaMode = other.alphaMode; other.alphaMode  = MaterialAlphaMode::Opaque;
+    gpuHandle = other.gpuHandle; other.gpuHandle  = {};
     for (size_t i = 0; i < MaterialTextureType::COUNT; i++) {
         textures[i] = other.textures[i];
         other.textures[i] = nullptr;
@@ -49,6 +56,7 @@ Material::~Material()
 
 void Material::FinalizeLoading()
 {
+    ClassifyAlphaMode();
     Application::Get()->GetGpuData()->CreateData(*this);
 }
 
@@ -57,6 +65,14 @@ bool Material::IsLoadingFinalized()
     return Application::Get()->GetGpuData()->CheckData(*this);
 }
 
+void Material::ClassifyAlphaMode()
+{
+    const Texture* albedoTexture = textures[MaterialTextureType::Albedo];
+    if      (alpha < 1 || textures[MaterialTextureType::Alpha]) alphaMode = MaterialAlphaMode::Blended;
+    else if (albedoTexture && albedoTexture->HasAlpha())        alphaMode = MaterialAlphaMode::AlphaTested;
+    else                                                        alphaMode = MaterialAlphaMode::Opaque;
+}
+
 void Material::SetParams(const RGB& _albedo, const RGB& _emissive, const float& _metallic, const float& _roughness, const float& _alpha)
 {
     albedo    = _albedo;
@@ -64,32 +80,46 @@ void Material::SetParams(const RGB& _albedo, const RGB& _emissive, const float&
     metallic  = _metallic;
     roughness = _roughness;
     alpha     = _alpha;
+    ClassifyAlphaMode();
 }
 
 
 template<> const GpuArray<Material>& GpuDataManager::CreateArray()
 {
-    if (materialsArray.vkDescriptorSetLayout && materialsArray.vkDescriptorPool) return materialsArray;
+    if (CheckArray<Material>()) return materialsArray;
 
     // Get the necessary vulkan resources.
-    const VkDevice vkDevice = renderer->GetVkDevice();
+    const VkDevice         vkDevice         = renderer->GetVkDevice();
+    const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
      
-    // Set the bindings of the material data and textures.
+    // Set the bindings of the material buffer and bindless textures.
     VkDescriptorSetLayoutBinding layoutBindings[2] = {{},{}};
     layoutBindings[0].binding         = 0;
-    layoutBindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    layoutBindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     layoutBindings[0].descriptorCount = 1;
-    layoutBindings[0].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+    layoutBindings[0].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT; // Depth maps also displace tessellated geometry.
     layoutBindings[1].binding         = 1;
-    layoutBindings[1].descriptorCount = MaterialTextureType::COUNT;
+    layoutBindings[1].descriptorCount = MAX_BINDLESS_TEXTURES;
     layoutBindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    layoutBindings[1].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+    layoutBindings[1].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+
+    // Texture slots can be left empty, and written while frames in flight sample other slots.
+    const VkDescriptorBindingFlags bindingFlags[2] = {
+        0,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+    };
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount  = 2;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
 
     // Create the descriptor set layout.
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
     layoutInfo.bindingCount = 2;
     layoutInfo.pBindings    = layoutBindings;
+    layoutInfo.pNext        = &bindingFlagsInfo;
     if (vkCreateDescriptorSetLayout(vkDevice, &layoutInfo, nullptr, &materialsArray.vkDescriptorSetLayout) != VK_SUCCESS) {
         LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
         throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
@@ -97,109 +127,92 @@ template<> const GpuArray<Material>& GpuDataManager::CreateArray()
 
     // Set the type and number of descriptors.
     VkDescriptorPoolSize poolSizes[2];
-    poolSizes[0].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = Engine::MAX_MATERIALS;
+    poolSizes[0].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = 1;
     poolSizes[1].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = Engine::MAX_MATERIALS;
+    poolSizes[1].descriptorCount = MAX_BINDLESS_TEXTURES;
 
     // Create the descriptor pool.
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
     poolInfo.poolSizeCount = 2;
     poolInfo.pPoolSizes    = poolSizes;
-    poolInfo.maxSets       = Engine::MAX_MATERIALS;
+    poolInfo.maxSets       = 1;
     if (vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &materialsArray.vkDescriptorPool) != VK_SUCCESS) {
         LogError(LogType::Vulkan, "Failed to create descriptor pool.");
         throw std::runtime_error("VULKAN_DESCRIPTOR_POOL_ERROR");
     }
 
-    return materialsArray;
-}
-
-template<> const GpuData<Material>& GpuDataManager::CreateData(const Material& resource)
-{
-    if (resource.GetID() == UniqueID::unassigned) {
-        LogError(LogType::Resources, "Can't create GPU data from unassigned resource.");
-        throw std::runtime_error("RESOURCE_UNASSIGNED_ERROR");
-    }
-    GpuData<Material>& data = materials.emplace(std::make_pair(resource.GetID(), GpuData<Material>())).first->second;
-
-    // Get necessary vulkan resources.
-    const VkDevice         vkDevice         = renderer->GetVkDevice();
-    const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
-
-    // Create a temporary staging buffer.
-    constexpr VkDeviceSize bufferSize = sizeof(MaterialData);
-    VkBuffer       stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    CreateBuffer(vkDevice, vkPhysicalDevice, bufferSize,
-                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 stagingBuffer, stagingBufferMemory);
-
-    // Map the buffer's GPU memory to CPU memory, and write vertex info to it.
-    const MaterialData materialData{ resource.albedo, resource.emissive, resource.metallic, resource.roughness, resource.alpha, resource.depthMultiplier, resource.depthLayerCount };
-    void* memMapped;
-    vkMapMemory(vkDevice, stagingBufferMemory, 0, bufferSize, 0, &memMapped);
-    memcpy(memMapped, &materialData, (size_t)bufferSize);
-    vkUnmapMemory(vkDevice, stagingBufferMemory);
-
-    // Create the material buffer.
+    // Create the material buffer and keep it mapped, each material writes its own slot once.
+    materialsArray.capacity = (uint32_t)Engine::MAX_MATERIALS;
+    const VkDeviceSize bufferSize = sizeof(MaterialData) * materialsArray.capacity;
     CreateBuffer(vkDevice, vkPhysicalDevice, bufferSize,
-                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                 data.vkDataBuffer, data.vkDataBufferMemory);
-
-    // Copy the staging buffer to the material buffer.
-    CopyBuffer(vkDevice, renderer->GetVkCommandPool(), renderer->GetVkGraphicsQueue(), stagingBuffer, data.vkDataBuffer, bufferSize);
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 materialsArray.vkBuffer, materialsArray.vkBufferMemory);
+    vkMapMemory(vkDevice, materialsArray.vkBufferMemory, 0, bufferSize, 0, &materialsArray.vkBufferMapped);
+    materialsArray.vkMemorySize = GetBufferMemorySize(vkDevice, materialsArray.vkBuffer);
+    TrackMemory(GpuMemoryCategory::Materials, materialsArray.vkMemorySize);
 
-    // De-allocate the staging buffer.
-    vkDestroyBuffer(vkDevice, stagingBuffer,       nullptr);
-    vkFreeMemory   (vkDevice, stagingBufferMemory, nullptr);
-    
     // Allocate the descriptor set.
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool     = materialsArray.vkDescriptorPool;
     allocInfo.descriptorSetCount = 1;
     allocInfo.pSetLayouts        = &materialsArray.vkDescriptorSetLayout;
-    if (vkAllocateDescriptorSets(vkDevice, &allocInfo, &data.vkDescriptorSet) != VK_SUCCESS) {
+    if (vkAllocateDescriptorSets(vkDevice, &allocInfo, &materialsArray.vkDescriptorSet) != VK_SUCCESS) {
         LogError(LogType::Vulkan, "Failed to allocate descriptor sets.");
         throw std::runtime_error("VULKAN_DESCRIPTOR_SET_ALLOCATION_ERROR");
     }
 
-    // Populate the descriptor set.
-    VkDescriptorBufferInfo dataBufferInfo{};
-    dataBufferInfo.buffer = data.vkDataBuffer;
-    dataBufferInfo.offset = 0;
-    dataBufferInfo.range  = sizeof(MaterialData);
-    
-    VkDescriptorImageInfo imagesInfo[MaterialTextureType::COUNT];
+    // Point the descriptor to the material buffer, textures are written to their slots as they are created.
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = materialsArray.vkBuffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range  = bufferSize;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet          = materialsArray.vkDescriptorSet;
+    descriptorWrite.dstBinding      = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo     = &bufferInfo;
+    vkUpdateDescriptorSets(vkDevice, 1, &descriptorWrite, 0, nullptr);
+
+    return materialsArray;
+}
+
+template<> const GpuData<Material>& GpuDataManager::CreateData(const Material& resource)
+{
+    if (resource.GetID() == UniqueID::unassigned) {
+        LogError(LogType::Resources, "Can't create GPU data from unassigned resource.");
+        throw std::runtime_error("RESOURCE_UNASSIGNED_ERROR");
+    }
+
+    // Find a free slot in the material buffer.
+    const uint32_t index = AllocateSlot(materialsArray.freeMaterialSlots, materialsArray.materialSlotCount, materialsArray.capacity);
+    if (index == INVALID_BINDLESS_INDEX) {
+        LogError(LogType::Vulkan, "Too many materials loaded at once, increase Engine::MAX_MATERIALS.");
+        throw std::runtime_error("VULKAN_MATERIAL_CAPACITY_ERROR");
+    }
+    GpuData<Material>& data = materials.Emplace(resource.gpuHandle);
+    data.index = index;
+
+    // Write the material data along with the bindless indices of its textures.
+    MaterialData materialData{ resource.albedo, resource.emissive, resource.metallic, resource.roughness, resource.alpha, resource.depthMultiplier, resource.depthLayerCount };
+    materialData.parallaxLodDistance = resource.parallaxLodDistance;
+    materialData.normalLodDistance   = resource.normalLodDistance;
+    materialData.detailLodDistance   = resource.detailLodDistance;
+    materialData.alphaCutoff         = resource.alphaCutoff;
     for (size_t j = 0; j < MaterialTextureType::COUNT; j++)
     {
-        const Texture* texture = resource.textures[MaterialTextureType::Albedo+j];
-        const GpuData<Texture>* gpuData = nullptr;
-        if (texture) gpuData = GetData(*texture);
-        imagesInfo[j].imageView   = texture && gpuData ? gpuData->vkImageView : VK_NULL_HANDLE;
-        imagesInfo[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imagesInfo[j].sampler     = renderer->GetVkTextureSampler();
+        const Texture*          texture     = resource.textures[j];
+        const GpuData<Texture>* textureData = texture ? GetData(*texture) : nullptr;
+        materialData.textureIndices[j] = textureData ? textureData->bindlessIndex : INVALID_BINDLESS_INDEX;
     }
-    
-    VkWriteDescriptorSet descriptorWrites[2] = {{},{}};
-    descriptorWrites[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet          = data.vkDescriptorSet;
-    descriptorWrites[0].dstBinding      = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo     = &dataBufferInfo;
-    descriptorWrites[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet          = data.vkDescriptorSet;
-    descriptorWrites[1].dstBinding      = 1;
-    descriptorWrites[1].dstArrayElement = 0;
-    descriptorWrites[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[1].descriptorCount = MaterialTextureType::COUNT;
-    descriptorWrites[1].pImageInfo      = imagesInfo;
-    
-    vkUpdateDescriptorSets(vkDevice, 2, descriptorWrites, 0, nullptr);
+    ((MaterialData*)materialsArray.vkBufferMapped)[index] = materialData;
     
     return data;
 }
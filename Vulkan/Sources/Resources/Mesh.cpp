@@ -4,17 +4,21 @@
 #include "Core/Renderer.h"
 #include "Core/GpuDataManager.h"
 #include "Core/GraphicsUtils.h"
+#include "Core/Engine.h"
 #include <vulkan/vulkan.h>
 #include <array>
+#include <algorithm>
 using namespace Core;
 using namespace Resources;
 using namespace GraphicsUtils;
 
 Mesh::Mesh(Mesh&& other) noexcept
     : UniqueID(std::move(other)), name(std::move(other.name)), material(other.material),
-      parentModel(other.parentModel), vertices(std::move(other.vertices)), indices(std::move(other.indices))
+      parentModel(other.parentModel), vertices(std::move(other.vertices)), indices(std::move(other.indices)),
+      boundsCenter(other.boundsCenter), boundsRadius(other.boundsRadius), gpuHandle(other.gpuHandle)
 {
-    other.material = nullptr;
+    other.material  = nullptr;
+    other.gpuHandle = {};
 }
 
 Mesh::~Mesh()
@@ -24,17 +28,36 @@ Mesh::~Mesh()
 
 void Mesh::FinalizeLoading()
 {
+    // Compute the bounding sphere around the center of the mesh's bounding box.
+    if (!vertices.empty())
+    {
+        Maths::Vector3 min = vertices[0].pos, max = vertices[0].pos;
+        for (const Maths::TangentVertex& vertex : vertices) {
+            min = { std::min(min.x, vertex.pos.x), std::min(min.y, vertex.pos.y), std::min(min.z, vertex.pos.z) };
+            max = { std::max(max.x, vertex.pos.x), std::max(max.y, vertex.pos.y), std::max(max.z, vertex.pos.z) };
+        }
+        boundsCenter = (min + max) * 0.5f;
+        boundsRadius = 0;
+        for (const Maths::TangentVertex& vertex : vertices)
+            boundsRadius = std::max(boundsRadius, (vertex.pos - boundsCenter).GetLength());
+    }
+    
     Application::Get()->GetGpuData()->CreateData(*this);
 }
 
-VkVertexInputBindingDescription Mesh::GetVertexBindingDescription()
+std::array<VkVertexInputBindingDescription, 2> Mesh::GetVertexBindingDescriptions()
 {
-    VkVertexInputBindingDescription bindingDescription{};
-    bindingDescription.binding   = 0;
-    bindingDescription.stride    = sizeof(Maths::TangentVertex);
-    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    std::array<VkVertexInputBindingDescription, 2> bindingDescriptions{};
+
+    bindingDescriptions[0].binding   = 0;
+    bindingDescriptions[0].stride    = sizeof(Maths::Vector3);
+    bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-    return bindingDescription;
+    bindingDescriptions[1].binding   = 1;
+    bindingDescriptions[1].stride    = sizeof(Maths::VertexAttributes);
+    bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return bindingDescriptions;
 }
 
 std::array<VkVertexInputAttributeDescription, 5> Mesh::GetVertexAttributeDescriptions()
@@ -44,107 +67,178 @@ std::array<VkVertexInputAttributeDescription, 5> Mesh::GetVertexAttributeDescrip
     attributeDescriptions[0].binding  = 0;
     attributeDescriptions[0].location = 0;
     attributeDescriptions[0].format   = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[0].offset   = offsetof(Maths::TangentVertex, pos);
+    attributeDescriptions[0].offset   = 0;
     
-    attributeDescriptions[1].binding  = 0;
+    attributeDescriptions[1].binding  = 1;
     attributeDescriptions[1].location = 1;
     attributeDescriptions[1].format   = VK_FORMAT_R32G32_SFLOAT;
-    attributeDescriptions[1].offset   = offsetof(Maths::TangentVertex, uv);
+    attributeDescriptions[1].offset   = offsetof(Maths::VertexAttributes, uv);
 
-    attributeDescriptions[2].binding  = 0;
+    attributeDescriptions[2].binding  = 1;
     attributeDescriptions[2].location = 2;
     attributeDescriptions[2].format   = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[2].offset   = offsetof(Maths::TangentVertex, normal);
+    attributeDescriptions[2].offset   = offsetof(Maths::VertexAttributes, normal);
     
-    attributeDescriptions[3].binding  = 0;
+    attributeDescriptions[3].binding  = 1;
     attributeDescriptions[3].location = 3;
     attributeDescriptions[3].format   = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[3].offset   = offsetof(Maths::TangentVertex, tangent);
+    attributeDescriptions[3].offset   = offsetof(Maths::VertexAttributes, tangent);
 
-    attributeDescriptions[4].binding  = 0;
+    attributeDescriptions[4].binding  = 1;
     attributeDescriptions[4].location = 4;
     attributeDescriptions[4].format   = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[4].offset   = offsetof(Maths::TangentVertex, bitangent);
+    attributeDescriptions[4].offset   = offsetof(Maths::VertexAttributes, bitangent);
 
     return attributeDescriptions;
 }
 
 
+template<> const GpuArray<Mesh>& GpuDataManager::CreateArray()
+{
+    if (CheckArray<Mesh>()) return meshesArray;
+
+    // Get necessary vulkan resources.
+    const VkDevice         vkDevice         = renderer->GetVkDevice();
+    const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
+
+    // Create the shared position, attribute and index buffers, which are also copied from when they are compacted.
+    CreateBuffer(vkDevice, vkPhysicalDevice, sizeof(Maths::Vector3) * Engine::MAX_VERTICES,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 meshesArray.vkPositionBuffer, meshesArray.vkPositionBufferMemory);
+    CreateBuffer(vkDevice, vkPhysicalDevice, sizeof(Maths::VertexAttributes) * Engine::MAX_VERTICES,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 meshesArray.vkAttributeBuffer, meshesArray.vkAttributeBufferMemory);
+    CreateBuffer(vkDevice, vkPhysicalDevice, sizeof(uint32_t) * Engine::MAX_INDICES,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 meshesArray.vkIndexBuffer, meshesArray.vkIndexBufferMemory);
+    meshesArray.freeVertexRanges = { { 0, (uint32_t)Engine::MAX_VERTICES } };
+    meshesArray.freeIndexRanges  = { { 0, (uint32_t)Engine::MAX_INDICES  } };
+
+    // The shared buffers are counted as mesh memory as a whole, the ranges used by meshes are counted separately.
+    meshesArray.vkMemorySize = GetBufferMemorySize(vkDevice, meshesArray.vkPositionBuffer) + GetBufferMemorySize(vkDevice, meshesArray.vkAttributeBuffer)
+                             + GetBufferMemorySize(vkDevice, meshesArray.vkIndexBuffer);
+    TrackMemory(GpuMemoryCategory::Meshes, meshesArray.vkMemorySize, 3);
+
+    return meshesArray;
+}
+
 template<> const GpuData<Mesh>& GpuDataManager::CreateData(const Mesh& resource)
 {
     if (resource.GetID() == UniqueID::unassigned) {
         LogError(LogType::Resources, "Can't create GPU data from unassigned resource.");
         throw std::runtime_error("RESOURCE_UNASSIGNED_ERROR");
     }
-    GpuData<Mesh>& data = meshes.emplace(std::make_pair(resource.GetID(), GpuData<Mesh>())).first->second;
+    GpuData<Mesh>& data = meshes.Emplace(resource.gpuHandle);
+    UploadMeshData(data, resource);
+    return data;
+}
+
+void GpuDataManager::UploadMeshData(GpuData<Mesh>& data, const Mesh& resource)
+{
+    data.lastUsedFrame  = renderer->GetFrameIndex();
+    data.resident       = true;
+    data.residencyEntry = residencyList.insert(residencyList.end(), { {}, resource.gpuHandle });
 
     // Get necessary vulkan resources.
     const VkDevice         vkDevice         = renderer->GetVkDevice();
     const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
-    const VkCommandPool    vkCommandPool    = renderer->GetVkCommandPool();
-    const VkQueue          vkGraphicsQueue  = renderer->GetVkGraphicsQueue();
 
-    // Create vertex buffer.
+    // Get the mesh data, with the vertex positions split from their other attributes.
+    const std::vector<Maths::TangentVertex>& vertices = resource.GetVertices();
+    const std::vector<uint32_t>&             indices  = resource.GetIndices();
+    std::vector<Maths::Vector3>          positions (vertices.size());
+    std::vector<Maths::VertexAttributes> attributes(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        positions [i] = vertices[i].pos;
+        attributes[i] = { vertices[i].uv, vertices[i].normal, vertices[i].tangent, vertices[i].bitangent };
+    }
+    const VkDeviceSize positionsSize  = sizeof(Maths::Vector3)          * positions .size();
+    const VkDeviceSize attributesSize = sizeof(Maths::VertexAttributes) * attributes.size();
+    const VkDeviceSize indicesSize    = sizeof(uint32_t)                * indices   .size();
+    data.vertexRange.count = (uint32_t)vertices.size();
+    data.indexRange .count = (uint32_t)indices .size();
+
+    // Sub-allocate the mesh from the shared geometry buffers when there is room left.
+    bool shared = false;
+    if (AllocateRange(meshesArray.freeVertexRanges, data.vertexRange.count, data.vertexRange.offset))
     {
-        const std::vector<Maths::TangentVertex>& vertices = resource.GetVertices();
-        
-        // Create a temporary staging buffer.
-        const VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-        VkBuffer       stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        CreateBuffer(vkDevice, vkPhysicalDevice, bufferSize,
-                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     stagingBuffer, stagingBufferMemory);
-
-        // Map the buffer's GPU memory to CPU memory, and write vertex info to it.
-        void* memMap;
-        vkMapMemory(vkDevice, stagingBufferMemory, 0, bufferSize, 0, &memMap);
-        memcpy(memMap, vertices.data(), (size_t)bufferSize);
-        vkUnmapMemory(vkDevice, stagingBufferMemory);
-
-        // Create the vertex buffer.
-        CreateBuffer(vkDevice, vkPhysicalDevice, bufferSize,
-                     VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                     data.vkVertexBuffer, data.vkVertexBufferMemory);
-
-        // Copy the staging buffer to the vertex buffer.
-        CopyBuffer(vkDevice, vkCommandPool, vkGraphicsQueue, stagingBuffer, data.vkVertexBuffer, bufferSize);
-
-        // De-allocate the staging buffer.
-        vkDestroyBuffer(vkDevice, stagingBuffer,       nullptr);
-        vkFreeMemory   (vkDevice, stagingBufferMemory, nullptr);
+        shared = AllocateRange(meshesArray.freeIndexRanges, data.indexRange.count, data.indexRange.offset);
+        if (!shared) FreeRange(meshesArray.freeVertexRanges, data.vertexRange);
     }
-
-    // Create index buffer.
+    if (shared)
     {
-        const std::vector<uint32_t>& indices = resource.GetIndices();
+        data.vkPositionBuffer  = meshesArray.vkPositionBuffer;
+        data.vkAttributeBuffer = meshesArray.vkAttributeBuffer;
+        data.vkIndexBuffer     = meshesArray.vkIndexBuffer;
+        UploadBufferData(data.vkPositionBuffer,  sizeof(Maths::Vector3)          * data.vertexRange.offset, positions .data(), positionsSize );
+        UploadBufferData(data.vkAttributeBuffer, sizeof(Maths::VertexAttributes) * data.vertexRange.offset, attributes.data(), attributesSize);
+        UploadBufferData(data.vkIndexBuffer,     sizeof(uint32_t)                * data.indexRange .offset, indices   .data(), indicesSize   );
         
-        // Create a temporary staging buffer.
-        const VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-        VkBuffer       stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        CreateBuffer(vkDevice, vkPhysicalDevice, bufferSize,
-                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     stagingBuffer, stagingBufferMemory);
-
-        // Map the buffer's GPU memory to CPU memory, and write vertex info to it.
-        void* memMap;
-        vkMapMemory(vkDevice, stagingBufferMemory, 0, bufferSize, 0, &memMap);
-        memcpy(memMap, indices.data(), (size_t)bufferSize);
-        vkUnmapMemory(vkDevice, stagingBufferMemory);
-
-        // Create the vertex buffer.
-        CreateBuffer(vkDevice, vkPhysicalDevice, bufferSize,
-                     VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                     data.vkIndexBuffer, data.vkIndexBufferMemory);
-
-        // Copy the staging buffer to the vertex buffer.
-        CopyBuffer(vkDevice, vkCommandPool, vkGraphicsQueue, stagingBuffer, data.vkIndexBuffer, bufferSize);
-
-        // De-allocate the staging buffer.
-        vkDestroyBuffer(vkDevice, stagingBuffer,       nullptr);
-        vkFreeMemory   (vkDevice, stagingBufferMemory, nullptr);
+        // Keep track of the space used by the ranges, the memory itself is already counted with the shared buffers.
+        data.vkMemorySize = positionsSize + attributesSize + indicesSize;
+        meshesArray.usedBytes += data.vkMemorySize;
+        return;
     }
+
+    // Otherwise create dedicated position, attribute and index buffers, copied from when the mesh is moved into the shared ones.
+    data.vertexRange.offset = data.indexRange.offset = 0;
+    CreateBuffer(vkDevice, vkPhysicalDevice, positionsSize,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 data.vkPositionBuffer, data.vkPositionBufferMemory);
+    CreateBuffer(vkDevice, vkPhysicalDevice, attributesSize,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 data.vkAttributeBuffer, data.vkAttributeBufferMemory);
+    CreateBuffer(vkDevice, vkPhysicalDevice, indicesSize,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 data.vkIndexBuffer, data.vkIndexBufferMemory);
+    UploadBufferData(data.vkPositionBuffer,  0, positions .data(), positionsSize );
+    UploadBufferData(data.vkAttributeBuffer, 0, attributes.data(), attributesSize);
+    UploadBufferData(data.vkIndexBuffer,     0, indices   .data(), indicesSize   );
+
+    // Keep track of the memory used by the buffers.
+    data.vkMemorySize = GetBufferMemorySize(vkDevice, data.vkPositionBuffer) + GetBufferMemorySize(vkDevice, data.vkAttributeBuffer) + GetBufferMemorySize(vkDevice, data.vkIndexBuffer);
+    TrackMemory(GpuMemoryCategory::Meshes, data.vkMemorySize, 3);
+}
+
+void GpuDataManager::UploadBufferData(const VkBuffer& dstBuffer, const VkDeviceSize& dstOffset, const void* src, const VkDeviceSize& size)
+{
+    // Get necessary vulkan resources.
+    const VkDevice         vkDevice         = renderer->GetVkDevice();
+    const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
     
-    return data;
+    // Create a temporary staging buffer.
+    VkBuffer       stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    CreateBuffer(vkDevice, vkPhysicalDevice, size,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 stagingBuffer, stagingBufferMemory);
+
+    // Map the buffer's GPU memory to CPU memory, and write the data to it.
+    void* memMap;
+    vkMapMemory(vkDevice, stagingBufferMemory, 0, size, 0, &memMap);
+    memcpy(memMap, src, (size_t)size);
+    vkUnmapMemory(vkDevice, stagingBufferMemory);
+
+    // Record the copy in the upload command buffer if there is one, and retire the staging buffer with its frame.
+    if (vkUploadCommandBuffer)
+    {
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = 0;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size      = size;
+        vkCmdCopyBuffer(vkUploadCommandBuffer, stagingBuffer, dstBuffer, 1, &copyRegion);
+        DeferDeletion([vkDevice, stagingBuffer, stagingBufferMemory]
+        {
+            vkDestroyBuffer(vkDevice, stagingBuffer,       nullptr);
+            vkFreeMemory   (vkDevice, stagingBufferMemory, nullptr);
+        });
+        return;
+    }
+
+    // Otherwise copy the staging buffer to the destination buffer and wait for it.
+    CopyBuffer(vkDevice, renderer->GetVkCommandPool(), renderer->GetVkGraphicsQueue(), stagingBuffer, dstBuffer, size, dstOffset);
+
+    // De-allocate the staging buffer.
+    vkDestroyBuffer(vkDevice, stagingBuffer,       nullptr);
+    vkFreeMemory   (vkDevice, stagingBufferMemory, nullptr);
 }
@@ -8,6 +8,7 @@
 #include "Resources/Mesh.h"
 #include "Maths/Vertex.h"
 #include <vulkan/vulkan.h>
+#include <algorithm>
 
 using namespace Core;
 using namespace GraphicsUtils;
@@ -18,52 +19,60 @@ Model::Model(std::string _name, Transform _transform)
      : name(std::move(_name)), transform(std::move(_transform))
 {
      transform.SetRotation({ 0, 1, 0, 0 });
-     Application::Get()->GetGpuData()->CreateData(*this);
 }
 
 Model& Model::operator=(Model&& other) noexcept
 {
      UniqueID::operator=(std::move(other));
-     name      = other.name;                 other.name = "";
-     meshes    = std::move(other.meshes);    other.meshes.clear();
-     transform = std::move(other.transform); other.transform = {};
+     name         = other.name;                 other.name = "";
+     meshes       = std::move(other.meshes);    other.meshes.clear();
+     transform    = std::move(other.transform); other.transform = {};
+     boundsCenter = other.boundsCenter;
+     boundsRadius = other.boundsRadius;
      return *this;
 }
 
-Model::~Model()
+void Model::UpdateBounds()
 {
-     Application::Get()->GetGpuData()->DestroyData(*this);
-}
-
-void Model::UpdateMvpBuffer(const Camera& camera, const uint32_t& currentFrame, const GpuData<Model>* gpuData) const
-{
-     if (!gpuData) gpuData = Application::Get()->GetGpuData()->GetData(*this);
-     
-     // Copy the matrices to buffer memory.
-     const MvpBuffer mvp = { transform.GetLocalMat(), transform.GetLocalMat() * camera.GetViewMat() * camera.GetProjMat() };
-     memcpy(gpuData->vkMvpBuffersMapped[currentFrame], &mvp, sizeof(mvp));
+     if (meshes.empty()) return;
+
+     // Center the sphere on the meshes' bounding box and grow it to enclose each mesh's sphere.
+     Vector3 min = meshes[0].GetBoundsCenter(), max = min;
+     for (const Mesh& mesh : meshes) {
+          const Vector3& center = mesh.GetBoundsCenter();
+          const float    radius = mesh.GetBoundsRadius();
+          min = { std::min(min.x, center.x - radius), std::min(min.y, center.y - radius), std::min(min.z, center.z - radius) };
+          max = { std::max(max.x, center.x + radius), std::max(max.y, center.y + radius), std::max(max.z, center.z + radius) };
+     }
+     boundsCenter = (min + max) * 0.5f;
+     boundsRadius = 0;
+     for (const Mesh& mesh : meshes)
+          boundsRadius = std::max(boundsRadius, (mesh.GetBoundsCenter() - boundsCenter).GetLength() + mesh.GetBoundsRadius());
 }
 
 
 template<> const GpuArray<Model>& GpuDataManager::CreateArray()
 {
-     if (modelsArray.vkDescriptorSetLayout && modelsArray.vkDescriptorPool) return modelsArray;
+     if (CheckArray<Model>()) return modelsArray;
 
      // Get the necessary vulkan resources.
-     const VkDevice vkDevice = renderer->GetVkDevice();
+     const VkDevice         vkDevice         = renderer->GetVkDevice();
+     const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
      
-     // Set the binding of the mvp buffer object.
-     VkDescriptorSetLayoutBinding mvpLayoutBinding{};
-     mvpLayoutBinding.binding         = 0;
-     mvpLayoutBinding.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-     mvpLayoutBinding.descriptorCount = 1;
-     mvpLayoutBinding.stageFlags      = VK_SHADER_STAGE_ALL;
+     // Set the bindings of the instance data and visible instance indices buffers.
+     VkDescriptorSetLayoutBinding layoutBindings[2] = {{},{}};
+     for (uint32_t i = 0; i < 2; i++) {
+          layoutBindings[i].binding         = i;
+          layoutBindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+          layoutBindings[i].descriptorCount = 1;
+          layoutBindings[i].stageFlags      = VK_SHADER_STAGE_ALL;
+     }
 
      // Create the descriptor set layout.
      VkDescriptorSetLayoutCreateInfo layoutInfo{};
      layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-     layoutInfo.bindingCount = 1;
-     layoutInfo.pBindings    = &mvpLayoutBinding;
+     layoutInfo.bindingCount = 2;
+     layoutInfo.pBindings    = layoutBindings;
      if (vkCreateDescriptorSetLayout(vkDevice, &layoutInfo, nullptr, &modelsArray.vkDescriptorSetLayout) != VK_SUCCESS) {
           LogError(LogType::Vulkan, "Failed to create descriptor set layout.");
           throw std::runtime_error("VULKAN_DESCRIPTOR_SET_LAYOUT_ERROR");
@@ -71,77 +80,86 @@ template<> const GpuArray<Model>& GpuDataManager::CreateArray()
 
      // Set the type and number of descriptors.
      VkDescriptorPoolSize poolSize{};
-     poolSize.type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-     poolSize.descriptorCount = MAX_FRAMES_IN_FLIGHT * Engine::MAX_MODELS;
+     poolSize.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+     poolSize.descriptorCount = 2;
 
      // Create the descriptor pool.
      VkDescriptorPoolCreateInfo poolInfo{};
      poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
      poolInfo.poolSizeCount = 1;
      poolInfo.pPoolSizes    = &poolSize;
-     poolInfo.maxSets       = MAX_FRAMES_IN_FLIGHT * Engine::MAX_MODELS;
+     poolInfo.maxSets       = 1;
      if (vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &modelsArray.vkDescriptorPool) != VK_SUCCESS) {
           LogError(LogType::Vulkan, "Failed to create descriptor pool.");
           throw std::runtime_error("VULKAN_DESCRIPTOR_POOL_ERROR");
      }
 
-     return modelsArray;
-}
+     // Pack instance data tightly and align each frame's region to the device's dynamic offset alignment.
+     VkPhysicalDeviceProperties deviceProperties;
+     vkGetPhysicalDeviceProperties(vkPhysicalDevice, &deviceProperties);
+     const VkDeviceSize alignment = deviceProperties.limits.minStorageBufferOffsetAlignment;
+     modelsArray.capacity    = (uint32_t)Engine::MAX_INSTANCES;
+     modelsArray.vkStride    = sizeof(InstanceData);
+     modelsArray.vkFrameSize = (modelsArray.vkStride * modelsArray.capacity + alignment - 1) & ~(alignment - 1);
+
+     // Create the ring buffer and keep it mapped.
+     const VkDeviceSize bufferSize = modelsArray.vkFrameSize * MAX_FRAMES_IN_FLIGHT;
+     CreateBuffer(vkDevice, vkPhysicalDevice, bufferSize,
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  modelsArray.vkBuffer, modelsArray.vkBufferMemory);
+     vkMapMemory(vkDevice, modelsArray.vkBufferMemory, 0, bufferSize, 0, &modelsArray.vkBufferMapped);
+     modelsArray.vkMemorySize = GetBufferMemorySize(vkDevice, modelsArray.vkBuffer);
+     TrackMemory(GpuMemoryCategory::Models, modelsArray.vkMemorySize);
+
+     // Create the indirect draw commands buffer, each instance can be drawn by a separate command.
+     const VkDeviceSize drawBufferSize = sizeof(VkDrawIndexedIndirectCommand) * modelsArray.capacity * MAX_FRAMES_IN_FLIGHT;
+     CreateBuffer(vkDevice, vkPhysicalDevice, drawBufferSize,
+                  VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  modelsArray.vkDrawBuffer, modelsArray.vkDrawBufferMemory);
+     vkMapMemory(vkDevice, modelsArray.vkDrawBufferMemory, 0, drawBufferSize, 0, &modelsArray.vkDrawBufferMapped);
+     modelsArray.vkDrawMemorySize = GetBufferMemorySize(vkDevice, modelsArray.vkDrawBuffer);
+     TrackMemory(GpuMemoryCategory::Models, modelsArray.vkDrawMemorySize);
+
+     // Create the visible instance indices buffer, draws read their instances' matrices through it.
+     const VkDeviceSize visibleBufferSize = sizeof(uint32_t) * modelsArray.capacity * MAX_FRAMES_IN_FLIGHT;
+     CreateBuffer(vkDevice, vkPhysicalDevice, visibleBufferSize,
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  modelsArray.vkVisibleBuffer, modelsArray.vkVisibleBufferMemory);
+     vkMapMemory(vkDevice, modelsArray.vkVisibleBufferMemory, 0, visibleBufferSize, 0, &modelsArray.vkVisibleBufferMapped);
+     modelsArray.vkVisibleMemorySize = GetBufferMemorySize(vkDevice, modelsArray.vkVisibleBuffer);
+     TrackMemory(GpuMemoryCategory::Models, modelsArray.vkVisibleMemorySize);
+
+     // Allocate the descriptor set.
+     VkDescriptorSetAllocateInfo allocInfo{};
+     allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+     allocInfo.descriptorPool     = modelsArray.vkDescriptorPool;
+     allocInfo.descriptorSetCount = 1;
+     allocInfo.pSetLayouts        = &modelsArray.vkDescriptorSetLayout;
+     if (vkAllocateDescriptorSets(vkDevice, &allocInfo, &modelsArray.vkDescriptorSet) != VK_SUCCESS) {
+          LogError(LogType::Vulkan, "Failed to allocate descriptor sets.");
+          throw std::runtime_error("VULKAN_DESCRIPTOR_SET_ALLOCATION_ERROR");
+     }
 
-template<> const GpuData<Model>& GpuDataManager::CreateData(const Model& resource)
-{
-     if (resource.GetID() == UniqueID::unassigned) {
-          LogError(LogType::Resources, "Can't create GPU data from unassigned resource.");
-          throw std::runtime_error("RESOURCE_UNASSIGNED_ERROR");
+     // Point the descriptors to a single frame's region, the dynamic offsets select which one.
+     VkDescriptorBufferInfo bufferInfos[2] = {{},{}};
+     bufferInfos[0].buffer = modelsArray.vkBuffer;
+     bufferInfos[0].offset = 0;
+     bufferInfos[0].range  = modelsArray.vkFrameSize;
+     bufferInfos[1].buffer = modelsArray.vkVisibleBuffer;
+     bufferInfos[1].offset = 0;
+     bufferInfos[1].range  = sizeof(uint32_t) * modelsArray.capacity;
+
+     VkWriteDescriptorSet descriptorWrites[2] = {{},{}};
+     for (uint32_t i = 0; i < 2; i++) {
+          descriptorWrites[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+          descriptorWrites[i].dstSet          = modelsArray.vkDescriptorSet;
+          descriptorWrites[i].dstBinding      = i;
+          descriptorWrites[i].dstArrayElement = 0;
+          descriptorWrites[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+          descriptorWrites[i].descriptorCount = 1;
+          descriptorWrites[i].pBufferInfo     = &bufferInfos[i];
      }
-    GpuData<Model>& data = models.emplace(std::make_pair(resource.GetID(), GpuData<Model>())).first->second;
-
-    // Get necessary vulkan resources.
-    const VkDevice         vkDevice         = renderer->GetVkDevice();
-    const VkPhysicalDevice vkPhysicalDevice = renderer->GetVkPhysicalDevice();
-
-    // Create the buffers.
-    constexpr VkDeviceSize mvpSize = sizeof(Maths::MvpBuffer);
-    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        CreateBuffer(vkDevice, vkPhysicalDevice, mvpSize,
-                     VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     data.vkMvpBuffers[i], data.vkMvpBuffersMemory[i]);
-
-        vkMapMemory(vkDevice, data.vkMvpBuffersMemory[i], 0, mvpSize, 0, &data.vkMvpBuffersMapped[i]);
-    }
-
-    // Allocate the descriptor sets.
-    const std::vector layouts(MAX_FRAMES_IN_FLIGHT, modelsArray.vkDescriptorSetLayout);
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool     = modelsArray.vkDescriptorPool;
-    allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
-    allocInfo.pSetLayouts        = layouts.data();
-    if (vkAllocateDescriptorSets(vkDevice, &allocInfo, data.vkDescriptorSets) != VK_SUCCESS) {
-        LogError(LogType::Vulkan, "Failed to allocate descriptor sets.");
-        throw std::runtime_error("VULKAN_DESCRIPTOR_SET_ALLOCATION_ERROR");
-    }
-
-    // Populate the descriptor sets.
-    for (unsigned int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        VkDescriptorBufferInfo mvpBufferInfo{};
-        mvpBufferInfo.buffer = data.vkMvpBuffers[i];
-        mvpBufferInfo.offset = 0;
-        mvpBufferInfo.range  = mvpSize;
-        
-        VkWriteDescriptorSet descriptorWrite{};
-        descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.dstSet          = data.vkDescriptorSets[i];
-        descriptorWrite.dstBinding      = 0;
-        descriptorWrite.dstArrayElement = 0;
-        descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.pBufferInfo     = &mvpBufferInfo;
-        
-        vkUpdateDescriptorSets(vkDevice, 1, &descriptorWrite, 0, nullptr);
-    }
-    
-    return data;
+     vkUpdateDescriptorSets(vkDevice, 2, descriptorWrites, 0, nullptr);
+
+     return modelsArray;
 }
@@ -3,6 +3,7 @@
 #include "Core/Logger.h"
 #include "Core/Renderer.h"
 #include "Core/GpuDataManager.h"
+#include "Core/MipGenerator.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #include <vulkan/vulkan.h>
@@ -22,6 +23,13 @@ Texture::Texture(std::string filename, const bool& containsColorData)
     }
     mipLevels = (uint32_t)std::floor(std::log2(std::max(width, height))) + 1;
 
+    // Check the alpha channel, so that materials with fully opaque textures aren't alpha tested.
+    if (channels == 4) {
+        const size_t pixelCount = (size_t)width * height;
+        for (size_t i = 0; i < pixelCount && !hasAlpha; i++)
+            hasAlpha = pixels[i * 4 + 3] < 255;
+    }
+
     // Send the texture data to the GPU and delete CPU data.
     Application::Get()->GetGpuData()->CreateData(*this);
     stbi_image_free(pixels);
@@ -29,8 +37,11 @@ Texture::Texture(std::string filename, const bool& containsColorData)
 }
 
 Texture::Texture(Texture&& other) noexcept
-    : UniqueID(std::move(other)), name(std::move(other.name)), containsColor(other.containsColor), width(other.width), height(other.height), channels(other.channels), mipLevels(other.mipLevels), pixels(other.pixels)
-{}
+    : UniqueID(std::move(other)), name(std::move(other.name)), containsColor(other.containsColor), width(other.width), height(other.height), channels(other.channels), mipLevels(other.mipLevels), hasAlpha(other.hasAlpha), pixels(other.pixels), gpuHandle(other.gpuHandle)
+{
+    other.pixels    = nullptr;
+    other.gpuHandle = {};
+}
 
 Texture& Texture::operator=(Texture&& other) noexcept
 {
@@ -41,13 +52,17 @@ Texture& Texture::operator=(Texture&& other) noexcept
     height    = other.height;
     channels  = other.channels;
     mipLevels = other.mipLevels;
+    hasAlpha  = other.hasAlpha;
     pixels    = other.pixels;
+    gpuHandle = other.gpuHandle;
     other.name      = "";
     other.width     = 0;
     other.height    = 0;
     other.channels  = 0;
     other.mipLevels = 0;
+    other.hasAlpha  = false;
     other.pixels    = nullptr;
+    other.gpuHandle = {};
     return *this;
 }
 
@@ -70,10 +85,65 @@ template<> const GpuData<Texture>& GpuDataManager::CreateData(const Texture& res
         LogError(LogType::Resources, "Can't create GPU data from unassigned resource.");
         throw std::runtime_error("RESOURCE_UNASSIGNED_ERROR");
     }
-    if (textures.find(resource.GetID()) != textures.end()) return textures.at(resource.GetID());
+    if (const GpuData<Texture>* existing = textures.Get(resource.gpuHandle)) return *existing;
+    
+    GpuData<Texture>& data = textures.Emplace(resource.gpuHandle);
+    data.vkImageFormat  = resource.ContainsColorData() ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    data.sourceFile     = resource.GetName();
+    data.width          = (uint32_t)resource.GetWidth();
+    data.height         = (uint32_t)resource.GetHeight();
+    data.mipLevels      = resource.GetMipLevels();
+    data.lastUsedFrame  = renderer->GetFrameIndex();
+    data.residencyEntry = residencyList.insert(residencyList.end(), { resource.gpuHandle, {} });
+
+    // Send the pixels to the GPU.
+    UploadTextureImage(data, resource.GetPixels());
+
+    // Keep track of the memory used by the image.
+    data.vkMemorySize = GetImageMemorySize(renderer->GetVkDevice(), data.vkImage);
+    TrackMemory(GpuMemoryCategory::Textures, data.vkMemorySize);
+
+    // Give the texture a slot in the bindless texture array.
+    data.bindlessIndex = AllocateSlot(materialsArray.freeTextureSlots, materialsArray.textureSlotCount, MAX_BINDLESS_TEXTURES);
+    if (data.bindlessIndex == INVALID_BINDLESS_INDEX)
+        LogWarning(LogType::Vulkan, "Too many textures loaded at once, " + resource.GetName() + " won't be sampled. Increase GraphicsUtils::MAX_BINDLESS_TEXTURES.");
+    WriteTextureDescriptor(data);
     
-    GpuData<Texture>& data = textures.emplace(std::make_pair(resource.GetID(), GpuData<Texture>())).first->second;
-    data.vkImageFormat = resource.ContainsColorData() ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    return data;
+}
+
+void GpuDataManager::WriteTextureDescriptor(const GpuData<Texture>& data) const
+{
+    if (data.bindlessIndex == GraphicsUtils::INVALID_BINDLESS_INDEX || !materialsArray.vkDescriptorSet) return;
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageView   = data.vkImageView;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.sampler     = renderer->GetVkTextureSampler();
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet          = materialsArray.vkDescriptorSet;
+    descriptorWrite.dstBinding      = 1;
+    descriptorWrite.dstArrayElement = data.bindlessIndex;
+    descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo      = &imageInfo;
+    vkUpdateDescriptorSets(renderer->GetVkDevice(), 1, &descriptorWrite, 0, nullptr);
+}
+
+void GpuDataManager::RemapTextureSlot(const uint32_t& oldSlot, const uint32_t& newSlot)
+{
+    // Only called once the new slot's image is uploaded, the frames still in flight then read either slot and the old one stays valid until it is retired.
+    MaterialData* materialData = (MaterialData*)materialsArray.vkBufferMapped;
+    for (uint32_t i = 0; i < materialsArray.materialSlotCount; i++)
+        for (uint32_t& textureIndex : materialData[i].textureIndices)
+            if (textureIndex == oldSlot) textureIndex = newSlot;
+}
+
+void GpuDataManager::UploadTextureImage(GpuData<Texture>& data, const unsigned char* pixels)
+{
+    using namespace GraphicsUtils;
 
     // Get necessary vulkan resources.
     const VkDevice         device         = renderer->GetVkDevice();
@@ -82,9 +152,9 @@ template<> const GpuData<Texture>& GpuDataManager::CreateData(const Texture& res
     const VkQueue          graphicsQueue  = renderer->GetVkGraphicsQueue();
 
     // Get texture data.
-    const int      width     = resource.GetWidth();
-    const int      height    = resource.GetHeight();
-    const uint32_t mipLevels = resource.GetMipLevels();
+    const int      width     = (int)data.width;
+    const int      height    = (int)data.height;
+    const uint32_t mipLevels = data.mipLevels;
     const VkDeviceSize imageSize = (VkDeviceSize)(width * height) * 4;
 
     // Create a transfer buffer to send the pixels to the GPU.
@@ -97,103 +167,82 @@ template<> const GpuData<Texture>& GpuDataManager::CreateData(const Texture& res
     // Copy the pixels to the transfer buffer.
     void* mapMem;
     vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &mapMem);
-    memcpy(mapMem, resource.GetPixels(), (size_t)imageSize);
+    memcpy(mapMem, pixels, (size_t)imageSize);
     vkUnmapMemory(device, stagingBufferMemory);
 
-    // Create the Vulkan image.
+    // Create the Vulkan image, with the usage and flags needed to generate its mips by compute.
+    MipGenerator* mipGenerator = renderer->GetMipGenerator();
     CreateImage(device, physicalDevice, width, height, mipLevels, VK_SAMPLE_COUNT_1_BIT, data.vkImageFormat, VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                data.vkImage, data.vkImageMemory);
-
-    // Copy the transfer buffer to the vulkan image.
-    TransitionImageLayout(device, commandPool, graphicsQueue, data.vkImage, data.vkImageFormat, mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    CopyBufferToImage    (device, commandPool, graphicsQueue, stagingBuffer, data.vkImage, (uint32_t)width, (uint32_t)height);
-
-    // Check if image format supports linear blitting.
-    VkFormatProperties formatProperties;
-    vkGetPhysicalDeviceFormatProperties(physicalDevice, data.vkImageFormat, &formatProperties);
-    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-        LogError(LogType::Resources, "Texture image format does not support linear blitting.");
-        throw std::runtime_error("TEXTURE_BLITTING_ERROR");
-    }
+                mipGenerator->GetImageUsage(), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                data.vkImage, data.vkImageMemory, mipGenerator->GetImageFlags(data.vkImageFormat), mipGenerator->GetImageFormatList(data.vkImageFormat));
 
-    // Begin commands and create a memory barrier used to create mipmaps.
-    const VkCommandBuffer commandBuffer = BeginSingleTimeCommands(device, commandPool);
-    VkImageMemoryBarrier barrier{};
-    barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.image                           = data.vkImage;
-    barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount     = 1;
-    barrier.subresourceRange.levelCount     = 1;
-
-    // Create texture mipmaps.
-    int32_t mipWidth  = width;
-    int32_t mipHeight = height;
-    for (uint32_t i = 1; i < mipLevels; i++)
+    // Record the copy and the mip generation in the upload command buffer if there is one, the staging buffer is then retired with its frame.
+    // Formats that can't be blitted linearly are uploaded synchronously, since compute generation reuses its descriptor sets.
+    if (vkUploadCommandBuffer && mipGenerator->CanRecord(data.vkImageFormat))
     {
-        barrier.subresourceRange.baseMipLevel = i - 1;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-        vkCmdPipelineBarrier(commandBuffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-            0, nullptr, 0, nullptr, 1, &barrier);
-
-        VkImageBlit blit{};
-        blit.srcOffsets[0] = {0, 0, 0};
-        blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
-        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        blit.srcSubresource.mipLevel = i - 1;
-        blit.srcSubresource.baseArrayLayer = 0;
-        blit.srcSubresource.layerCount = 1;
-        blit.dstOffsets[0] = {0, 0, 0};
-        blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        blit.dstSubresource.mipLevel = i;
-        blit.dstSubresource.baseArrayLayer = 0;
-        blit.dstSubresource.layerCount = 1;
-
-        vkCmdBlitImage(commandBuffer,
-            data.vkImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            data.vkImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &blit, VK_FILTER_LINEAR);
-
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        vkCmdPipelineBarrier(commandBuffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-            0, nullptr, 0, nullptr, 1, &barrier);
-
-        if (mipWidth > 1) mipWidth /= 2;
-        if (mipHeight > 1) mipHeight /= 2;
+        VkImageMemoryBarrier barrier{};
+        barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image               = data.vkImage;
+        barrier.subresourceRange    = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+        barrier.srcAccessMask       = 0;
+        barrier.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(vkUploadCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        region.imageExtent      = { data.width, data.height, 1 };
+        vkCmdCopyBufferToImage(vkUploadCommandBuffer, stagingBuffer, data.vkImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        mipGenerator->Record(vkUploadCommandBuffer, data.vkImage, data.width, data.height, mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        DeferDeletion([device, stagingBuffer, stagingBufferMemory]
+        {
+            vkDestroyBuffer(device, stagingBuffer,       nullptr);
+            vkFreeMemory   (device, stagingBufferMemory, nullptr);
+        });
     }
+    else
+    {
+        // Copy the transfer buffer to the vulkan image.
+        TransitionImageLayout(device, commandPool, graphicsQueue, data.vkImage, data.vkImageFormat, mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        CopyBufferToImage    (device, commandPool, graphicsQueue, stagingBuffer, data.vkImage, (uint32_t)width, (uint32_t)height);
 
-    barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    vkCmdPipelineBarrier(commandBuffer,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-        0, nullptr, 0, nullptr, 1, &barrier);
-
-    EndSingleTimeCommands(device, commandPool, graphicsQueue, commandBuffer);
+        // Generate the mipmaps from the first level.
+        mipGenerator->Generate(data.vkImage, data.vkImageFormat, data.width, data.height, mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-    // Cleanup allocated resources.
-    vkDestroyBuffer(device, stagingBuffer,       nullptr);
-    vkFreeMemory   (device, stagingBufferMemory, nullptr);
+        // Cleanup allocated resources.
+        vkDestroyBuffer(device, stagingBuffer,       nullptr);
+        vkFreeMemory   (device, stagingBufferMemory, nullptr);
+    }
 
     // Create the texture image view.
     CreateImageView(device, data.vkImage, data.vkImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, data.vkImageView);
-    
-    return data;
+}
+
+void GpuDataManager::BenchmarkMipGeneration()
+{
+    // Wait for the frames in flight to stop sampling the textures.
+    renderer->WaitUntilIdle();
+
+    // Regenerate the mips of each texture with both methods, evicted textures only have their mip tail.
+    // The selected method runs last, so that the textures are left with its mips.
+    MipGenerator* mipGenerator = renderer->GetMipGenerator();
+    const bool    computeLast  = mipGenerator->GetMethod() == MipMethod::Compute;
+    uint32_t textureCount = 0;
+    float    computeTime  = 0, blitTime = 0;
+    textures.ForEach([&](GpuData<Texture>& data)
+    {
+        if (data.residentMip != 0 || data.mipLevels <= 1) return;
+        const auto generate = [&](const MipMethod& method) {
+            return mipGenerator->Generate(data.vkImage, data.vkImageFormat, data.width, data.height, data.mipLevels, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, method);
+        };
+        if (computeLast) { blitTime    += generate(MipMethod::Blit);    computeTime += generate(MipMethod::Compute); }
+        else             { computeTime += generate(MipMethod::Compute); blitTime    += generate(MipMethod::Blit);    }
+        textureCount++;
+    });
+    LogInfo(LogType::Resources, "Generated the mips of " + std::to_string(textureCount) + " textures. "
+                              + "Compute (" + MipFilterToStr(mipGenerator->GetFilter()) + " filter): " + std::to_string(computeTime) + "ms | "
+                              + "Blit: " + std::to_string(blitTime) + "ms");
 }